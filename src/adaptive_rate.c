@@ -0,0 +1,199 @@
+#include "adaptive_rate.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Initializes the adaptive sampling scheduler. Sampling starts at the
+ * ceiling interval and tightens on the first fast change.
+ *
+ * @param rate The scheduler to initialize.
+ * @param config The configuration, copied into the scheduler.
+ */
+void init_adaptive_rate(adaptive_rate_t *rate, const adaptive_rate_config_t *config)
+{
+    memset(rate, 0, sizeof(*rate));
+    rate->config = *config;
+
+    if (rate->config.floor_us <= 0)
+        rate->config.floor_us = RATE_BUCKET_BASE_US;
+    if (rate->config.ceiling_us < rate->config.floor_us)
+        rate->config.ceiling_us = rate->config.floor_us;
+
+    rate->interval_us = rate->config.ceiling_us;
+}
+
+/**
+ * Returns the statistics bucket of an interval.
+ */
+static int rate_bucket(long interval_us)
+{
+    int bucket = 0;
+    for (long bound = RATE_BUCKET_BASE_US; interval_us > bound && bucket < RATE_BUCKETS - 1; bound *= 2) {
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * Checks whether a reading changes faster than the given slope.
+ *
+ * @param delta Change of the reading over the measured span.
+ * @param span_us The measured span.
+ * @param slope Change per second considered fast, 0 disables the check.
+ * @param fast Whether the readings already change fast: the change then has
+ *     to drop below half the slope to be steady again.
+ */
+static int is_fast(int delta, int64_t span_us, int slope, int fast)
+{
+    int64_t limit = (int64_t)slope * span_us;
+
+    if (fast)
+        limit /= 2;
+    return slope > 0 && (int64_t)abs(delta) * 1000000 > limit;
+}
+
+/**
+ * Computes the interval until the next sample.
+ *
+ * The interval drops to the floor while temperature, load or power change
+ * faster than their configured slopes, and doubles with every steady sample
+ * up to the ceiling. Slopes are measured from a reference sample at least
+ * RATE_SLOPE_WINDOW_US old (or over that span while younger), which filters
+ * the integer steps of the readings, with hysteresis between fast and
+ * steady.
+ *
+ * @param rate The scheduler.
+ * @param values The sample just taken.
+ * @param now Time the sample was taken (CLOCK_MONOTONIC).
+ * @return The interval until the next sample in microseconds.
+ */
+long adaptive_rate_next(adaptive_rate_t *rate, const sensors_values_t *values, const struct timespec *now)
+{
+    const adaptive_rate_config_t *config = &rate->config;
+    int64_t now_us = now->tv_sec * 1000000LL + now->tv_nsec / 1000;
+
+    if (!rate->primed) {
+        rate->primed = 1;
+        rate->reference = rate->pending = *values;
+        rate->reference_us = rate->pending_us = now_us;
+        rate->last_us = now_us;
+        return rate->interval_us;
+    }
+
+    if (now_us > rate->last_us)
+        rate->time_at_rate_us[rate_bucket(rate->interval_us)] += now_us - rate->last_us;
+    rate->last_us = now_us;
+
+    int64_t span_us = now_us - rate->reference_us;
+    if (span_us < RATE_SLOPE_WINDOW_US)
+        span_us = RATE_SLOPE_WINDOW_US;
+
+    rate->fast = is_fast(values->cpu_temp - rate->reference.cpu_temp, span_us, config->temp_slope, rate->fast)
+              || is_fast(values->cpu_usage - rate->reference.cpu_usage, span_us, config->load_slope, rate->fast)
+              || is_fast(values->cpu_power - rate->reference.cpu_power, span_us, config->power_slope, rate->fast);
+
+    if (rate->fast) {
+        rate->interval_us = config->floor_us;
+    } else if (rate->interval_us < config->ceiling_us) {
+        rate->interval_us *= 2;
+        if (rate->interval_us > config->ceiling_us)
+            rate->interval_us = config->ceiling_us;
+    }
+
+    if (now_us - rate->pending_us >= RATE_SLOPE_WINDOW_US) {
+        rate->reference = rate->pending;
+        rate->reference_us = rate->pending_us;
+        rate->pending = *values;
+        rate->pending_us = now_us;
+    }
+
+    return rate->interval_us;
+}
+
+/**
+ * Drops the interval to the floor, e.g. on a CPU pressure step.
+ *
+ * @param rate The scheduler.
+ */
+void adaptive_rate_boost(adaptive_rate_t *rate)
+{
+    rate->interval_us = rate->config.floor_us;
+}
+
+/**
+ * Changes the configuration while keeping the last sample and the
+ * statistics. The current interval is clamped to the new bounds.
+ *
+ * @param rate The scheduler.
+ * @param config The new configuration, copied into the scheduler.
+ */
+void set_adaptive_rate_config(adaptive_rate_t *rate, const adaptive_rate_config_t *config)
+{
+    rate->config = *config;
+
+    if (rate->config.floor_us <= 0)
+        rate->config.floor_us = RATE_BUCKET_BASE_US;
+    if (rate->config.ceiling_us < rate->config.floor_us)
+        rate->config.ceiling_us = rate->config.floor_us;
+
+    if (rate->interval_us < rate->config.floor_us)
+        rate->interval_us = rate->config.floor_us;
+    if (rate->interval_us > rate->config.ceiling_us)
+        rate->interval_us = rate->config.ceiling_us;
+}
+
+/**
+ * Parses a "floor_ms:ceiling_ms" specification such as "100:5000".
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to update.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_adaptive_rate_config(const char *spec, adaptive_rate_config_t *config)
+{
+    long floor_ms, ceiling_ms;
+
+    if (sscanf(spec, "%ld:%ld", &floor_ms, &ceiling_ms) != 2)
+        return 0;
+
+    if (floor_ms < 10 || ceiling_ms < floor_ms)
+        return 0;
+
+    config->floor_us = floor_ms * 1000;
+    config->ceiling_us = ceiling_ms * 1000;
+    return 1;
+}
+
+/**
+ * Logs the share of time spent at each sampling interval.
+ *
+ * @param time_at_rate_us Time spent per interval bucket.
+ */
+void log_adaptive_rate_stats(const uint64_t time_at_rate_us[RATE_BUCKETS])
+{
+    uint64_t total = 0;
+    for (int i = 0; i < RATE_BUCKETS; i++) {
+        total += time_at_rate_us[i];
+    }
+    if (total == 0)
+        return;
+
+    long bound = RATE_BUCKET_BASE_US;
+    for (int i = 0; i < RATE_BUCKETS; i++, bound *= 2) {
+        if (time_at_rate_us[i] == 0)
+            continue;
+
+        if (i < RATE_BUCKETS - 1) {
+            loginfo("Sampling interval <= %ld ms: %llu s (%llu%%)\n", bound / 1000,
+                (unsigned long long)(time_at_rate_us[i] / 1000000),
+                (unsigned long long)(time_at_rate_us[i] * 100 / total));
+        } else {
+            loginfo("Sampling interval > %ld ms: %llu s (%llu%%)\n", bound / 2000,
+                (unsigned long long)(time_at_rate_us[i] / 1000000),
+                (unsigned long long)(time_at_rate_us[i] * 100 / total));
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef _ADAPTIVE_RATE__H
+#define _ADAPTIVE_RATE__H
+
+#include "sensors_wrap.h"
+
+#include <stdint.h>
+#include <time.h>
+
+/** Number of interval buckets in the time-at-rate statistics */
+#define RATE_BUCKETS 8
+
+/** Upper bound of the first bucket, each next bucket doubles it (100ms, 200ms, ... 6.4s, more) */
+#define RATE_BUCKET_BASE_US (100000L)
+
+/** Shortest span the slopes are measured over, so that a single degree
+ * step between two close samples does not read as a fast change */
+#define RATE_SLOPE_WINDOW_US (1000000LL)
+
+struct adaptive_rate_config {
+    long floor_us;          // shortest interval, used while readings change quickly
+    long ceiling_us;        // longest interval, reached while readings are steady
+    int temp_slope;         // C/s considered a fast change
+    int load_slope;         // %/s considered a fast change
+    int power_slope;        // W/s considered a fast change
+};
+typedef struct adaptive_rate_config adaptive_rate_config_t;
+
+struct adaptive_rate {
+    adaptive_rate_config_t config;
+    long interval_us;
+
+    int primed;
+    int fast;                   // readings changing fast, left below half the slopes
+    int64_t last_us;            // time of the previous sample
+
+    // Samples the slopes are measured from: the reference is between one
+    // and two windows old, the pending one becomes the reference next
+    sensors_values_t reference, pending;
+    int64_t reference_us, pending_us;
+
+    uint64_t time_at_rate_us[RATE_BUCKETS];
+};
+typedef struct adaptive_rate adaptive_rate_t;
+
+void init_adaptive_rate(adaptive_rate_t *rate, const adaptive_rate_config_t *config);
+long adaptive_rate_next(adaptive_rate_t *rate, const sensors_values_t *values, const struct timespec *now);
+void adaptive_rate_boost(adaptive_rate_t *rate);
+void set_adaptive_rate_config(adaptive_rate_t *rate, const adaptive_rate_config_t *config);
+int parse_adaptive_rate_config(const char *spec, adaptive_rate_config_t *config);
+void log_adaptive_rate_stats(const uint64_t time_at_rate_us[RATE_BUCKETS]);
+
+#endif // _ADAPTIVE_RATE__H
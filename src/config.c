@@ -0,0 +1,107 @@
+#include "config.h"
+#include "logger.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * Strips leading and trailing whitespace in place.
+ *
+ * @param text The string to strip.
+ * @return Pointer to the first non-blank character.
+ */
+static char* strip(char *text)
+{
+    while (isspace((unsigned char)*text))
+        text++;
+
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+
+    return text;
+}
+
+/**
+ * Reads a configuration file made of "key = value" lines. Blank lines and
+ * everything after a '#' are ignored.
+ *
+ * All lines are read even if some are invalid, so that every error is
+ * reported at once.
+ *
+ * @param path Path of the configuration file.
+ * @param handler Called for each setting.
+ * @param userdata Passed to the handler.
+ * @return 1 if the file was read and all settings are valid, 0 otherwise.
+ */
+int read_config_file(const char *path, config_handler_t handler, void *userdata)
+{
+    char line[CONFIG_LINE_MAX];
+    int line_nr = 0;
+    int valid = 1;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        logerror("Unable to open %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        line_nr++;
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char *key = strip(line);
+        if (*key == '\0')
+            continue;
+
+        char *value = strchr(key, '=');
+        if (!value) {
+            logerror("%s:%d: expected key = value\n", path, line_nr);
+            valid = 0;
+            continue;
+        }
+        *value++ = '\0';
+
+        key = strip(key);
+        value = strip(value);
+
+        if (!handler(key, value, userdata)) {
+            logerror("%s:%d: invalid setting %s = %s\n", path, line_nr, key, value);
+            valid = 0;
+        }
+    }
+
+    fclose(file);
+    return valid;
+}
+
+/**
+ * Parses a yes/no setting.
+ *
+ * @param value "yes", "no", "true", "false", "on", "off", "1" or "0".
+ * @param result Set to 1 or 0.
+ * @return 1 if the value is valid, 0 otherwise.
+ */
+int parse_config_bool(const char *value, int *result)
+{
+    static const char *true_values[] = { "yes", "true", "on", "1" };
+    static const char *false_values[] = { "no", "false", "off", "0" };
+
+    for (size_t i = 0; i < sizeof(true_values) / sizeof(true_values[0]); i++) {
+        if (!strcasecmp(value, true_values[i])) {
+            *result = 1;
+            return 1;
+        }
+        if (!strcasecmp(value, false_values[i])) {
+            *result = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
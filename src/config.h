@@ -0,0 +1,16 @@
+#ifndef _CONFIG__H
+#define _CONFIG__H
+
+/** Longest line of a configuration file */
+#define CONFIG_LINE_MAX 512
+
+/**
+ * Called for each "key = value" line of a configuration file.
+ * Returns 1 if the setting is valid, 0 otherwise.
+ */
+typedef int (*config_handler_t)(const char *key, const char *value, void *userdata);
+
+int read_config_file(const char *path, config_handler_t handler, void *userdata);
+int parse_config_bool(const char *value, int *result);
+
+#endif // _CONFIG__H
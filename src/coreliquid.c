@@ -117,7 +117,7 @@ struct message_fan_status_response {
     };
 };
 
-#define CONFIG_COUNT_FAN 7
+#define CONFIG_COUNT_FAN FAN_CURVE_POINTS
 
 // SET_FAN_DUTY_MODE
 struct config_fan_duty {
@@ -188,13 +188,14 @@ struct message_oled_show_clock {
 
 #pragma pack()
 
-const uint8_t fan_temp_preset_1[CONFIG_COUNT_FAN] = {35, 40, 70, 81, 81, 81, 81};
-const uint8_t fan_temp_preset_4[CONFIG_COUNT_FAN] = {35, 40, 70, 81, 81, 81, 81};
-const uint8_t fan_temp_preset_5[CONFIG_COUNT_FAN] = {35, 60, 70, 81, 81, 81, 81};
-
-const uint8_t fan_duty_preset_1[CONFIG_COUNT_FAN] = {28, 40, 70, 100, 100, 100, 100};
-const uint8_t fan_duty_preset_4[CONFIG_COUNT_FAN] = {60, 70, 100, 100, 100, 100, 100};
-const uint8_t fan_duty_preset_5[CONFIG_COUNT_FAN] = {20, 40, 50, 100, 100, 100, 100};
+/** Curves sent along with the preset modes, also the default custom curves */
+static const fan_curve_points_t fan_curve_presets[FAN_CHANNELS] = {
+    [FAN_CHANNEL_RADIATOR_1]  = { .temp = {35, 40, 70, 81, 81, 81, 81}, .duty = {28, 40, 70, 100, 100, 100, 100} },
+    [FAN_CHANNEL_RADIATOR_2]  = { .temp = {35, 40, 70, 81, 81, 81, 81}, .duty = {28, 40, 70, 100, 100, 100, 100} },
+    [FAN_CHANNEL_RADIATOR_3]  = { .temp = {35, 40, 70, 81, 81, 81, 81}, .duty = {28, 40, 70, 100, 100, 100, 100} },
+    [FAN_CHANNEL_WATER_BLOCK] = { .temp = {35, 40, 70, 81, 81, 81, 81}, .duty = {60, 70, 100, 100, 100, 100, 100} },
+    [FAN_CHANNEL_PUMP]        = { .temp = {35, 60, 70, 81, 81, 81, 81}, .duty = {20, 40, 50, 100, 100, 100, 100} },
+};
 
 /**
  * Sends a reset command to the MCU of the AIO device.
@@ -284,10 +285,10 @@ void set_oled_cpu_status(coreliquid_device* handle, int temperature, int frequen
  * Sets the fan duty mode for a Coreliquid device.
  *
  * @param handle Pointer to the CoreLiquid device handle.
- * @param fan_mode The fan mode to set for all fans. If set to FAN_MODE_CUSTOM,
- *                 predefined duty cycles will be applied to the fans.
+ * @param fan_mode The fan mode to set for all fans.
+ * @param curves Duty cycles of each channel, applied in FAN_MODE_CUSTOM.
  */
-void set_fan_duty_mode(coreliquid_device* handle, uint8_t fan_mode)
+static void set_fan_duty_mode(coreliquid_device* handle, uint8_t fan_mode, const fan_curve_points_t curves[FAN_CHANNELS])
 {
     struct message_fan_duty message;
     memset(&message.raw_buffer, 0, sizeof(message.raw_buffer));
@@ -306,11 +307,11 @@ void set_fan_duty_mode(coreliquid_device* handle, uint8_t fan_mode)
         },
     };
 
-    memcpy(message.config.duty_cycle_1, fan_duty_preset_1, sizeof(fan_duty_preset_1));
-    memcpy(message.config.duty_cycle_2, fan_duty_preset_1, sizeof(fan_duty_preset_1));
-    memcpy(message.config.duty_cycle_3, fan_duty_preset_1, sizeof(fan_duty_preset_1));
-    memcpy(message.config.duty_cycle_4, fan_duty_preset_4, sizeof(fan_duty_preset_4));
-    memcpy(message.config.duty_cycle_5, fan_duty_preset_5, sizeof(fan_duty_preset_5));
+    memcpy(message.config.duty_cycle_1, curves[FAN_CHANNEL_RADIATOR_1].duty, CONFIG_COUNT_FAN);
+    memcpy(message.config.duty_cycle_2, curves[FAN_CHANNEL_RADIATOR_2].duty, CONFIG_COUNT_FAN);
+    memcpy(message.config.duty_cycle_3, curves[FAN_CHANNEL_RADIATOR_3].duty, CONFIG_COUNT_FAN);
+    memcpy(message.config.duty_cycle_4, curves[FAN_CHANNEL_WATER_BLOCK].duty, CONFIG_COUNT_FAN);
+    memcpy(message.config.duty_cycle_5, curves[FAN_CHANNEL_PUMP].duty, CONFIG_COUNT_FAN);
 
     write_output(handle, message.raw_buffer, sizeof(message.raw_buffer));
 }
@@ -319,10 +320,10 @@ void set_fan_duty_mode(coreliquid_device* handle, uint8_t fan_mode)
 * Sets the temperature mode for all fans on a CoreLiquid device.
 *
 * @param handle Pointer to the CoreLiquid device handle.
-* @param fan_mode The temperature mode to set for all fans. If set to FAN_MODE_CUSTOM,
-*                 custom temperature presets will be applied to each fan.
+* @param fan_mode The temperature mode to set for all fans.
+* @param curves Temperature points of each channel, applied in FAN_MODE_CUSTOM.
 */
-void set_fan_temperature_mode(coreliquid_device* handle, uint8_t fan_mode)
+static void set_fan_temperature_mode(coreliquid_device* handle, uint8_t fan_mode, const fan_curve_points_t curves[FAN_CHANNELS])
 {
     struct message_fan_temperature message;
     memset(&message.raw_buffer, 0, sizeof(message.raw_buffer));
@@ -341,11 +342,11 @@ void set_fan_temperature_mode(coreliquid_device* handle, uint8_t fan_mode)
         }
     };
 
-    memcpy(message.config.fan_temp_1, fan_temp_preset_1, sizeof(fan_temp_preset_1));
-    memcpy(message.config.fan_temp_2, fan_temp_preset_1, sizeof(fan_temp_preset_1));
-    memcpy(message.config.fan_temp_3, fan_temp_preset_1, sizeof(fan_temp_preset_1));
-    memcpy(message.config.fan_temp_4, fan_temp_preset_4, sizeof(fan_temp_preset_4));
-    memcpy(message.config.fan_temp_5, fan_temp_preset_5, sizeof(fan_temp_preset_5));
+    memcpy(message.config.fan_temp_1, curves[FAN_CHANNEL_RADIATOR_1].temp, CONFIG_COUNT_FAN);
+    memcpy(message.config.fan_temp_2, curves[FAN_CHANNEL_RADIATOR_2].temp, CONFIG_COUNT_FAN);
+    memcpy(message.config.fan_temp_3, curves[FAN_CHANNEL_RADIATOR_3].temp, CONFIG_COUNT_FAN);
+    memcpy(message.config.fan_temp_4, curves[FAN_CHANNEL_WATER_BLOCK].temp, CONFIG_COUNT_FAN);
+    memcpy(message.config.fan_temp_5, curves[FAN_CHANNEL_PUMP].temp, CONFIG_COUNT_FAN);
 
     write_output(handle, message.raw_buffer, sizeof(message.raw_buffer));
 }
@@ -354,16 +355,60 @@ void set_fan_temperature_mode(coreliquid_device* handle, uint8_t fan_mode)
  * Sets the fan mode for a CoreLiquid device.
  *
  * @param handle Pointer to the CoreLiquid device handle.
- * @param fan_mode The desired fan mode to set.
+ * @param fan_mode The desired fan mode to set. FAN_MODE_CUSTOM applies the
+ *                 default curves, use set_fan_curves() for user curves.
  */
 void set_fan_mode(coreliquid_device* handle, fan_mode_t fan_mode)
 {
-    set_fan_duty_mode(handle, fan_mode);
+    set_fan_duty_mode(handle, fan_mode, fan_curve_presets);
     usleep(10000);
-    set_fan_temperature_mode(handle, fan_mode);
+    set_fan_temperature_mode(handle, fan_mode, fan_curve_presets);
     usleep(10000);
 }
 
+/**
+ * Switches all fans to FAN_MODE_CUSTOM with the given curves. The AIO then
+ * follows the curves on its own.
+ *
+ * @param handle Pointer to the CoreLiquid device handle.
+ * @param curves The curve of each fan channel.
+ */
+void set_fan_curves(coreliquid_device* handle, const fan_curve_points_t curves[FAN_CHANNELS])
+{
+    set_fan_duty_mode(handle, FAN_MODE_CUSTOM, curves);
+    usleep(10000);
+    set_fan_temperature_mode(handle, FAN_MODE_CUSTOM, curves);
+    usleep(10000);
+}
+
+/**
+ * Sets a constant duty cycle on each fan channel (FAN_MODE_CUSTOM with a
+ * flat curve), for curves evaluated by the host.
+ *
+ * @param handle Pointer to the CoreLiquid device handle.
+ * @param duty Duty cycle (%) of each fan channel.
+ */
+void set_fan_duty(coreliquid_device* handle, const uint8_t duty[FAN_CHANNELS])
+{
+    fan_curve_points_t curves[FAN_CHANNELS];
+
+    for (int channel = 0; channel < FAN_CHANNELS; channel++) {
+        curves[channel] = fan_curve_presets[channel];
+        memset(curves[channel].duty, duty[channel], CONFIG_COUNT_FAN);
+    }
+    set_fan_duty_mode(handle, FAN_MODE_CUSTOM, curves);
+}
+
+/**
+ * Returns the curves the AIO is configured with by default.
+ *
+ * @param curves Filled with the curve of each fan channel.
+ */
+void get_default_fan_curves(fan_curve_points_t curves[FAN_CHANNELS])
+{
+    memcpy(curves, fan_curve_presets, sizeof(fan_curve_presets));
+}
+
 /**
  * Sets the clock display style on the OLED screen.
  *
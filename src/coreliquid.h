@@ -13,6 +13,27 @@ enum fan_mode {
 };
 typedef enum fan_mode fan_mode_t;
 
+/** Number of points of a fan curve */
+#define FAN_CURVE_POINTS 7
+
+/** Fan channels of the AIO: 1-3 radiator, 4 water block, 5 pump */
+#define FAN_CHANNELS 5
+
+enum fan_channel {
+    FAN_CHANNEL_RADIATOR_1 = 0,
+    FAN_CHANNEL_RADIATOR_2 = 1,
+    FAN_CHANNEL_RADIATOR_3 = 2,
+    FAN_CHANNEL_WATER_BLOCK = 3,
+    FAN_CHANNEL_PUMP = 4
+};
+
+/** Duty cycle (%) applied by the AIO from each temperature (C) up */
+struct fan_curve_points {
+    uint8_t temp[FAN_CURVE_POINTS];
+    uint8_t duty[FAN_CURVE_POINTS];
+};
+typedef struct fan_curve_points fan_curve_points_t;
+
 struct cooler_status {
     uint16_t fan_radiator_speed;
     uint16_t fan_water_block_speed;
@@ -24,6 +45,9 @@ typedef struct cooler_status cooler_status_t;
 void set_reset_mcu(coreliquid_device* handle);
 int get_cooler_status(coreliquid_device* handle, cooler_status_t* status);
 void set_fan_mode(coreliquid_device* handle, fan_mode_t fan_mode);
+void set_fan_curves(coreliquid_device* handle, const fan_curve_points_t curves[FAN_CHANNELS]);
+void set_fan_duty(coreliquid_device* handle, const uint8_t duty[FAN_CHANNELS]);
+void get_default_fan_curves(fan_curve_points_t curves[FAN_CHANNELS]);
 void set_oled_cpu_status(coreliquid_device* handle, int temperature, int frequency);
 void set_oled_show_clock(coreliquid_device* handle, uint8_t style);
 int get_model_index(coreliquid_device* handle, int* model_idx);
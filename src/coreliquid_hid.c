@@ -1,15 +1,106 @@
 #include "coreliquid_hid.h"
+#include "event_loop.h"
 #include "logger.h"
+#include "probes.h"
 
 #include <hidapi/hidapi.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 struct coreliquid_device_ {
     hid_device* hid_device_handle;
+    char name[16];          // vid:pid, for the log
 };
 typedef struct coreliquid_device_ coreliquid_device;
 
+/** Names of the transactions, e.g. for metric labels */
+const char* const hid_op_names[HID_OP_COUNT] = {
+    [HID_OP_SET_REPORT] = "set_report",
+    [HID_OP_GET_REPORT] = "get_report",
+    [HID_OP_WRITE]      = "write",
+    [HID_OP_READ]       = "read",
+};
+
+/** Transactions are only made from the main thread */
+static hid_stats_t hid_stats;
+
+/**
+ * Records the outcome of a transaction.
+ *
+ * @param op The transaction.
+ * @param start_us Time the transaction started, retries included.
+ * @param ok Whether it succeeded.
+ */
+static void record_hid_op(hid_op_t op, uint64_t start_us, int ok)
+{
+    record_jitter(&hid_stats.latency[op], monotonic_us() - start_us);
+    if (!ok)
+        hid_stats.errors[op]++;
+}
+
+/** Leading bytes of a report logged as its command: the report ID and the
+ * command code, after the magic code for the S series */
+#define HID_COMMAND_BYTES 5
+
+/** Magic code after the report ID of the S series messages, little endian */
+#define HID_MAGIC_S 0x5a6b
+
+/**
+ * Returns the command code of a report, for the probes: the byte after the
+ * report ID, or for the S series the 16-bit code after the magic code.
+ *
+ * @param report The report.
+ * @param length Length of the report.
+ * @return The command code, 0 if the report is too short.
+ */
+static uint16_t report_command(const uint8_t *report, size_t length)
+{
+    if (length >= HID_COMMAND_BYTES && (report[1] | report[2] << 8) == HID_MAGIC_S)
+        return report[3] | report[4] << 8;
+
+    return length > 1 ? report[1] : 0;
+}
+
+/**
+ * Logs a failed transaction, with the device, the command and the error
+ * number as structured fields. Errors repeating every tick are collapsed
+ * and rate limited by the logger.
+ *
+ * @param cl_handle The device.
+ * @param format Message, with %ls for the hidapi error.
+ * @param report The report of the transaction, NULL if not known.
+ * @param length Length of the report.
+ */
+static void log_hid_error(coreliquid_device* cl_handle, const char *format, const uint8_t *report, size_t length)
+{
+    char command[HID_COMMAND_BYTES * 3];
+    log_fields_t fields = {
+        .device = cl_handle->name,
+        .error = errno,
+    };
+
+    if (report && length > 0) {
+        int len = 0;
+        for (size_t i = 0; i < length && i < HID_COMMAND_BYTES; i++) {
+            len += snprintf(command + len, sizeof(command) - len, i ? ":%02x" : "%02x", report[i]);
+        }
+        fields.command = command;
+    }
+
+    logerror_fields(&fields, format, hid_error(cl_handle->hid_device_handle));
+}
+
+/**
+ * Returns the latency histograms and the retry and error counters of the
+ * HID transactions since startup.
+ */
+const hid_stats_t* get_hid_stats(void)
+{
+    return &hid_stats;
+}
+
 void init_coreliquid(void)
 {
     hid_init();
@@ -43,6 +134,7 @@ coreliquid_device* open_coreliquid_device(uint16_t vid, uint16_t pid)
     }
 
     cl_handle->hid_device_handle = handle;
+    snprintf(cl_handle->name, sizeof(cl_handle->name), "%04hx:%04hx", vid, pid);
     return cl_handle;
 }
 
@@ -115,16 +207,19 @@ found:
 */
 int set_report(coreliquid_device* cl_handle, uint8_t* output_report, size_t length)
 {
+    uint64_t start_us = monotonic_us();
+    PROBE5(hid_start, hid_op_names[HID_OP_SET_REPORT], output_report[0], report_command(output_report, length), length, output_report);
     int ret = hid_send_feature_report(cl_handle->hid_device_handle, output_report, length);
     for (int i = 0; (i < 10) && ret < 0; ++i) {
         ret = hid_send_feature_report(cl_handle->hid_device_handle, output_report, length);
+        hid_stats.retries[HID_OP_SET_REPORT]++;
         usleep(1000);
     }
+    PROBE3(hid_end, hid_op_names[HID_OP_SET_REPORT], ret, length);
+    record_hid_op(HID_OP_SET_REPORT, start_us, ret >= 0);
 
     if (ret < 0) {
-#ifdef _DEBUG
-        logerror("Unable to set report: %ls\n", hid_error(cl_handle->hid_device_handle));
-#endif
+        log_hid_error(cl_handle, "Unable to set report: %ls\n", output_report, length);
         return 0;
     }
 
@@ -141,11 +236,13 @@ int set_report(coreliquid_device* cl_handle, uint8_t* output_report, size_t leng
  */
 int get_report(coreliquid_device* cl_handle, uint8_t* input_report, size_t length)
 {
+    uint64_t start_us = monotonic_us();
+    PROBE5(hid_start, hid_op_names[HID_OP_GET_REPORT], input_report[0], 0, length, input_report);
     int ret = hid_get_feature_report(cl_handle->hid_device_handle, input_report, length);
+    PROBE3(hid_end, hid_op_names[HID_OP_GET_REPORT], ret, length);
+    record_hid_op(HID_OP_GET_REPORT, start_us, ret >= 0);
     if (ret < 0) {
-#ifdef _DEBUG
-        logerror("Unable to get report: %ls\n", hid_error(cl_handle->hid_device_handle));
-#endif
+        log_hid_error(cl_handle, "Unable to get report: %ls\n", input_report, 1);
         return 0;
     }
 
@@ -162,11 +259,13 @@ int get_report(coreliquid_device* cl_handle, uint8_t* input_report, size_t lengt
 */
 int write_output(coreliquid_device* cl_handle, uint8_t* output_report, size_t length)
 {
+    uint64_t start_us = monotonic_us();
+    PROBE5(hid_start, hid_op_names[HID_OP_WRITE], output_report[0], report_command(output_report, length), length, output_report);
     int res = hid_write(cl_handle->hid_device_handle, output_report, length);
+    PROBE3(hid_end, hid_op_names[HID_OP_WRITE], res, length);
+    record_hid_op(HID_OP_WRITE, start_us, res >= 0);
     if (res < 0) {
-#ifdef _DEBUG
-        logerror("Unable to write output: %ls\n", hid_error(cl_handle->hid_device_handle));
-#endif
+        log_hid_error(cl_handle, "Unable to write output: %ls\n", output_report, length);
         return 0;
     }
 
@@ -183,11 +282,13 @@ int write_output(coreliquid_device* cl_handle, uint8_t* output_report, size_t le
 */
 int read_input(coreliquid_device* cl_handle, uint8_t* input_report, size_t length)
 {
+    uint64_t start_us = monotonic_us();
+    PROBE5(hid_start, hid_op_names[HID_OP_READ], 0, 0, length, input_report);
     int res = hid_read(cl_handle->hid_device_handle, input_report, length);
+    PROBE3(hid_end, hid_op_names[HID_OP_READ], res, length);
+    record_hid_op(HID_OP_READ, start_us, res >= 0);
     if (res < 0) {
-#ifdef _DEBUG
-        logerror("Unable to read input: %ls\n", hid_error(cl_handle->hid_device_handle));
-#endif
+        log_hid_error(cl_handle, "Unable to read input: %ls\n", NULL, 0);
         return 0;
     }
 
@@ -1,6 +1,8 @@
 #ifndef _CORELIQUID_HID__H
 #define _CORELIQUID_HID__H
 
+#include "rt_mode.h"
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -9,6 +11,25 @@
 struct coreliquid_device_;
 typedef struct coreliquid_device_ coreliquid_device;
 
+/** HID transactions, timed and counted */
+enum hid_op {
+    HID_OP_SET_REPORT = 0,
+    HID_OP_GET_REPORT,
+    HID_OP_WRITE,
+    HID_OP_READ,
+    HID_OP_COUNT
+};
+typedef enum hid_op hid_op_t;
+
+struct hid_stats {
+    jitter_histogram_t latency[HID_OP_COUNT];  // retries included
+    uint64_t retries[HID_OP_COUNT];
+    uint64_t errors[HID_OP_COUNT];              // failed after the retries
+};
+typedef struct hid_stats hid_stats_t;
+
+extern const char* const hid_op_names[HID_OP_COUNT];
+
 void init_coreliquid(void);
 void shutdown_coreliquid(void);
 
@@ -27,5 +48,6 @@ int set_report(coreliquid_device* cl_handle, uint8_t* output_report, size_t leng
 int get_report(coreliquid_device* cl_handle, uint8_t* input_report, size_t length);
 int write_output(coreliquid_device* cl_handle, uint8_t* output_report, size_t length);
 int read_input(coreliquid_device* cl_handle, uint8_t* input_report, size_t length);
+const hid_stats_t* get_hid_stats(void);
 
 #endif // _CORELIQUID_HID__H
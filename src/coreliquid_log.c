@@ -0,0 +1,137 @@
+#include "coreliquid_log.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Writes an unsigned LEB128 varint.
+ *
+ * @return Number of bytes written.
+ */
+static int put_varint(uint8_t *out, uint64_t value)
+{
+    int len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+/**
+ * Reads an unsigned LEB128 varint.
+ *
+ * @return Number of bytes read, 0 if the varint runs past the end.
+ */
+static int get_varint(const uint8_t *in, uint32_t size, uint64_t *value)
+{
+    *value = 0;
+    for (uint32_t i = 0; i < size && i < 10; i++) {
+        *value |= (uint64_t)(in[i] & 0x7f) << (7 * i);
+        if (!(in[i] & 0x80))
+            return (int)i + 1;
+    }
+    return 0;
+}
+
+/**
+ * Empties a block and gives it a sequence number.
+ *
+ * @param block The block.
+ * @param seq Sequence number, 1 for the first block of the log.
+ */
+void coreliquid_log_start_block(coreliquid_log_block_t *block, uint64_t seq)
+{
+    memset(block, 0, offsetof(coreliquid_log_block_t, data));
+    for (int i = 0; i < CORELIQUID_LOG_METRICS; i++) {
+        block->min[i] = UINT16_MAX;
+    }
+    block->seq = seq;
+}
+
+/**
+ * Encodes a record at the end of a block and updates the block index.
+ *
+ * @param block The block.
+ * @param metric_count Metrics per record.
+ * @param previous The previous record of the block, ignored for the first one.
+ * @param record The record, not older than the previous one.
+ * @return 1 on success, 0 if the block is full or the record is older.
+ */
+int coreliquid_log_append(coreliquid_log_block_t *block, int metric_count, const coreliquid_log_record_t *previous,
+    const coreliquid_log_record_t *record)
+{
+    static const coreliquid_log_record_t zero;
+
+    if (block->used + CORELIQUID_LOG_RECORD_MAX > sizeof(block->data))
+        return 0;
+
+    if (block->records == 0) {
+        block->first_ms = record->time_ms;
+        previous = &zero;
+    } else if (record->time_ms < block->last_ms) {
+        return 0;
+    }
+
+    uint8_t *out = block->data + block->used;
+    int len = put_varint(out, block->records ? record->time_ms - block->last_ms : 0);
+
+    for (int i = 0; i < metric_count; i++) {
+        int32_t delta = (int32_t)record->values[i] - (int32_t)previous->values[i];
+        len += put_varint(out + len, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+
+        if (record->values[i] < block->min[i])
+            block->min[i] = record->values[i];
+        if (record->values[i] > block->max[i])
+            block->max[i] = record->values[i];
+        block->sum[i] += record->values[i];
+    }
+
+    block->last_ms = record->time_ms;
+    block->used += len;
+    block->records++;
+    return 1;
+}
+
+/**
+ * Decodes the record at an offset of a block.
+ *
+ * @param block The block.
+ * @param metric_count Metrics per record.
+ * @param offset Offset of the record, 0 for the first one, advanced past it.
+ * @param record The previous record on input (ignored at offset 0), the
+ *               decoded record on output.
+ * @return 1 if a record was decoded, 0 at the end of the block.
+ */
+int coreliquid_log_next(const coreliquid_log_block_t *block, int metric_count, uint32_t *offset,
+    coreliquid_log_record_t *record)
+{
+    uint32_t used = block->used < sizeof(block->data) ? block->used : sizeof(block->data);
+    uint64_t value;
+    int len;
+
+    if (*offset >= used)
+        return 0;
+
+    if (*offset == 0) {
+        memset(record, 0, sizeof(*record));
+        record->time_ms = block->first_ms;
+    }
+
+    if (!(len = get_varint(block->data + *offset, used - *offset, &value)))
+        return 0;
+    *offset += len;
+    record->time_ms += value;
+
+    for (int i = 0; i < metric_count; i++) {
+        if (!(len = get_varint(block->data + *offset, used - *offset, &value)))
+            return 0;
+        *offset += len;
+
+        int32_t delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        record->values[i] = (uint16_t)(record->values[i] + delta);
+    }
+    return 1;
+}
@@ -0,0 +1,70 @@
+#ifndef _CORELIQUID_LOG__H
+#define _CORELIQUID_LOG__H
+
+/*
+ * On-disk telemetry log of the daemon, and its record codec.
+ *
+ * The file is a header block followed by a ring of fixed-size data blocks,
+ * reused oldest first once the file reaches its size cap. Each data block
+ * holds records of all the metrics: the time and the values are stored as
+ * varint-packed deltas from the previous record of the block, so a block
+ * decodes on its own. The block header indexes its time range and the
+ * minimum, maximum and sum of each metric, which answers aggregate queries
+ * over whole blocks without decoding them.
+ */
+
+#include <stdint.h>
+
+#define CORELIQUID_LOG_MAGIC        0x474c434dU     // "MCLG"
+#define CORELIQUID_LOG_VERSION      1
+
+#define CORELIQUID_LOG_BLOCK_SIZE   4096
+
+/** Metric slots of a record, metric_count of them are used */
+#define CORELIQUID_LOG_METRICS      16
+
+#define CORELIQUID_LOG_NAME_LEN     24
+
+/** Largest encoded record: time delta, then a zigzag delta per metric */
+#define CORELIQUID_LOG_RECORD_MAX   (10 + CORELIQUID_LOG_METRICS * 3)
+
+/** First block of the file */
+struct coreliquid_log_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t metric_count;
+    uint32_t block_size;
+    uint32_t block_count;                       // data blocks after the header block
+    char metric_names[CORELIQUID_LOG_METRICS][CORELIQUID_LOG_NAME_LEN];
+};
+typedef struct coreliquid_log_header coreliquid_log_header_t;
+
+struct coreliquid_log_block {
+    uint64_t seq;                               // order of the blocks, 0 for an unused block
+    uint64_t first_ms;                          // Unix time of the first and last records, in ms
+    uint64_t last_ms;
+    uint32_t records;
+    uint32_t used;                              // bytes of data
+    uint16_t min[CORELIQUID_LOG_METRICS];
+    uint16_t max[CORELIQUID_LOG_METRICS];
+    uint64_t sum[CORELIQUID_LOG_METRICS];
+    uint8_t data[CORELIQUID_LOG_BLOCK_SIZE - 224];
+};
+typedef struct coreliquid_log_block coreliquid_log_block_t;
+
+_Static_assert(sizeof(coreliquid_log_block_t) == CORELIQUID_LOG_BLOCK_SIZE, "log block size");
+_Static_assert(sizeof(coreliquid_log_header_t) <= CORELIQUID_LOG_BLOCK_SIZE, "log header size");
+
+struct coreliquid_log_record {
+    uint64_t time_ms;
+    uint16_t values[CORELIQUID_LOG_METRICS];
+};
+typedef struct coreliquid_log_record coreliquid_log_record_t;
+
+void coreliquid_log_start_block(coreliquid_log_block_t *block, uint64_t seq);
+int coreliquid_log_append(coreliquid_log_block_t *block, int metric_count, const coreliquid_log_record_t *previous,
+    const coreliquid_log_record_t *record);
+int coreliquid_log_next(const coreliquid_log_block_t *block, int metric_count, uint32_t *offset,
+    coreliquid_log_record_t *record);
+
+#endif // _CORELIQUID_LOG__H
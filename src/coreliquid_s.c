@@ -266,6 +266,64 @@ void send_cpu_info(coreliquid_device *handle, int temperature, int frequency)
     set_report(handle, message.raw_buffer, sizeof(message.raw_buffer));
 }
 
+/**
+ * Encodes the host sensor readings into a SEND_HOST_CPU_INFO report.
+ */
+static void build_hw_info(struct hw_info_message *message, const sensors_values_t *data)
+{
+    memset(&message->raw_buffer, 0, sizeof(message->raw_buffer));
+
+    message->data = (struct hw_info) {
+        .header = {
+            .report_id = REPORT_ID_S,
+            .message.magic_two = MAGIC_CODE_MCU,
+            .message.command_code = SEND_HOST_CPU_INFO,
+            .message.length = sizeof(message->data.payload),
+        },
+        .payload = {
+            .cpu_freq = data->cpu_freq,
+            .cpu_temp = data->cpu_temp,
+            .gpu_freq = data->gpu_freq,
+            .gpu_usage = data->gpu_usage,
+            .cpu_usage = data->cpu_usage,
+            .gpu_temp = data->gpu_temp,
+        }
+    };
+}
+
+/**
+* Sends the host sensor readings (CPU and GPU) to the device.
+*
+* @param handle Pointer to the coreliquid device handle.
+* @param data The sensor values to display.
+*/
+void send_hw_info(coreliquid_device *handle, const sensors_values_t *data)
+{
+    struct hw_info_message message;
+
+    build_hw_info(&message, data);
+    set_report(handle, message.raw_buffer, sizeof(message.raw_buffer));
+}
+
+/**
+ * Checks whether two sets of readings give different LCD reports, i.e.
+ * differ in a displayed value once converted. Readings the LCD does not
+ * show, such as the CPU power, are ignored.
+ *
+ * @param previous The readings last sent.
+ * @param current The readings to send.
+ * @return 1 if the reports differ, 0 otherwise.
+ */
+int hw_info_changed(const sensors_values_t *previous, const sensors_values_t *current)
+{
+    struct hw_info_message previous_message, current_message;
+
+    build_hw_info(&previous_message, previous);
+    build_hw_info(&current_message, current);
+    return memcmp(&previous_message.data.payload, &current_message.data.payload,
+        sizeof(current_message.data.payload)) != 0;
+}
+
 /**
 * Sets the backlight brightness of the LCM (LCD Module).
 *
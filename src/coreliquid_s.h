@@ -2,6 +2,7 @@
 #define _CORELIQUID_S__H
 
 #include "coreliquid_hid.h"
+#include "sensors_wrap.h"
 
 enum lcm_dir {
     LCM_DIR_90      = 90,
@@ -45,6 +46,8 @@ typedef enum display_features display_features_t;
 
 
 void send_cpu_info(coreliquid_device *cl_handle, int temperature, int frequency);
+void send_hw_info(coreliquid_device *handle, const sensors_values_t *data);
+int hw_info_changed(const sensors_values_t *previous, const sensors_values_t *current);
 void set_lcm_back_light(coreliquid_device *handle, int brightness);
 void set_lcm_direction(coreliquid_device *handle, lcm_dir_t direction);
 void send_host_msg(coreliquid_device *handle, const char *text);
@@ -0,0 +1,233 @@
+#include "coreliquid_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Attempts of a read before giving up on a segment left mid-update */
+#define SHM_READ_ATTEMPTS 100000
+
+struct coreliquid_reader {
+    const coreliquid_shm_t *shm;
+    uint64_t retries;           // copies repeated because the daemon was writing
+};
+
+/**
+ * Maps the telemetry segment of the daemon read-only.
+ *
+ * @return The reader, or NULL if the daemon does not publish a segment of
+ *         a known version (errno is set).
+ */
+coreliquid_reader_t* coreliquid_shm_open(void)
+{
+    int fd = shm_open(CORELIQUID_SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(coreliquid_shm_t)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(coreliquid_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    const coreliquid_shm_t *shm = map;
+    if (shm->magic != CORELIQUID_SHM_MAGIC || shm->version != CORELIQUID_SHM_VERSION
+            || shm->size != sizeof(coreliquid_shm_t)) {
+        munmap(map, sizeof(coreliquid_shm_t));
+        errno = EPROTO;
+        return NULL;
+    }
+
+    coreliquid_reader_t *reader = calloc(1, sizeof(*reader));
+    if (!reader) {
+        munmap(map, sizeof(coreliquid_shm_t));
+        return NULL;
+    }
+
+    reader->shm = shm;
+    return reader;
+}
+
+/**
+ * Unmaps the segment.
+ *
+ * @param reader The reader, may be NULL.
+ */
+void coreliquid_shm_close(coreliquid_reader_t *reader)
+{
+    if (!reader)
+        return;
+
+    munmap((void*) reader->shm, sizeof(coreliquid_shm_t));
+    free(reader);
+}
+
+/**
+ * Looks a metric up by name, e.g. "cpu_temp".
+ *
+ * @param reader The reader.
+ * @param name The metric name.
+ * @return Index of the metric in the sample values, -1 if unknown.
+ */
+int coreliquid_shm_metric(const coreliquid_reader_t *reader, const char *name)
+{
+    for (uint32_t i = 0; i < reader->shm->metric_count && i < CORELIQUID_SHM_METRICS; i++) {
+        if (!strncmp(reader->shm->metric_names[i], name, CORELIQUID_SHM_NAME_LEN))
+            return (int) i;
+    }
+    return -1;
+}
+
+/**
+ * Begins a seqlock read section.
+ *
+ * @param attempts Attempts left, shared with read_end().
+ * @param seq Set to the sequence to check at the end, always even.
+ * @return 1 if a section began, 0 if the daemon was writing for all the
+ *         attempts.
+ */
+static int read_begin(coreliquid_reader_t *reader, int *attempts, uint32_t *seq)
+{
+    while ((*seq = atomic_load_explicit(&reader->shm->sequence, memory_order_acquire)) & 1) {
+        reader->retries++;
+        if (--*attempts <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Ends a seqlock read section.
+ *
+ * @return 1 if the data copied since read_begin() is consistent.
+ */
+static int read_end(coreliquid_reader_t *reader, int *attempts, uint32_t seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&reader->shm->sequence, memory_order_relaxed) == seq)
+        return 1;
+
+    reader->retries++;
+    --*attempts;
+    return 0;
+}
+
+/**
+ * Fails a read that found the segment mid-update for all its attempts: the
+ * daemon died while writing if it is gone, otherwise it was preempted.
+ */
+static int read_stuck(const coreliquid_reader_t *reader)
+{
+    errno = coreliquid_shm_alive(reader) ? EBUSY : ESHUTDOWN;
+    return -1;
+}
+
+/**
+ * Copies the latest sample. Never blocks, and makes no system call unless
+ * the segment stays mid-update.
+ *
+ * @param reader The reader.
+ * @param sample Filled with the latest sample.
+ * @return 1 if a sample was read, 0 if none was published yet, -1 with
+ *         errno ESHUTDOWN if the daemon stopped (reopen the segment once it
+ *         runs again), or EBUSY if the daemon was writing for too long.
+ */
+int coreliquid_shm_read(coreliquid_reader_t *reader, coreliquid_shm_sample_t *sample)
+{
+    int attempts = SHM_READ_ATTEMPTS;
+    uint32_t seq, closed;
+    uint64_t count;
+
+    do {
+        if (!read_begin(reader, &attempts, &seq))
+            return read_stuck(reader);
+        memcpy(sample, &reader->shm->latest, sizeof(*sample));
+        count = reader->shm->sample_count;
+        closed = reader->shm->closed;
+    } while (!read_end(reader, &attempts, seq));
+
+    if (closed) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    return count > 0;
+}
+
+/**
+ * Copies the last samples, oldest first.
+ *
+ * @param reader The reader.
+ * @param samples Filled with the samples.
+ * @param max Size of samples, at most CORELIQUID_SHM_HISTORY are returned.
+ * @return Number of samples copied, -1 on error as coreliquid_shm_read().
+ */
+int coreliquid_shm_read_history(coreliquid_reader_t *reader, coreliquid_shm_sample_t *samples, int max)
+{
+    int attempts = SHM_READ_ATTEMPTS;
+    uint32_t seq, closed;
+    uint64_t count;
+    int n;
+
+    if (max > CORELIQUID_SHM_HISTORY)
+        max = CORELIQUID_SHM_HISTORY;
+
+    do {
+        if (!read_begin(reader, &attempts, &seq))
+            return read_stuck(reader);
+        count = reader->shm->sample_count;
+        closed = reader->shm->closed;
+
+        n = count < (uint64_t) max ? (int) count : max;
+        for (int i = 0; i < n; i++) {
+            uint64_t sample_nr = count - n + 1 + i;
+            memcpy(&samples[i], &reader->shm->history[(sample_nr - 1) % CORELIQUID_SHM_HISTORY], sizeof(samples[i]));
+        }
+    } while (!read_end(reader, &attempts, seq));
+
+    if (closed) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    return n;
+}
+
+/**
+ * Checks whether the daemon that publishes the segment still runs. A
+ * daemon that crashed leaves its segment behind, not marked closed, with
+ * its last sample: readers should check from time to time, e.g. when the
+ * samples stop coming. Makes a system call.
+ *
+ * @param reader The reader.
+ * @return 1 if the daemon runs, 0 if the segment is stale (reopen it).
+ */
+int coreliquid_shm_alive(const coreliquid_reader_t *reader)
+{
+    if (reader->shm->closed)
+        return 0;
+
+    // EPERM: the process exists but belongs to another user
+    return kill(reader->shm->writer_pid, 0) == 0 || errno == EPERM;
+}
+
+/**
+ * Returns how many copies were repeated because they overlapped with the
+ * daemon publishing a sample.
+ *
+ * @param reader The reader.
+ * @return The number of retries.
+ */
+uint64_t coreliquid_shm_retries(const coreliquid_reader_t *reader)
+{
+    return reader->retries;
+}
@@ -0,0 +1,67 @@
+#ifndef _CORELIQUID_SHM__H
+#define _CORELIQUID_SHM__H
+
+/*
+ * Shared-memory telemetry segment of the daemon, and the reader library.
+ *
+ * The daemon publishes its latest sample and the last samples into a
+ * fixed-size POSIX shared-memory segment. Readers map it read-only and
+ * copy samples out under a seqlock, without any system call.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/** Name of the segment, i.e. /dev/shm/my_msi_coreliquid */
+#define CORELIQUID_SHM_NAME     "/my_msi_coreliquid"
+
+#define CORELIQUID_SHM_MAGIC    0x4353494dU     // "MSIC"
+#define CORELIQUID_SHM_VERSION  2
+
+/** Metric slots of a sample, metric_count of them are used */
+#define CORELIQUID_SHM_METRICS  16
+
+/** Samples kept in the history ring */
+#define CORELIQUID_SHM_HISTORY  128
+
+#define CORELIQUID_SHM_NAME_LEN 24
+
+struct coreliquid_shm_sample {
+    uint64_t time_us;                           // CLOCK_MONOTONIC time of the sample
+    uint64_t sample_nr;                         // 1 for the first sample
+    uint16_t values[CORELIQUID_SHM_METRICS];
+};
+typedef struct coreliquid_shm_sample coreliquid_shm_sample_t;
+
+/** Layout of the segment. Fields are only added in a new version. */
+struct coreliquid_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                              // sizeof(struct coreliquid_shm)
+    uint32_t metric_count;
+    char metric_names[CORELIQUID_SHM_METRICS][CORELIQUID_SHM_NAME_LEN];
+
+    // Seqlock: odd while the daemon writes, readers retry if it changed
+    _Atomic uint32_t sequence;
+    uint32_t closed;                            // 1 once the daemon stopped publishing
+    int32_t writer_pid;                         // pid of the daemon, to detect a crash
+    uint32_t reserved;
+    uint64_t sample_count;                      // samples published so far
+
+    coreliquid_shm_sample_t latest;
+    coreliquid_shm_sample_t history[CORELIQUID_SHM_HISTORY];   // sample n at (n - 1) % HISTORY
+};
+typedef struct coreliquid_shm coreliquid_shm_t;
+
+struct coreliquid_reader;
+typedef struct coreliquid_reader coreliquid_reader_t;
+
+coreliquid_reader_t* coreliquid_shm_open(void);
+void coreliquid_shm_close(coreliquid_reader_t *reader);
+int coreliquid_shm_metric(const coreliquid_reader_t *reader, const char *name);
+int coreliquid_shm_read(coreliquid_reader_t *reader, coreliquid_shm_sample_t *sample);
+int coreliquid_shm_read_history(coreliquid_reader_t *reader, coreliquid_shm_sample_t *samples, int max);
+uint64_t coreliquid_shm_retries(const coreliquid_reader_t *reader);
+int coreliquid_shm_alive(const coreliquid_reader_t *reader);
+
+#endif // _CORELIQUID_SHM__H
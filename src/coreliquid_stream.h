@@ -0,0 +1,68 @@
+#ifndef _CORELIQUID_STREAM__H
+#define _CORELIQUID_STREAM__H
+
+/*
+ * Telemetry streaming protocol of the daemon.
+ *
+ * Clients connect to a SOCK_SEQPACKET unix socket, so every message is one
+ * packet. The daemon first sends a hello with the metric names, the client
+ * answers with a subscription (and may send a new one at any time), then
+ * the daemon pushes a sample frame each time a subscribed metric is
+ * updated. All fields are in host byte order.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Default path of the socket */
+#define CORELIQUID_STREAM_PATH      "/run/my_msi_coreliquid.sock"
+
+#define CORELIQUID_STREAM_MAGIC     0x5453434dU     // "MCST"
+#define CORELIQUID_STREAM_VERSION   1
+
+/** Metrics a client can subscribe to, metric_count of them are used */
+#define CORELIQUID_STREAM_METRICS   16
+
+#define CORELIQUID_STREAM_NAME_LEN  24
+
+enum coreliquid_stream_type {
+    CORELIQUID_STREAM_HELLO = 1,
+    CORELIQUID_STREAM_SAMPLE = 2,
+};
+
+/** Daemon to client, once after connecting */
+struct coreliquid_stream_hello {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t type;                               // CORELIQUID_STREAM_HELLO
+    uint8_t metric_count;
+    char metric_names[CORELIQUID_STREAM_METRICS][CORELIQUID_STREAM_NAME_LEN];
+};
+typedef struct coreliquid_stream_hello coreliquid_stream_hello_t;
+
+/** Client to daemon, replaces the previous subscription */
+struct coreliquid_stream_subscribe {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t metrics;                           // bit n subscribes to metric n, 0 pauses the stream
+};
+typedef struct coreliquid_stream_subscribe coreliquid_stream_subscribe_t;
+
+/** Daemon to client, for every update of a subscribed metric. Only the
+ *  first count values are sent, the frame is CORELIQUID_STREAM_SAMPLE_SIZE(count) bytes */
+struct coreliquid_stream_sample {
+    uint8_t type;                               // CORELIQUID_STREAM_SAMPLE
+    uint8_t count;                              // number of values
+    uint16_t reserved;
+    uint32_t dropped;                           // frames dropped for this client so far
+    uint64_t time_us;                           // CLOCK_MONOTONIC time of the sample
+    uint64_t sample_nr;                         // gaps are dropped or unsubscribed updates
+    uint16_t values[CORELIQUID_STREAM_METRICS]; // subscribed metrics, in metric order
+};
+typedef struct coreliquid_stream_sample coreliquid_stream_sample_t;
+
+#define CORELIQUID_STREAM_SAMPLE_SIZE(count) \
+    (offsetof(coreliquid_stream_sample_t, values) + (count) * sizeof(uint16_t))
+
+#endif // _CORELIQUID_STREAM__H
@@ -0,0 +1,261 @@
+#include "daemon_config.h"
+#include "coreliquid.h"
+#include "config.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct {
+    const char *name;
+    display_features_t feature;
+} display_feature_names[] = {
+    { "cpu_freq",           SHOW_CPU_FREQ },
+    { "cpu_temp",           SHOW_CPU_TEMP },
+    { "gpu_freq",           SHOW_GPU_FREQ },
+    { "gpu_usage",          SHOW_GPU_USAGE },
+    { "pump_fan",           SHOW_PUMP_FAN },
+    { "radiator_fan",       SHOW_RADIATOR_FAN },
+    { "water_block_fan",    SHOW_WATER_BLOCK_FAN },
+    { "psu_fan",            SHOW_PSU_FAN },
+    { "liquid_temp",        SHOW_LIQUID_TEMP },
+    { "fps",                SHOW_FPS },
+    { "psu_temp",           SHOW_PSU_TEMP },
+    { "psu_output_wattage", SHOW_PSU_OUTPUT_WATTAGE },
+    { "psu_efficiency",     SHOW_PSU_EFFICIENCY },
+    { "cpu_usage",          SHOW_CPU_USAGE },
+    { "gpu_temp",           SHOW_GPU_TEMP },
+};
+
+static const struct {
+    const char *name;
+    unsigned int sensor;
+} sensor_names[] = {
+    { "cpu_freq",  SENSOR_CPU_FREQ },
+    { "cpu_usage", SENSOR_CPU_USAGE },
+    { "power",     SENSOR_CPU_POWER },
+    { "pressure",  SENSOR_CPU_PRESSURE },
+    { "gpu",       SENSOR_GPU },
+};
+
+/** Defaults, also the reference for settings missing from the file */
+static const daemon_config_t default_config = {
+    .fan_mode = FAN_MODE_SMART,
+
+    // Closed-loop control is off until a target is set
+    .pid = {
+        .target = 0,
+        .source = PID_SOURCE_LIQUID,
+        .kp = 4.0f,
+        .ki = 0.1f,
+        .kd = 0.0f,
+        .min_duty = 20,
+        .max_duty = 100,
+        .max_step = 5.0f,
+        .settle_band = 1.0f,
+        .settle_hold_us = 30000000L,
+    },
+
+    .brightness = LCM_DEFAULT_BRIGHTNESS,
+    .direction = LCM_DIR_DEFAULT,
+    .temperature_unit = 0,
+    .display_features = SHOW_CPU_FREQ | SHOW_CPU_TEMP,
+    .display_style = STYLE_3,
+
+    .temp_filter = {
+        .median_len = 3,
+        .ema_alpha = 0.5f,
+        .deadband = 1,
+        .hysteresis_rise = 1,
+        .hysteresis_fall = 2,
+    },
+
+    // 100ms while readings change quickly, up to 5s while steady
+    .rate = {
+        .floor_us = 100000L,
+        .ceiling_us = 5000000L,
+        .temp_slope = 2,
+        .load_slope = 20,
+        .power_slope = 10,
+    },
+
+    // Period, phase offset, priority
+    .tasks = {
+        [TASK_TEMPERATURE] = { .name = "temperature", .period_us =  250000L, .phase_us =      0, .priority = 0 },
+        [TASK_DISPLAY]     = { .name = "display",     .period_us = 1000000L, .phase_us =  50000L, .priority = 1 },
+        [TASK_COOLER]      = { .name = "cooler",      .period_us = 2000000L, .phase_us = 125000L, .priority = 2 },
+        [TASK_DBUS]        = { .name = "dbus",        .period_us = 1000000L, .phase_us = 175000L, .priority = 3 },
+    },
+
+    .sensors = SENSOR_ALL,
+};
+
+/**
+ * Initializes the configuration with the defaults.
+ *
+ * @param config The configuration to initialize.
+ */
+void init_daemon_config(daemon_config_t *config)
+{
+    *config = default_config;
+    init_fan_curves(&config->fan_curves);
+    init_telemetry_config(&config->telemetry);
+}
+
+/**
+ * Parses a list of display features such as "cpu_temp,pump_fan,radiator_fan".
+ *
+ * @param spec The comma separated feature names.
+ * @param features The parsed features.
+ * @return 1 if the list is valid, 0 otherwise.
+ */
+int parse_display_features(const char *spec, display_features_t *features)
+{
+    char buf[256];
+    char *saveptr;
+    unsigned int result = 0;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, ", ", &saveptr); token; token = strtok_r(NULL, ", ", &saveptr)) {
+        size_t i = 0;
+        for (; i < sizeof(display_feature_names) / sizeof(display_feature_names[0]); i++) {
+            if (!strcmp(token, display_feature_names[i].name))
+                break;
+        }
+        if (i == sizeof(display_feature_names) / sizeof(display_feature_names[0]))
+            return 0;
+
+        result |= display_feature_names[i].feature;
+    }
+
+    *features = (display_features_t) result;
+    return 1;
+}
+
+/**
+ * Parses a list of optional sensor collectors such as "cpu_freq,power".
+ * The CPU temperature is always collected.
+ *
+ * @param spec The comma separated collector names, "none" for none.
+ * @param sensors The parsed SENSOR_* mask.
+ * @return 1 if the list is valid, 0 otherwise.
+ */
+int parse_sensor_collectors(const char *spec, unsigned int *sensors)
+{
+    char buf[128];
+    char *saveptr;
+    unsigned int result = 0;
+
+    if (!strcmp(spec, "none")) {
+        *sensors = 0;
+        return 1;
+    }
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, ", ", &saveptr); token; token = strtok_r(NULL, ", ", &saveptr)) {
+        size_t i = 0;
+        for (; i < sizeof(sensor_names) / sizeof(sensor_names[0]); i++) {
+            if (!strcmp(token, sensor_names[i].name))
+                break;
+        }
+        if (i == sizeof(sensor_names) / sizeof(sensor_names[0]))
+            return 0;
+
+        result |= sensor_names[i].sensor;
+    }
+
+    *sensors = result;
+    return 1;
+}
+
+/**
+ * Handles a setting of the configuration file.
+ */
+static int daemon_setting(const char *key, const char *value, void *userdata)
+{
+    daemon_config_t *config = (daemon_config_t*) userdata;
+    char extra;
+
+    if (!strcmp(key, "mode")) {
+        return sscanf(value, "%d%c", &config->fan_mode, &extra) == 1
+            && config->fan_mode >= FAN_MODE_SILENT && config->fan_mode <= FAN_MODE_SMART;
+    }
+    if (!strcmp(key, "brightness")) {
+        return sscanf(value, "%d%c", &config->brightness, &extra) == 1
+            && config->brightness >= 0 && config->brightness <= 100;
+    }
+    if (!strcmp(key, "direction")) {
+        int direction;
+        if (sscanf(value, "%d%c", &direction, &extra) != 1 || direction % 90 || direction < 0 || direction > 270)
+            return 0;
+        config->direction = (lcm_dir_t) direction;
+        return 1;
+    }
+    if (!strcmp(key, "temperature_unit")) {
+        if (!strcmp(value, "celsius"))
+            config->temperature_unit = 0;
+        else if (!strcmp(value, "fahrenheit"))
+            config->temperature_unit = 1;
+        else
+            return 0;
+        return 1;
+    }
+    if (!strcmp(key, "display"))
+        return parse_display_features(value, &config->display_features);
+    if (!strcmp(key, "style")) {
+        int style;
+        if (sscanf(value, "%d%c", &style, &extra) != 1 || style < STYLE_1 || style > STYLE_4)
+            return 0;
+        config->display_style = (monitor_style_t) style;
+        return 1;
+    }
+    if (!strcmp(key, "filter"))
+        return parse_filter_config(value, &config->temp_filter);
+    if (!strcmp(key, "interval"))
+        return parse_adaptive_rate_config(value, &config->rate);
+    if (!strcmp(key, "tasks"))
+        return parse_task_config(value, config->tasks, TASK_COUNT);
+    if (!strcmp(key, "controller")) {
+        if (!strcmp(value, "off")) {
+            config->pid.target = 0;
+            return 1;
+        }
+        return parse_pid_config(value, &config->pid) && config->pid.target > 0;
+    }
+    if (!strcmp(key, "sensors"))
+        return parse_sensor_collectors(value, &config->sensors);
+    if (!strcmp(key, "telemetry"))
+        return parse_telemetry_config(value, &config->telemetry);
+
+    return parse_fan_curve_setting(key, value, &config->fan_curves);
+}
+
+/**
+ * Loads a configuration file over the current settings, for example:
+ *
+ *     mode = 3
+ *     radiator = 30:25 40:35 60:70 75:100
+ *     brightness = 60
+ *     display = cpu_temp,cpu_freq,liquid_temp
+ *     sensors = cpu_freq,cpu_usage
+ *
+ * The configuration is left unchanged if the file is invalid.
+ *
+ * @param path Path of the configuration file.
+ * @param config The configuration to update.
+ * @return 1 on success, 0 otherwise.
+ */
+int load_daemon_config(const char *path, daemon_config_t *config)
+{
+    daemon_config_t loaded = *config;
+
+    if (!read_config_file(path, daemon_setting, &loaded))
+        return 0;
+
+    compile_fan_curves(&loaded.fan_curves);
+    *config = loaded;
+    return 1;
+}
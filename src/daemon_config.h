@@ -0,0 +1,46 @@
+#ifndef _DAEMON_CONFIG__H
+#define _DAEMON_CONFIG__H
+
+#include "coreliquid_s.h"
+#include "fan_curve.h"
+#include "fan_pid.h"
+#include "signal_filter.h"
+#include "adaptive_rate.h"
+#include "task_scheduler.h"
+#include "telemetry.h"
+
+/** Periodic tasks of the monitoring loop */
+enum monitor_task {
+    TASK_TEMPERATURE = 0,
+    TASK_DISPLAY,
+    TASK_COOLER,
+    TASK_DBUS,
+    TASK_COUNT
+};
+
+/** Settings that can be changed by reloading the configuration */
+struct daemon_config {
+    int fan_mode;
+    fan_curves_t fan_curves;
+    pid_config_t pid;           // closed-loop control in custom mode when pid.target > 0
+
+    int brightness;
+    lcm_dir_t direction;
+    int temperature_unit;       // 0 Celsius, 1 Fahrenheit
+    display_features_t display_features;
+    monitor_style_t display_style;
+
+    filter_config_t temp_filter;
+    adaptive_rate_config_t rate;
+    task_config_t tasks[TASK_COUNT];
+    unsigned int sensors;       // SENSOR_* collectors
+    telemetry_config_t telemetry;   // deadbands and rate limit of the D-Bus signals
+};
+typedef struct daemon_config daemon_config_t;
+
+void init_daemon_config(daemon_config_t *config);
+int load_daemon_config(const char *path, daemon_config_t *config);
+int parse_display_features(const char *spec, display_features_t *features);
+int parse_sensor_collectors(const char *spec, unsigned int *sensors);
+
+#endif // _DAEMON_CONFIG__H
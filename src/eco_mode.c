@@ -0,0 +1,127 @@
+#include "eco_mode.h"
+#include "event_loop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+// From linux/ioprio.h, not exported by glibc
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+/**
+ * Lowers the cost of the calling process: a large timer slack lets the
+ * kernel batch its sleeps with other wakeups, and idle CPU and I/O
+ * priorities keep it out of the way of the workload.
+ *
+ * The CPU priority is nice 19 rather than SCHED_IDLE: SCHED_IDLE would
+ * starve the cooling loop on a saturated machine, when it matters most.
+ *
+ * Threads created afterwards inherit the settings. Each step is tried even
+ * if a previous one failed.
+ *
+ * @param config The eco mode configuration.
+ * @return 1 if all steps succeeded, 0 otherwise.
+ */
+int enter_eco_mode(const eco_config_t *config)
+{
+    int result = 1;
+
+    if (prctl(PR_SET_TIMERSLACK, ECO_TIMER_SLACK_NS, 0, 0, 0) < 0) {
+        logerror("Unable to set timer slack: %s\n", strerror(errno));
+        result = 0;
+    }
+
+    if (setpriority(PRIO_PROCESS, 0, 19) < 0) {
+        logerror("Unable to lower CPU priority: %s\n", strerror(errno));
+        result = 0;
+    }
+
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0) {
+        logerror("Unable to lower I/O priority: %s\n", strerror(errno));
+        result = 0;
+    }
+
+    if (result) {
+        loginfo("Eco mode: ticks aligned on %ld ms, timer slack %ld ms\n",
+            config->align_us / 1000, ECO_TIMER_SLACK_NS / 1000000);
+    }
+    return result;
+}
+
+/**
+ * Parses the tick alignment of eco mode in milliseconds, such as "1000".
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to update.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_eco_config(const char *spec, eco_config_t *config)
+{
+    long align_ms;
+    char extra;
+
+    if (sscanf(spec, "%ld%c", &align_ms, &extra) != 1 || align_ms < 100)
+        return 0;
+
+    config->align_us = align_ms * 1000;
+    return 1;
+}
+
+/**
+ * Starts measuring the footprint of the process.
+ *
+ * @param footprint The measurement.
+ */
+void start_footprint(footprint_t *footprint)
+{
+    footprint->start_us = monotonic_us();
+    getrusage(RUSAGE_SELF, &footprint->start);
+}
+
+/**
+ * Computes the wakeup rate and CPU time of the process since
+ * start_footprint().
+ *
+ * @param footprint The measurement.
+ * @param stats Filled with the rates.
+ * @return 1 on success, 0 if no time has elapsed.
+ */
+int read_footprint(const footprint_t *footprint, footprint_stats_t *stats)
+{
+    struct rusage now;
+    uint64_t elapsed_us = monotonic_us() - footprint->start_us;
+
+    if (elapsed_us == 0 || getrusage(RUSAGE_SELF, &now) < 0)
+        return 0;
+
+    long wakeups = now.ru_nvcsw - footprint->start.ru_nvcsw;
+    double cpu_s = (now.ru_utime.tv_sec - footprint->start.ru_utime.tv_sec)
+                 + (now.ru_stime.tv_sec - footprint->start.ru_stime.tv_sec)
+                 + ((now.ru_utime.tv_usec - footprint->start.ru_utime.tv_usec)
+                 + (now.ru_stime.tv_usec - footprint->start.ru_stime.tv_usec)) / 1e6;
+
+    stats->wakeups_per_s = wakeups * 1e6 / elapsed_us;
+    stats->cpu_s_per_hour = cpu_s * 3600e6 / elapsed_us;
+    return 1;
+}
+
+/**
+ * Logs the wakeup rate and CPU time of the process.
+ *
+ * @param footprint The measurement.
+ */
+void log_footprint(const footprint_t *footprint)
+{
+    footprint_stats_t stats;
+
+    if (read_footprint(footprint, &stats)) {
+        loginfo("Footprint: %.2f wakeups/s, %.2f s CPU time per hour\n",
+            stats.wakeups_per_s, stats.cpu_s_per_hour);
+    }
+}
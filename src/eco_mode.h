@@ -0,0 +1,34 @@
+#ifndef _ECO_MODE__H
+#define _ECO_MODE__H
+
+#include <stdint.h>
+#include <sys/resource.h>
+
+/** Timer slack granted to the kernel in eco mode (50ms) */
+#define ECO_TIMER_SLACK_NS (50 * 1000 * 1000L)
+
+struct eco_config {
+    long align_us;          // ticks are lined up on multiples of this, 0 disables eco mode
+};
+typedef struct eco_config eco_config_t;
+
+/** Wakeups and CPU time of the whole process since a reference point */
+struct footprint {
+    uint64_t start_us;
+    struct rusage start;
+};
+typedef struct footprint footprint_t;
+
+struct footprint_stats {
+    float wakeups_per_s;        // voluntary context switches of all threads
+    float cpu_s_per_hour;       // user + system CPU time
+};
+typedef struct footprint_stats footprint_stats_t;
+
+int enter_eco_mode(const eco_config_t *config);
+int parse_eco_config(const char *spec, eco_config_t *config);
+void start_footprint(footprint_t *footprint);
+int read_footprint(const footprint_t *footprint, footprint_stats_t *stats);
+void log_footprint(const footprint_t *footprint);
+
+#endif // _ECO_MODE__H
@@ -0,0 +1,281 @@
+#include "event_loop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+struct event_source {
+    int fd;                 // -1 when the slot is free
+    event_handler_t handler;
+    void *userdata;
+};
+
+static struct {
+    int fd_epoll;
+    int running;
+    struct event_source sources[EVENT_LOOP_MAX_SOURCES];
+
+    event_prepare_t prepare;
+    void *prepare_userdata;
+} loop = { .fd_epoll = -1 };
+
+/**
+ * Creates the epoll instance backing the event loop.
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+int init_event_loop(void)
+{
+    memset(&loop, 0, sizeof(loop));
+    for (size_t i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        loop.sources[i].fd = -1;
+    }
+
+    loop.fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.fd_epoll < 0) {
+        logerror("Unable to create epoll instance: %s\n", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Closes the epoll instance. Registered descriptors are not closed.
+ */
+void shutdown_event_loop(void)
+{
+    if (loop.fd_epoll >= 0)
+        close(loop.fd_epoll);
+
+    loop.fd_epoll = -1;
+}
+
+/**
+ * Finds the slot of a registered descriptor.
+ *
+ * @param fd The descriptor.
+ * @return The slot, or NULL if the descriptor is not registered.
+ */
+static struct event_source* find_source(int fd)
+{
+    for (size_t i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        if (loop.sources[i].fd == fd)
+            return &loop.sources[i];
+    }
+    return NULL;
+}
+
+/**
+ * Registers a descriptor with the event loop.
+ *
+ * @param fd The descriptor to watch.
+ * @param events The epoll events to watch for (EPOLLIN, ...).
+ * @param handler Called from run_event_loop() when the descriptor is ready.
+ * @param userdata Passed to the handler.
+ * @return 1 on success, 0 otherwise.
+ */
+int event_loop_add(int fd, uint32_t events, event_handler_t handler, void *userdata)
+{
+    struct event_source *source = find_source(-1);
+    if (fd < 0 || !source) {
+        logerror("Unable to watch descriptor %d\n", fd);
+        return 0;
+    }
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = source,
+    };
+    if (epoll_ctl(loop.fd_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        logerror("Unable to watch descriptor %d: %s\n", fd, strerror(errno));
+        return 0;
+    }
+
+    *source = (struct event_source) {
+        .fd = fd,
+        .handler = handler,
+        .userdata = userdata,
+    };
+    return 1;
+}
+
+/**
+ * Changes the events watched for a registered descriptor.
+ *
+ * @param fd The registered descriptor.
+ * @param events The new epoll events.
+ * @return 1 on success, 0 otherwise.
+ */
+int event_loop_modify(int fd, uint32_t events)
+{
+    struct event_source *source = find_source(fd);
+    if (fd < 0 || !source)
+        return 0;
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = source,
+    };
+    return epoll_ctl(loop.fd_epoll, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+/**
+ * Stops watching a descriptor. Safe to call from a handler.
+ *
+ * @param fd The registered descriptor.
+ */
+void event_loop_remove(int fd)
+{
+    struct event_source *source = find_source(fd);
+    if (fd < 0 || !source)
+        return;
+
+    epoll_ctl(loop.fd_epoll, EPOLL_CTL_DEL, fd, NULL);
+    source->fd = -1;
+    source->handler = NULL;
+}
+
+/**
+ * Sets a callback run before each wait, e.g. to update the events of a
+ * descriptor whose interest changes after every operation (sd-bus).
+ *
+ * @param prepare The callback, or NULL.
+ * @param userdata Passed to the callback.
+ */
+void event_loop_set_prepare(event_prepare_t prepare, void *userdata)
+{
+    loop.prepare = prepare;
+    loop.prepare_userdata = userdata;
+}
+
+/**
+ * Dispatches events to the registered handlers until stop_event_loop()
+ * is called.
+ *
+ * @return 1 if stopped normally, 0 on error.
+ */
+int run_event_loop(void)
+{
+    struct epoll_event events[EVENT_LOOP_MAX_SOURCES];
+
+    loop.running = 1;
+    while (loop.running) {
+        if (loop.prepare)
+            loop.prepare(loop.prepare_userdata);
+
+        int count = epoll_wait(loop.fd_epoll, events, EVENT_LOOP_MAX_SOURCES, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            logerror("Event loop wait failed: %s\n", strerror(errno));
+            return 0;
+        }
+
+        for (int i = 0; i < count && loop.running; i++) {
+            struct event_source *source = events[i].data.ptr;
+
+            // Removed by a handler called earlier in this batch
+            if (source->fd < 0 || !source->handler)
+                continue;
+
+            source->handler(source->fd, events[i].events, source->userdata);
+        }
+    }
+    return 1;
+}
+
+/**
+ * Makes run_event_loop() return after the current handler.
+ */
+void stop_event_loop(void)
+{
+    loop.running = 0;
+}
+
+/**
+ * Creates a disarmed CLOCK_MONOTONIC timer descriptor.
+ *
+ * @return The timerfd, or -1 on error.
+ */
+int create_timer(void)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        logerror("Unable to create timer: %s\n", strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * Arms a periodic timer. The kernel keeps the period, so ticks do not
+ * drift by the time spent handling them.
+ *
+ * @param fd The timerfd.
+ * @param interval_us Period in microseconds, 0 disarms the timer.
+ * @return 1 on success, 0 otherwise.
+ */
+int set_timer(int fd, long interval_us)
+{
+    struct itimerspec spec = {
+        .it_interval = {
+            .tv_sec = interval_us / 1000000L,
+            .tv_nsec = (interval_us % 1000000L) * 1000L,
+        },
+    };
+    spec.it_value = spec.it_interval;
+
+    return timerfd_settime(fd, 0, &spec, NULL) == 0;
+}
+
+/**
+ * Arms a one-shot timer at an absolute CLOCK_MONOTONIC time.
+ *
+ * @param fd The timerfd.
+ * @param deadline_us Expiration time in microseconds, 0 disarms the timer.
+ * @return 1 on success, 0 otherwise.
+ */
+int set_timer_deadline(int fd, uint64_t deadline_us)
+{
+    struct itimerspec spec = {
+        .it_value = {
+            .tv_sec = deadline_us / 1000000ULL,
+            .tv_nsec = (deadline_us % 1000000ULL) * 1000ULL,
+        },
+    };
+
+    return timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0;
+}
+
+/**
+ * Acknowledges the expirations of a timer.
+ *
+ * @param fd The timerfd.
+ * @return Number of expirations since the last read, 0 if none.
+ */
+uint64_t read_timer(int fd)
+{
+    uint64_t expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+
+    return expirations;
+}
+
+/**
+ * Returns the current CLOCK_MONOTONIC time.
+ *
+ * @return Time in microseconds.
+ */
+uint64_t monotonic_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
@@ -0,0 +1,27 @@
+#ifndef _EVENT_LOOP__H
+#define _EVENT_LOOP__H
+
+#include <stdint.h>
+
+/** Maximum number of descriptors watched by the loop */
+#define EVENT_LOOP_MAX_SOURCES 32
+
+typedef void (*event_handler_t)(int fd, uint32_t events, void *userdata);
+typedef void (*event_prepare_t)(void *userdata);
+
+int init_event_loop(void);
+void shutdown_event_loop(void);
+int event_loop_add(int fd, uint32_t events, event_handler_t handler, void *userdata);
+int event_loop_modify(int fd, uint32_t events);
+void event_loop_remove(int fd);
+void event_loop_set_prepare(event_prepare_t prepare, void *userdata);
+int run_event_loop(void);
+void stop_event_loop(void);
+
+int create_timer(void);
+int set_timer(int fd, long interval_us);
+int set_timer_deadline(int fd, uint64_t deadline_us);
+uint64_t read_timer(int fd);
+uint64_t monotonic_us(void);
+
+#endif // _EVENT_LOOP__H
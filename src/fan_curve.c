@@ -0,0 +1,204 @@
+#include "fan_curve.h"
+#include "config.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Curve keys of the configuration file and the channels they set */
+static const struct {
+    const char *key;
+    int first;
+    int last;
+} curve_keys[] = {
+    { "radiator",   FAN_CHANNEL_RADIATOR_1,  FAN_CHANNEL_RADIATOR_3 },
+    { "waterblock", FAN_CHANNEL_WATER_BLOCK, FAN_CHANNEL_WATER_BLOCK },
+    { "pump",       FAN_CHANNEL_PUMP,        FAN_CHANNEL_PUMP },
+    { "fan1",       FAN_CHANNEL_RADIATOR_1,  FAN_CHANNEL_RADIATOR_1 },
+    { "fan2",       FAN_CHANNEL_RADIATOR_2,  FAN_CHANNEL_RADIATOR_2 },
+    { "fan3",       FAN_CHANNEL_RADIATOR_3,  FAN_CHANNEL_RADIATOR_3 },
+    { "fan4",       FAN_CHANNEL_WATER_BLOCK, FAN_CHANNEL_WATER_BLOCK },
+    { "fan5",       FAN_CHANNEL_PUMP,        FAN_CHANNEL_PUMP },
+};
+
+/**
+ * Initializes the curves with the defaults of the AIO.
+ *
+ * @param curves The curves to initialize.
+ */
+void init_fan_curves(fan_curves_t *curves)
+{
+    memset(curves, 0, sizeof(*curves));
+    get_default_fan_curves(curves->points);
+    compile_fan_curves(curves);
+}
+
+/**
+ * Parses a curve such as "30:25 40:35 60:70 75:100": up to FAN_CURVE_POINTS
+ * temperature:duty points, separated by blanks or commas.
+ *
+ * Temperatures must increase and duty cycles must not decrease, so that a
+ * hotter liquid never slows the fans down. Missing points repeat the last
+ * one, as the AIO always takes FAN_CURVE_POINTS points.
+ *
+ * @param spec The curve specification.
+ * @param curve The parsed curve.
+ * @param min_duty Lowest duty cycle allowed (%).
+ * @return 1 if the curve is valid, 0 otherwise.
+ */
+int parse_fan_curve(const char *spec, fan_curve_points_t *curve, int min_duty)
+{
+    char buf[256];
+    char *saveptr;
+    int count = 0;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, " \t,", &saveptr); token; token = strtok_r(NULL, " \t,", &saveptr)) {
+        int temp, duty;
+        char extra;
+
+        if (count == FAN_CURVE_POINTS || sscanf(token, "%d:%d%c", &temp, &duty, &extra) != 2)
+            return 0;
+
+        if (temp < 0 || temp > FAN_CURVE_MAX_TEMP || duty < min_duty || duty > 100)
+            return 0;
+
+        if (count > 0 && (temp <= curve->temp[count - 1] || duty < curve->duty[count - 1]))
+            return 0;
+
+        curve->temp[count] = temp;
+        curve->duty[count] = duty;
+        count++;
+    }
+
+    if (count == 0)
+        return 0;
+
+    for (int i = count; i < FAN_CURVE_POINTS; i++) {
+        curve->temp[i] = curve->temp[count - 1];
+        curve->duty[i] = curve->duty[count - 1];
+    }
+    return 1;
+}
+
+/**
+ * Builds the lookup tables from the curve points: linear interpolation
+ * between points, flat below the first and above the last one.
+ *
+ * @param curves The curves.
+ */
+void compile_fan_curves(fan_curves_t *curves)
+{
+    for (int channel = 0; channel < FAN_CHANNELS; channel++) {
+        const fan_curve_points_t *points = &curves->points[channel];
+        int point = 0;
+
+        for (int temp = 0; temp <= FAN_CURVE_MAX_TEMP; temp++) {
+            while (point < FAN_CURVE_POINTS - 1 && temp >= points->temp[point + 1])
+                point++;
+
+            int duty = points->duty[point];
+            if (temp > points->temp[point] && point < FAN_CURVE_POINTS - 1 && points->temp[point + 1] > points->temp[point]) {
+                int span = points->temp[point + 1] - points->temp[point];
+                int rise = points->duty[point + 1] - points->duty[point];
+                duty += (rise * (temp - points->temp[point]) + span / 2) / span;
+            }
+            curves->lut[channel][temp] = duty;
+        }
+    }
+}
+
+/**
+ * Parses a curve setting: "radiator", "waterblock", "pump", "fan1".."fan5"
+ * or "host_driven". The lookup tables must be compiled afterwards.
+ *
+ * @param key The setting name.
+ * @param value The setting value.
+ * @param curves The curves to update.
+ * @return 1 if the setting is valid, 0 otherwise.
+ */
+int parse_fan_curve_setting(const char *key, const char *value, fan_curves_t *curves)
+{
+    if (!strcmp(key, "host_driven"))
+        return parse_config_bool(value, &curves->host_driven);
+
+    for (size_t i = 0; i < sizeof(curve_keys) / sizeof(curve_keys[0]); i++) {
+        if (strcmp(key, curve_keys[i].key))
+            continue;
+
+        fan_curve_points_t curve;
+        int min_duty = curve_keys[i].last == FAN_CHANNEL_PUMP ? FAN_CURVE_PUMP_MIN_DUTY : 0;
+        if (!parse_fan_curve(value, &curve, min_duty))
+            return 0;
+
+        for (int channel = curve_keys[i].first; channel <= curve_keys[i].last; channel++) {
+            curves->points[channel] = curve;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Handles a setting of the curve file.
+ */
+static int fan_curve_setting(const char *key, const char *value, void *userdata)
+{
+    return parse_fan_curve_setting(key, value, (fan_curves_t*) userdata);
+}
+
+/**
+ * Loads fan curves from a file such as:
+ *
+ *     radiator = 30:25 40:35 60:70 75:100
+ *     pump = 30:50 50:80 60:100
+ *     host_driven = no
+ *
+ * Channels not present keep their current curve. The curves are left
+ * unchanged if the file is invalid.
+ *
+ * @param path Path of the curve file.
+ * @param curves The curves to update.
+ * @return 1 on success, 0 otherwise.
+ */
+int load_fan_curves(const char *path, fan_curves_t *curves)
+{
+    fan_curves_t loaded = *curves;
+
+    if (!read_config_file(path, fan_curve_setting, &loaded))
+        return 0;
+
+    compile_fan_curves(&loaded);
+    *curves = loaded;
+
+    for (int channel = 0; channel < FAN_CHANNELS; channel++) {
+        const fan_curve_points_t *points = &curves->points[channel];
+        loginfo("Fan %d curve: %d:%d %d:%d %d:%d %d:%d %d:%d %d:%d %d:%d\n", channel + 1,
+            points->temp[0], points->duty[0], points->temp[1], points->duty[1],
+            points->temp[2], points->duty[2], points->temp[3], points->duty[3],
+            points->temp[4], points->duty[4], points->temp[5], points->duty[5],
+            points->temp[6], points->duty[6]);
+    }
+    return 1;
+}
+
+/**
+ * Evaluates the curves at a temperature.
+ *
+ * @param curves The compiled curves.
+ * @param temperature The temperature (C).
+ * @param duty Filled with the duty cycle (%) of each channel.
+ */
+void fan_curve_duty(const fan_curves_t *curves, int temperature, uint8_t duty[FAN_CHANNELS])
+{
+    if (temperature < 0)
+        temperature = 0;
+    if (temperature > FAN_CURVE_MAX_TEMP)
+        temperature = FAN_CURVE_MAX_TEMP;
+
+    for (int channel = 0; channel < FAN_CHANNELS; channel++) {
+        duty[channel] = curves->lut[channel][temperature];
+    }
+}
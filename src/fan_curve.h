@@ -0,0 +1,31 @@
+#ifndef _FAN_CURVE__H
+#define _FAN_CURVE__H
+
+#include "coreliquid.h"
+
+#include <stdint.h>
+
+/** Highest temperature (C) of a curve point */
+#define FAN_CURVE_MAX_TEMP 100
+
+/** The pump never runs below this duty cycle (%) */
+#define FAN_CURVE_PUMP_MIN_DUTY 20
+
+struct fan_curves {
+    fan_curve_points_t points[FAN_CHANNELS];
+
+    // Duty cycle of each channel at every whole degree, built from the points
+    uint8_t lut[FAN_CHANNELS][FAN_CURVE_MAX_TEMP + 1];
+
+    int host_driven;        // evaluated by the host every tick instead of by the AIO
+};
+typedef struct fan_curves fan_curves_t;
+
+void init_fan_curves(fan_curves_t *curves);
+int load_fan_curves(const char *path, fan_curves_t *curves);
+int parse_fan_curve_setting(const char *key, const char *value, fan_curves_t *curves);
+int parse_fan_curve(const char *spec, fan_curve_points_t *curve, int min_duty);
+void compile_fan_curves(fan_curves_t *curves);
+void fan_curve_duty(const fan_curves_t *curves, int temperature, uint8_t duty[FAN_CHANNELS]);
+
+#endif // _FAN_CURVE__H
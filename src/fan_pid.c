@@ -0,0 +1,243 @@
+#include "fan_pid.h"
+#include "logger.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Error (C) that starts a new step when the loop was settled */
+#define PID_STEP_THRESHOLD 3.0f
+
+/**
+ * Initializes a controller and clears its state and metrics. The output
+ * starts at the lower bound.
+ *
+ * @param pid The controller to initialize.
+ * @param config The configuration, copied into the controller.
+ */
+void init_fan_pid(fan_pid_t *pid, const pid_config_t *config)
+{
+    memset(pid, 0, sizeof(*pid));
+    pid->config = *config;
+
+    if (pid->config.max_duty <= 0 || pid->config.max_duty > 100)
+        pid->config.max_duty = 100;
+    if (pid->config.min_duty < 0 || pid->config.min_duty > pid->config.max_duty)
+        pid->config.min_duty = 0;
+
+    pid->output = pid->config.min_duty;
+}
+
+/**
+ * Tracks the step response: a step starts when the error leaves
+ * PID_STEP_THRESHOLD, the overshoot is how far the temperature goes past
+ * the target afterwards, and the step settles once the error has stayed
+ * within the settle band for the hold time.
+ */
+static void track_step(fan_pid_t *pid, float error, uint64_t now_us)
+{
+    const pid_config_t *config = &pid->config;
+
+    if (!pid->in_step) {
+        if (fabsf(error) < PID_STEP_THRESHOLD)
+            return;
+
+        pid->in_step = 1;
+        pid->step_sign = error > 0 ? 1 : -1;
+        pid->step_start_us = now_us;
+        pid->step_overshoot = 0;
+        pid->in_band_since_us = 0;
+        pid->metrics.steps++;
+    }
+
+    float past_target = -error * pid->step_sign;
+    if (past_target > pid->step_overshoot)
+        pid->step_overshoot = past_target;
+
+    if (fabsf(error) > config->settle_band) {
+        pid->in_band_since_us = 0;
+        return;
+    }
+
+    if (pid->in_band_since_us == 0)
+        pid->in_band_since_us = now_us;
+
+    if (now_us - pid->in_band_since_us >= (uint64_t)config->settle_hold_us) {
+        pid_metrics_t *metrics = &pid->metrics;
+
+        metrics->settled++;
+        metrics->settling_time_us = pid->in_band_since_us - pid->step_start_us;
+        metrics->overshoot = pid->step_overshoot;
+        if (metrics->settling_time_us > metrics->max_settling_time_us)
+            metrics->max_settling_time_us = metrics->settling_time_us;
+        if (metrics->overshoot > metrics->max_overshoot)
+            metrics->max_overshoot = metrics->overshoot;
+
+        pid->in_step = 0;
+    }
+}
+
+/**
+ * Computes the duty cycle from a new measurement.
+ *
+ * The derivative acts on the measurement, so target changes do not kick
+ * the output. The integral stops while the output is saturated in the
+ * direction of the error (anti-windup), and the output moves by at most
+ * max_step per second.
+ *
+ * @param pid The controller.
+ * @param measured The measured temperature (C).
+ * @param cpu_load CPU load (%) for the feed-forward.
+ * @param cpu_power Package power (W) for the feed-forward.
+ * @param now_us Time of the measurement (CLOCK_MONOTONIC, microseconds).
+ * @return The duty cycle to apply (%).
+ */
+int fan_pid_update(fan_pid_t *pid, float measured, int cpu_load, int cpu_power, uint64_t now_us)
+{
+    const pid_config_t *config = &pid->config;
+    float error = measured - config->target;
+
+    if (!pid->primed) {
+        pid->primed = 1;
+        pid->last_measured = measured;
+        pid->last_time_us = now_us;
+        track_step(pid, error, now_us);
+        return (int)(pid->output + 0.5f);
+    }
+
+    float dt = (now_us - pid->last_time_us) / 1000000.0f;
+    if (dt <= 0)
+        return (int)(pid->output + 0.5f);
+
+    float derivative = (measured - pid->last_measured) / dt;
+    float feed_forward = config->ff_load * cpu_load + config->ff_power * cpu_power;
+
+    float integral = pid->integral + config->ki * error * dt;
+    float output = config->kp * error + integral + config->kd * derivative + feed_forward;
+
+    // Anti-windup: keep the integral while saturated in the direction of the error
+    if ((output > config->max_duty && error > 0) || (output < config->min_duty && error < 0)) {
+        output -= integral - pid->integral;
+    } else {
+        pid->integral = integral;
+    }
+
+    if (output > config->max_duty)
+        output = config->max_duty;
+    if (output < config->min_duty)
+        output = config->min_duty;
+
+    if (config->max_step > 0) {
+        float max_change = config->max_step * dt;
+        if (output > pid->output + max_change)
+            output = pid->output + max_change;
+        if (output < pid->output - max_change)
+            output = pid->output - max_change;
+    }
+
+    pid->output = output;
+    pid->last_measured = measured;
+    pid->last_time_us = now_us;
+
+    track_step(pid, error, now_us);
+
+    return (int)(output + 0.5f);
+}
+
+/**
+ * Changes the target temperature. The change is tracked as a new step.
+ *
+ * @param pid The controller.
+ * @param target The new target (C).
+ * @param now_us Current time (CLOCK_MONOTONIC, microseconds).
+ */
+void fan_pid_set_target(fan_pid_t *pid, int target, uint64_t now_us)
+{
+    if (target == pid->config.target)
+        return;
+
+    pid->config.target = target;
+    pid->in_step = 0;
+    if (pid->primed)
+        track_step(pid, pid->last_measured - target, now_us);
+}
+
+/**
+ * Parses a controller specification such as
+ * "target=55,source=liquid,kp=4,ki=0.2,kd=0,min=20,max=100,step=5,load=0.2,power=0.1".
+ * Keys not present keep their current value in config.
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to update.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_pid_config(const char *spec, pid_config_t *config)
+{
+    char buf[256];
+    char *saveptr;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(token, '=');
+        if (!value)
+            return 0;
+        *value++ = '\0';
+
+        if (!strcmp(token, "target")) {
+            config->target = atoi(value);
+            if (config->target < 20 || config->target > 95)
+                return 0;
+        } else if (!strcmp(token, "source")) {
+            if (!strcmp(value, "liquid"))
+                config->source = PID_SOURCE_LIQUID;
+            else if (!strcmp(value, "cpu"))
+                config->source = PID_SOURCE_CPU;
+            else
+                return 0;
+        } else if (!strcmp(token, "kp")) {
+            config->kp = strtof(value, NULL);
+        } else if (!strcmp(token, "ki")) {
+            config->ki = strtof(value, NULL);
+        } else if (!strcmp(token, "kd")) {
+            config->kd = strtof(value, NULL);
+        } else if (!strcmp(token, "min")) {
+            config->min_duty = atoi(value);
+        } else if (!strcmp(token, "max")) {
+            config->max_duty = atoi(value);
+        } else if (!strcmp(token, "step")) {
+            config->max_step = strtof(value, NULL);
+        } else if (!strcmp(token, "load")) {
+            config->ff_load = strtof(value, NULL);
+        } else if (!strcmp(token, "power")) {
+            config->ff_power = strtof(value, NULL);
+        } else if (!strcmp(token, "band")) {
+            config->settle_band = strtof(value, NULL);
+        } else if (!strcmp(token, "hold")) {
+            config->settle_hold_us = atol(value) * 1000L;
+        } else {
+            return 0;
+        }
+    }
+
+    return config->min_duty >= 0 && config->min_duty <= config->max_duty && config->max_duty <= 100
+        && config->kp >= 0 && config->ki >= 0 && config->kd >= 0 && config->max_step >= 0;
+}
+
+/**
+ * Logs the step response metrics of the controller.
+ *
+ * @param pid The controller.
+ */
+void log_pid_metrics(const fan_pid_t *pid)
+{
+    const pid_metrics_t *metrics = &pid->metrics;
+
+    loginfo("PID: %u steps, %u settled, last settling %llu s with %.1f C overshoot, max settling %llu s, max overshoot %.1f C\n",
+        metrics->steps, metrics->settled,
+        (unsigned long long)(metrics->settling_time_us / 1000000),
+        metrics->overshoot,
+        (unsigned long long)(metrics->max_settling_time_us / 1000000),
+        metrics->max_overshoot);
+}
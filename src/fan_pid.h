@@ -0,0 +1,65 @@
+#ifndef _FAN_PID__H
+#define _FAN_PID__H
+
+#include <stdint.h>
+
+enum pid_source {
+    PID_SOURCE_LIQUID = 0,  // liquid temperature reported by the AIO
+    PID_SOURCE_CPU = 1      // conditioned CPU temperature
+};
+typedef enum pid_source pid_source_t;
+
+struct pid_config {
+    int target;             // temperature to hold (C), 0 disables the controller
+    pid_source_t source;
+    float kp;               // duty % per C of error
+    float ki;               // duty % per C of error and second
+    float kd;               // duty % per C/s
+    int min_duty;           // output bounds (%)
+    int max_duty;
+    float max_step;         // largest duty change per second (%), 0 disables
+    float ff_load;          // feed-forward, duty % per % of CPU load
+    float ff_power;         // feed-forward, duty % per W of package power
+    float settle_band;      // error considered settled (C)
+    long settle_hold_us;    // time the error must stay in the band
+};
+typedef struct pid_config pid_config_t;
+
+/** Step response of the last disturbance or target change */
+struct pid_metrics {
+    uint32_t steps;             // disturbances seen
+    uint32_t settled;           // disturbances that settled
+    uint64_t settling_time_us;  // of the last settled step
+    float overshoot;            // of the last step (C past the target)
+    float max_overshoot;
+    uint64_t max_settling_time_us;
+};
+typedef struct pid_metrics pid_metrics_t;
+
+struct fan_pid {
+    pid_config_t config;
+
+    float integral;
+    float output;
+    float last_measured;
+    uint64_t last_time_us;
+    int primed;
+
+    // Step response tracking
+    int in_step;
+    int step_sign;              // sign of the error when the step started
+    uint64_t step_start_us;
+    uint64_t in_band_since_us;  // 0 while out of the band
+    float step_overshoot;
+
+    pid_metrics_t metrics;
+};
+typedef struct fan_pid fan_pid_t;
+
+void init_fan_pid(fan_pid_t *pid, const pid_config_t *config);
+int fan_pid_update(fan_pid_t *pid, float measured, int cpu_load, int cpu_power, uint64_t now_us);
+void fan_pid_set_target(fan_pid_t *pid, int target, uint64_t now_us);
+int parse_pid_config(const char *spec, pid_config_t *config);
+void log_pid_metrics(const fan_pid_t *pid);
+
+#endif // _FAN_PID__H
@@ -0,0 +1,326 @@
+#define FUSE_USE_VERSION 31
+#include "fuse_hwmon.h"
+#include "logger.h"
+
+#include <fuse.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/** Reported size of the files, as sysfs does; reads return the actual text */
+#define HWMON_FILE_SIZE 4096
+
+enum hwmon_attr {
+    HWMON_NAME,
+    HWMON_FAN_INPUT,
+    HWMON_FAN_LABEL,
+    HWMON_PWM,
+    HWMON_TEMP_INPUT,
+    HWMON_TEMP_LABEL,
+};
+
+struct hwmon_file {
+    const char *path;
+    enum hwmon_attr attr;
+    int index;              // fan number - 1
+};
+
+static const struct hwmon_file hwmon_files[] = {
+    { "/name",        HWMON_NAME,       0 },
+    { "/fan1_input",  HWMON_FAN_INPUT,  0 },
+    { "/fan1_label",  HWMON_FAN_LABEL,  0 },
+    { "/fan2_input",  HWMON_FAN_INPUT,  1 },
+    { "/fan2_label",  HWMON_FAN_LABEL,  1 },
+    { "/fan3_input",  HWMON_FAN_INPUT,  2 },
+    { "/fan3_label",  HWMON_FAN_LABEL,  2 },
+    { "/pwm1",        HWMON_PWM,        0 },
+    { "/pwm2",        HWMON_PWM,        1 },
+    { "/pwm3",        HWMON_PWM,        2 },
+    { "/temp1_input", HWMON_TEMP_INPUT, 0 },
+    { "/temp1_label", HWMON_TEMP_LABEL, 0 },
+};
+
+/** Fans of the hwmon directory */
+static const struct {
+    int metric;
+    int channel;
+    const char *label;
+} hwmon_fans[] = {
+    { METRIC_FAN_RADIATOR,    FAN_CHANNEL_RADIATOR_1,  "Radiator" },
+    { METRIC_FAN_WATER_BLOCK, FAN_CHANNEL_WATER_BLOCK, "Water block" },
+    { METRIC_PUMP,            FAN_CHANNEL_PUMP,        "Pump" },
+};
+
+static struct {
+    struct fuse *fuse;
+    pthread_t thread;
+    int running;
+
+    // Seqlock protected copy of the cached readings: odd sequence while
+    // the main thread is copying
+    _Atomic uint32_t sequence;
+    telemetry_t telemetry;
+    uint8_t duty[FAN_CHANNELS];     // %, 0xff if not set by the host
+    int valid;                      // cooler status read at least once and the last read succeeded
+} hwmon;
+
+/**
+ * Copies the cached readings, retrying while the main thread updates them.
+ */
+static void read_hwmon_values(telemetry_t *telemetry, uint8_t duty[FAN_CHANNELS], int *valid)
+{
+    uint32_t seq_begin, seq_end;
+
+    do {
+        seq_begin = atomic_load_explicit(&hwmon.sequence, memory_order_acquire);
+        *telemetry = hwmon.telemetry;
+        memcpy(duty, hwmon.duty, FAN_CHANNELS);
+        *valid = hwmon.valid;
+        atomic_thread_fence(memory_order_acquire);
+        seq_end = atomic_load_explicit(&hwmon.sequence, memory_order_relaxed);
+    } while ((seq_begin & 1) || seq_begin != seq_end);
+}
+
+static const struct hwmon_file* find_hwmon_file(const char *path)
+{
+    for (size_t i = 0; i < sizeof(hwmon_files) / sizeof(hwmon_files[0]); i++) {
+        if (!strcmp(hwmon_files[i].path, path))
+            return &hwmon_files[i];
+    }
+    return NULL;
+}
+
+/**
+ * Formats the content of a file, from the cached readings only.
+ *
+ * @return Length of the text, or -ENODATA while the reading is unavailable.
+ */
+static int format_hwmon_file(const struct hwmon_file *file, char *text, size_t size)
+{
+    telemetry_t telemetry;
+    uint8_t duty[FAN_CHANNELS];
+    int valid;
+
+    read_hwmon_values(&telemetry, duty, &valid);
+
+    switch (file->attr) {
+        case HWMON_NAME:
+            return snprintf(text, size, "coreliquid\n");
+
+        case HWMON_FAN_LABEL:
+            return snprintf(text, size, "%s\n", hwmon_fans[file->index].label);
+
+        case HWMON_TEMP_LABEL:
+            return snprintf(text, size, "Liquid\n");
+
+        case HWMON_FAN_INPUT:
+            if (!valid)
+                return -ENODATA;
+            return snprintf(text, size, "%u\n", telemetry.values[hwmon_fans[file->index].metric]);
+
+        case HWMON_TEMP_INPUT:
+            if (!valid)
+                return -ENODATA;
+            return snprintf(text, size, "%u\n", telemetry.values[METRIC_LIQUID_TEMP] * 1000U);
+
+        case HWMON_PWM: {
+            // Only known when the host sets the duty cycles
+            uint8_t percent = duty[hwmon_fans[file->index].channel];
+            if (percent > 100)
+                return -ENODATA;
+            return snprintf(text, size, "%u\n", (percent * 255U + 50) / 100);
+        }
+    }
+    return -ENOENT;
+}
+
+static int hwmon_getattr(const char *path, struct stat *st, __attribute__((unused)) struct fuse_file_info *fi)
+{
+    memset(st, 0, sizeof(*st));
+
+    if (!strcmp(path, "/")) {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_nlink = 2;
+        return 0;
+    }
+
+    if (!find_hwmon_file(path))
+        return -ENOENT;
+
+    st->st_mode = S_IFREG | 0444;
+    st->st_nlink = 1;
+    st->st_size = HWMON_FILE_SIZE;
+    return 0;
+}
+
+static int hwmon_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+    __attribute__((unused)) off_t offset,
+    __attribute__((unused)) struct fuse_file_info *fi,
+    __attribute__((unused)) enum fuse_readdir_flags flags)
+{
+    if (strcmp(path, "/"))
+        return -ENOENT;
+
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    for (size_t i = 0; i < sizeof(hwmon_files) / sizeof(hwmon_files[0]); i++) {
+        filler(buf, hwmon_files[i].path + 1, NULL, 0, 0);
+    }
+    return 0;
+}
+
+static int hwmon_open(const char *path, struct fuse_file_info *fi)
+{
+    if (!find_hwmon_file(path))
+        return -ENOENT;
+
+    if ((fi->flags & O_ACCMODE) != O_RDONLY)
+        return -EACCES;
+
+    // Every read gets the current value, not the page cache
+    fi->direct_io = 1;
+    return 0;
+}
+
+static int hwmon_read(const char *path, char *buf, size_t size, off_t offset,
+    __attribute__((unused)) struct fuse_file_info *fi)
+{
+    const struct hwmon_file *file = find_hwmon_file(path);
+    char text[32];
+
+    if (!file)
+        return -ENOENT;
+
+    int len = format_hwmon_file(file, text, sizeof(text));
+    if (len < 0)
+        return len;
+
+    if (offset >= len)
+        return 0;
+    if (size > (size_t)(len - offset))
+        size = len - offset;
+
+    memcpy(buf, text + offset, size);
+    return (int)size;
+}
+
+static const struct fuse_operations hwmon_operations = {
+    .getattr = hwmon_getattr,
+    .readdir = hwmon_readdir,
+    .open = hwmon_open,
+    .read = hwmon_read,
+};
+
+static void* run_fuse_hwmon(__attribute__((unused)) void *arg)
+{
+    fuse_loop(hwmon.fuse);
+    return NULL;
+}
+
+/**
+ * Creates the mount point and its parents.
+ */
+static void make_mountpoint(const char *mountpoint)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s", mountpoint);
+    for (char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    mkdir(path, 0755);
+}
+
+/**
+ * Mounts the hwmon-like directory and serves it from a thread. Files are
+ * read from the readings cached by the main thread, never from the devices.
+ *
+ * The thread is created with the signals blocked by the caller.
+ *
+ * @param mountpoint The directory to mount on, created if needed.
+ * @return 1 on success, 0 otherwise.
+ */
+int start_fuse_hwmon(const char *mountpoint)
+{
+    char *argv[] = { "my_msi_coreliquid", "-o", "allow_other", NULL };
+    struct fuse_args args = FUSE_ARGS_INIT(3, argv);
+
+    memset(hwmon.duty, 0xff, sizeof(hwmon.duty));
+    make_mountpoint(mountpoint);
+
+    hwmon.fuse = fuse_new(&args, &hwmon_operations, sizeof(hwmon_operations), NULL);
+    fuse_opt_free_args(&args);
+    if (!hwmon.fuse) {
+        logerror("Unable to create the hwmon filesystem\n");
+        return 0;
+    }
+
+    if (fuse_mount(hwmon.fuse, mountpoint) != 0) {
+        logerror("Unable to mount the hwmon filesystem on %s\n", mountpoint);
+        fuse_destroy(hwmon.fuse);
+        hwmon.fuse = NULL;
+        return 0;
+    }
+
+    if (pthread_create(&hwmon.thread, NULL, run_fuse_hwmon, NULL) != 0) {
+        logerror("Unable to start the hwmon filesystem thread\n");
+        fuse_unmount(hwmon.fuse);
+        fuse_destroy(hwmon.fuse);
+        hwmon.fuse = NULL;
+        return 0;
+    }
+
+    hwmon.running = 1;
+    loginfo("hwmon filesystem mounted on %s\n", mountpoint);
+    return 1;
+}
+
+/**
+ * Updates the readings served by the filesystem.
+ *
+ * Only the main thread writes, so the seqlock needs no writer lock.
+ *
+ * @param telemetry The latest telemetry.
+ * @param duty Duty cycles set by the host (%), 0xff if not set.
+ * @param valid Whether the cooler status is current.
+ */
+void update_fuse_hwmon(const telemetry_t *telemetry, const uint8_t duty[FAN_CHANNELS], int valid)
+{
+    if (!hwmon.running)
+        return;
+
+    uint32_t seq = atomic_load_explicit(&hwmon.sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&hwmon.sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    hwmon.telemetry = *telemetry;
+    memcpy(hwmon.duty, duty, FAN_CHANNELS);
+    hwmon.valid = valid;
+
+    atomic_store_explicit(&hwmon.sequence, seq + 2, memory_order_release);
+}
+
+/**
+ * Unmounts the filesystem, which ends the thread.
+ */
+void stop_fuse_hwmon(void)
+{
+    if (!hwmon.running)
+        return;
+
+    fuse_exit(hwmon.fuse);
+    fuse_unmount(hwmon.fuse);
+    pthread_join(hwmon.thread, NULL);
+    fuse_destroy(hwmon.fuse);
+
+    hwmon.fuse = NULL;
+    hwmon.running = 0;
+}
@@ -0,0 +1,11 @@
+#ifndef _FUSE_HWMON__H
+#define _FUSE_HWMON__H
+
+#include "coreliquid.h"
+#include "telemetry.h"
+
+int start_fuse_hwmon(const char *mountpoint);
+void update_fuse_hwmon(const telemetry_t *telemetry, const uint8_t duty[FAN_CHANNELS], int valid);
+void stop_fuse_hwmon(void);
+
+#endif // _FUSE_HWMON__H
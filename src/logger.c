@@ -1,38 +1,468 @@
 #include "logger.h"
 
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
 #include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
-static int dosyslog = 0;
+#if defined(HAVE_SYSTEMD_BUS) && !defined(_DEBUG)
+#include <sys/uio.h>
+#include <systemd/sd-daemon.h>
+#include <systemd/sd-journal.h>
+#endif
+
+/** Messages waiting for the log thread, a power of two */
+#define LOG_RING_SIZE 256
+#define LOG_MESSAGE_SIZE 256
+
+/** Messages of a same format written per interval, the others are counted */
+#define LOG_RATE_BURST 10
+#define LOG_RATE_INTERVAL_US 10000000ULL
+#define LOG_RATE_FORMATS 32
+
+/** Interval of the summaries of repeated and suppressed messages */
+#define LOG_SUMMARY_INTERVAL_MS 10000
+
+struct log_message {
+    int priority;
+    const char *format;         // key of the rate limit, NULL for the summaries
+    int error;
+    char device[32];
+    char command[16];
+    char text[LOG_MESSAGE_SIZE];
+};
+
+struct log_entry {
+    // Position + 1 once written, position + LOG_RING_SIZE once read
+    _Atomic uint32_t sequence;
+    struct log_message message;
+};
+
+struct log_rate {
+    const char *format;
+    uint64_t window_us;         // start of the current interval
+    uint32_t count;
+    uint32_t suppressed;
+};
+
+static struct {
+    int dosyslog;
+    int journal;                // journald runs, messages go to it
+    const char *ident;
+
+    // Bounded multi-producer ring, read by the log thread only
+    struct log_entry ring[LOG_RING_SIZE];
+    _Atomic uint32_t head;
+    uint32_t tail;
+    _Atomic uint64_t dropped;
+
+    _Atomic int running;
+    _Atomic int stop;
+    _Atomic int waiting;        // the log thread sleeps, producers must wake it
+    int fd_event;
+    pthread_t thread;
+
+    // Log thread state
+    struct log_message last;    // last message written
+    uint32_t repeated;          // times the last message came again since written
+    uint64_t last_us;
+    struct log_rate rates[LOG_RATE_FORMATS];
+    uint64_t dropped_pending;   // not reported yet
+    uint64_t dropped_us;        // last report
+} logger;
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static void format_message(struct log_message *message, int priority, const log_fields_t *fields,
+    const char *format, va_list ap)
+{
+    message->priority = priority;
+    message->format = format;
+    message->error = fields ? fields->error : 0;
+    snprintf(message->device, sizeof(message->device), "%s", fields && fields->device ? fields->device : "");
+    snprintf(message->command, sizeof(message->command), "%s", fields && fields->command ? fields->command : "");
+    vsnprintf(message->text, sizeof(message->text), format, ap);
+}
+
+#if defined(HAVE_SYSTEMD_BUS) && !defined(_DEBUG)
+static void set_field(struct iovec *field, char *buffer, size_t size, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int len = vsnprintf(buffer, size, format, ap);
+    va_end(ap);
+
+    field->iov_base = buffer;
+    field->iov_len = len < (int)size ? (size_t)len : size - 1;
+}
+
+/**
+ * Writes a message to the journal, with its fields.
+ *
+ * @return 1 on success, 0 if journald did not take it.
+ */
+static int write_journal(const struct log_message *message)
+{
+    char text[LOG_MESSAGE_SIZE + 8], priority[16], facility[24], identifier[80];
+    char device[48], command[32], error[16];
+    struct iovec fields[7];
+    int count = 0;
+
+    size_t len = strlen(message->text);
+    while (len > 0 && message->text[len - 1] == '\n')
+        len--;
+
+    set_field(&fields[count++], text, sizeof(text), "MESSAGE=%.*s", (int)len, message->text);
+    set_field(&fields[count++], priority, sizeof(priority), "PRIORITY=%d", message->priority);
+    set_field(&fields[count++], facility, sizeof(facility), "SYSLOG_FACILITY=%d", LOG_DAEMON >> 3);
+    set_field(&fields[count++], identifier, sizeof(identifier), "SYSLOG_IDENTIFIER=%s", logger.ident);
+    if (message->device[0])
+        set_field(&fields[count++], device, sizeof(device), "CORELIQUID_DEVICE=%s", message->device);
+    if (message->command[0])
+        set_field(&fields[count++], command, sizeof(command), "CORELIQUID_COMMAND=%s", message->command);
+    if (message->error)
+        set_field(&fields[count++], error, sizeof(error), "ERRNO=%d", message->error);
+
+    return sd_journal_sendv(fields, count) >= 0;
+}
+#endif
+
+/**
+ * Writes a message to the journal, or to stderr when journald does not
+ * run or fails to take it.
+ */
+static void write_message(const struct log_message *message)
+{
+#ifndef _DEBUG
+    if (logger.dosyslog) {
+#ifdef HAVE_SYSTEMD_BUS
+        if (logger.journal && write_journal(message))
+            return;
+#else
+        syslog(message->priority, "%s", message->text);
+        return;
+#endif
+    }
+#endif
+    fputs(message->text, stderr);
+}
+
+static void write_summary(int priority, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void write_summary(int priority, const char *format, ...)
+{
+    struct log_message message;
+    va_list ap;
+
+    va_start(ap, format);
+    format_message(&message, priority, NULL, format, ap);
+    va_end(ap);
+    message.format = NULL;
+
+    write_message(&message);
+}
+
+/**
+ * Writes how many times the last message came again since written.
+ */
+static void flush_repeated(uint64_t now)
+{
+    if (logger.repeated > 0) {
+        write_summary(logger.last.priority, "Last message repeated %u times\n", logger.repeated);
+        logger.repeated = 0;
+    }
+    logger.last_us = now;
+}
+
+static void report_suppressed(struct log_rate *rate)
+{
+    if (rate->suppressed == 0)
+        return;
+
+    write_summary(LOG_WARNING, "%u more messages like \"%.*s\" suppressed\n", rate->suppressed,
+        (int)strcspn(rate->format, "\n"), rate->format);
+    rate->suppressed = 0;
+}
+
+/**
+ * Counts a message against the rate of its format.
+ *
+ * @return 1 if the message can be written, 0 if it is over the rate.
+ */
+static int check_rate(const char *format, uint64_t now)
+{
+    struct log_rate *rate = NULL;
+    struct log_rate *oldest = &logger.rates[0];
 
+    for (int i = 0; i < LOG_RATE_FORMATS; i++) {
+        if (logger.rates[i].format == format) {
+            rate = &logger.rates[i];
+            break;
+        }
+        if (logger.rates[i].window_us < oldest->window_us)
+            oldest = &logger.rates[i];
+    }
+
+    if (!rate) {
+        rate = oldest;
+        if (rate->format)
+            report_suppressed(rate);
+        *rate = (struct log_rate) { .format = format, .window_us = now };
+    } else if (now - rate->window_us >= LOG_RATE_INTERVAL_US) {
+        report_suppressed(rate);
+        rate->window_us = now;
+        rate->count = 0;
+    }
+
+    if (rate->count >= LOG_RATE_BURST) {
+        rate->suppressed++;
+        return 0;
+    }
+    rate->count++;
+    return 1;
+}
+
+/**
+ * Writes the summaries due: the repeats of the last message after the
+ * interval, the suppressed messages of the formats whose interval ended, and
+ * the messages dropped while the ring was full, at most once per interval.
+ *
+ * @param all Whether to write them all, at the end.
+ */
+static void flush_summaries(uint64_t now, int all)
+{
+    if (all || now - logger.last_us >= LOG_SUMMARY_INTERVAL_MS * 1000ULL)
+        flush_repeated(now);
+
+    for (int i = 0; i < LOG_RATE_FORMATS; i++) {
+        struct log_rate *rate = &logger.rates[i];
+        if (rate->suppressed > 0 && (all || now - rate->window_us >= LOG_RATE_INTERVAL_US)) {
+            report_suppressed(rate);
+            rate->window_us = now;
+            rate->count = 0;
+        }
+    }
+
+    if (logger.dropped_pending > 0 && (all || now - logger.dropped_us >= LOG_SUMMARY_INTERVAL_MS * 1000ULL)) {
+        write_summary(LOG_WARNING, "Log ring full, %llu messages dropped\n", (unsigned long long)logger.dropped_pending);
+        logger.dropped_pending = 0;
+        logger.dropped_us = now;
+    }
+}
+
+static int has_summaries(void)
+{
+    if (logger.repeated > 0 || logger.dropped_pending > 0)
+        return 1;
+    for (int i = 0; i < LOG_RATE_FORMATS; i++) {
+        if (logger.rates[i].suppressed > 0)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Writes a message, unless it repeats the last one or its format is over
+ * the rate.
+ */
+static void process_message(const struct log_message *message)
+{
+    uint64_t now = now_us();
+
+    if (message->priority == logger.last.priority && !strcmp(message->text, logger.last.text)) {
+        logger.repeated++;
+        if (now - logger.last_us >= LOG_SUMMARY_INTERVAL_MS * 1000ULL)
+            flush_repeated(now);
+        return;
+    }
+
+    flush_repeated(now);
+    if (!check_rate(message->format, now))
+        return;
+
+    write_message(message);
+    logger.last = *message;
+}
+
+/**
+ * Processes the messages published in the ring.
+ */
+static void drain_ring(void)
+{
+    for (;;) {
+        struct log_entry *entry = &logger.ring[logger.tail & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&entry->sequence, memory_order_acquire) != logger.tail + 1)
+            break;
+
+        process_message(&entry->message);
+        atomic_store_explicit(&entry->sequence, logger.tail + LOG_RING_SIZE, memory_order_release);
+        logger.tail++;
+    }
+
+    logger.dropped_pending += atomic_exchange_explicit(&logger.dropped, 0, memory_order_relaxed);
+}
+
+static void* log_thread(__attribute__((unused)) void *arg)
+{
+    struct pollfd pfd = { .fd = logger.fd_event, .events = POLLIN };
+
+    while (!atomic_load(&logger.stop)) {
+        // Producers only write the eventfd while the thread sleeps: announce
+        // it, then look at the ring again in case a message came meanwhile
+        atomic_store(&logger.waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        struct log_entry *next = &logger.ring[logger.tail & (LOG_RING_SIZE - 1)];
+        int ret = 0;
+        if (atomic_load_explicit(&next->sequence, memory_order_acquire) != logger.tail + 1)
+            ret = poll(&pfd, 1, has_summaries() ? LOG_SUMMARY_INTERVAL_MS : -1);
+        atomic_store(&logger.waiting, 0);
+
+        uint64_t count;
+        if (ret > 0 && read(logger.fd_event, &count, sizeof(count)) < 0)
+            continue;
+
+        drain_ring();
+        flush_summaries(now_us(), 0);
+    }
+    return NULL;
+}
+
+/**
+ * Opens the log and starts the thread writing the messages, so that
+ * logging never blocks the callers. Messages are written synchronously
+ * before, and if the thread cannot start.
+ *
+ * @param syslog Whether to log to the journal (or syslog) instead of stderr.
+ * @param ident Identifier of the messages.
+ */
 void open_log(int syslog, const char* ident)
 {
-    dosyslog = syslog;
+    logger.dosyslog = syslog;
+    logger.ident = ident;
 
-    if (dosyslog)
+    if (logger.dosyslog)
         openlog(ident, LOG_PID, LOG_DAEMON);
+#if defined(HAVE_SYSTEMD_BUS) && !defined(_DEBUG)
+    logger.journal = logger.dosyslog && sd_booted() > 0;
+#endif
+
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        atomic_init(&logger.ring[i].sequence, i);
+    }
+    logger.last.priority = -1;
+    logger.last_us = now_us();
+
+    logger.fd_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (logger.fd_event < 0) {
+        logerror("Unable to create log eventfd, logging synchronously\n");
+        return;
+    }
+
+    // Signals are handled by the main thread only
+    sigset_t all_signals, old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    int ret = pthread_create(&logger.thread, NULL, log_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (ret != 0) {
+        close(logger.fd_event);
+        logerror("Unable to start log thread, logging synchronously\n");
+        return;
+    }
+
+    atomic_store(&logger.running, 1);
 }
 
+/**
+ * Stops the log thread after it has written the pending messages, and
+ * closes the log.
+ */
 void close_log(void)
 {
-    if (dosyslog)
+    if (atomic_load(&logger.running)) {
+        atomic_store(&logger.running, 0);
+        atomic_store(&logger.stop, 1);
+
+        uint64_t one = 1;
+        if (write(logger.fd_event, &one, sizeof(one)) < 0) {
+            // Counter full: the thread has a wakeup pending anyway
+        }
+        pthread_join(logger.thread, NULL);
+        close(logger.fd_event);
+
+        // Published while the thread was stopping
+        drain_ring();
+        flush_summaries(now_us(), 1);
+    }
+
+    if (logger.dosyslog)
         closelog();
 }
 
+/**
+ * Queues a message for the log thread. Never blocks: when the ring is
+ * full the message is dropped and counted.
+ */
+static void vlog(int priority, const log_fields_t *fields, const char *format, va_list ap)
+{
+    if (!atomic_load_explicit(&logger.running, memory_order_acquire)) {
+        struct log_message message;
+        format_message(&message, priority, fields, format, ap);
+        write_message(&message);
+        return;
+    }
+
+    struct log_entry *entry;
+    uint32_t pos = atomic_load_explicit(&logger.head, memory_order_relaxed);
+    for (;;) {
+        entry = &logger.ring[pos & (LOG_RING_SIZE - 1)];
+        int32_t diff = (int32_t)(atomic_load_explicit(&entry->sequence, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger.head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&logger.head, memory_order_relaxed);
+        }
+    }
+
+    format_message(&entry->message, priority, fields, format, ap);
+    atomic_store_explicit(&entry->sequence, pos + 1, memory_order_release);
+
+    // Only wake the thread if it sleeps, an awake one drains the ring anyway
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&logger.waiting, 0)) {
+        uint64_t one = 1;
+        if (write(logger.fd_event, &one, sizeof(one)) < 0) {
+            // Counter full: the thread has a wakeup pending anyway
+        }
+    }
+}
 
 void loginfo(const char *format, ...)
 {
     va_list ap;
     va_start(ap, format);
-
-#ifndef _DEBUG
-    if (dosyslog)
-        vsyslog(LOG_INFO, format, ap);
-    else
-#endif
-        vfprintf(stderr, format, ap);
-
+    vlog(LOG_INFO, NULL, format, ap);
     va_end(ap);
 }
 
@@ -40,13 +470,21 @@ void logerror(const char *format, ...)
 {
     va_list ap;
     va_start(ap, format);
+    vlog(LOG_ERR, NULL, format, ap);
+    va_end(ap);
+}
 
-#ifndef _DEBUG
-    if (dosyslog)
-        vsyslog(LOG_ERR, format, ap);
-    else
-#endif
-        vfprintf(stderr, format, ap);
-
+/**
+ * Logs an error with structured fields, e.g. the device and the command of
+ * a failed HID transaction, so that the journal can be filtered on them.
+ *
+ * @param fields The fields of the message.
+ * @param format printf-like format of the message.
+ */
+void logerror_fields(const log_fields_t *fields, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vlog(LOG_ERR, fields, format, ap);
     va_end(ap);
 }
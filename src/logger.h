@@ -1,9 +1,18 @@
 #ifndef _LOGGER__H
 #define _LOGGER__H
 
+/** Structured fields of a message, written as journal fields */
+struct log_fields {
+    const char *device;     // NULL if none
+    const char *command;    // NULL if none
+    int error;              // errno value, 0 if none
+};
+typedef struct log_fields log_fields_t;
+
 void open_log(int syslog, const char* ident);
 void close_log(void);
-void loginfo(const char *format, ...);
-void logerror(const char *format, ...);
+void loginfo(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void logerror(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void logerror_fields(const log_fields_t *fields, const char *format, ...) __attribute__((format(printf, 2, 3)));
 
 #endif // _LOGGER__H
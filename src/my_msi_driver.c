@@ -1,6 +1,22 @@
 #include "coreliquid_s.h"
 #include "coreliquid.h"
+#include "daemon_config.h"
+#include "fan_curve.h"
+#include "fan_pid.h"
 #include "sensors_wrap.h"
+#include "sensors_sampler.h"
+#include "signal_filter.h"
+#include "event_loop.h"
+#include "task_scheduler.h"
+#include "rt_mode.h"
+#include "eco_mode.h"
+#include "telemetry_history.h"
+#include "telemetry_shm.h"
+#include "telemetry_stream.h"
+#include "telemetry_log.h"
+#include "coreliquid_stream.h"
+#include "coreliquid_hid.h"
+#include "openmetrics.h"
 #include "logger.h"
 
 #ifdef HAVE_SYSTEMD_BUS
@@ -9,124 +25,596 @@
 #define dbus_device void
 #endif
 
+#ifdef HAVE_FUSE
+#include "fuse_hwmon.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 // ============================================================================
 // Constants and Configuration
 // ============================================================================
 
-/** Polling interval in microseconds (1 second) */
-#define POLL_INTERVAL_US          (1000000L)
+/** Device status is rewritten at least every N runs even if unchanged */
+#define REFRESH_SAMPLES           (10)
 
-/** Short delay between device operations in microseconds (10ms) */
-#define OPERATION_DELAY_US        (10000L)
+/** Consecutive failed cooler status reads reported as a device error */
+#define HEALTH_FAILED_READS       (3)
 
 /** Application identifier for logging */
 #define APP_IDENTIFIER           "MSI_Coreliquid_S360"
 
 
-// Flags to stop and suspend the daemon
-static volatile sig_atomic_t is_stop = 0;
-static volatile sig_atomic_t is_suspend = 0;
+/** Settings of the daemon: defaults, then the -c file, then the command line.
+ *  Replaced as a whole on SIGHUP */
+static daemon_config_t config;
+
+/** Default filter chain applied to the CPU frequency (MHz) */
+static const filter_config_t freq_filter_config = {
+    .median_len = 1,
+    .ema_alpha = 1.0f,
+    .deadband = 100,
+};
+
+/** Real-time mode, enabled with -S */
+static rt_config_t rt_config = {
+    .priority = 0,
+    .cpu = -1,
+};
+
+/** Eco mode, enabled with -E */
+static eco_config_t eco_config = {
+    .align_us = 0,
+};
+
+/** Command line, re-applied over the configuration file on every reload */
+static struct {
+    int argc;
+    char **argv;
+
+    // Startup only, not reloaded
+    const char *config_file;
+    const char *curve_file;
+    const char *sensors_root;
+    const char *bus_address;
+    const char *stream_path;
+    const char *metrics_address;
+    telemetry_log_config_t log;
+    const char *hwmon_path;
+} options = { .stream_path = CORELIQUID_STREAM_PATH };
+
+/** Settings changed over D-Bus, which a reload keeps */
+static struct {
+    int fan_mode;               // -1 if not set
+    int brightness;             // -1 if not set
+    uint32_t display_features;  // 0 if not set
+    int display_style;
+} overrides = { .fan_mode = -1, .brightness = -1 };
+
+/** Device writes skipped because the conditioned values did not change */
+static struct {
+    uint32_t oled_writes;
+    uint32_t oled_suppressed;
+    uint32_t lcd_writes;
+    uint32_t lcd_suppressed;
+    uint32_t fan_writes;
+} write_stats;
+
+/** State of the monitoring loop */
+static struct {
+    coreliquid_device* handle_s;
+    coreliquid_device* handle_cl;
+    dbus_device* handle_dbus;
+
+    int fd_timer;
+    int fd_signal;
+    int is_suspend;
+
+    task_scheduler_t scheduler;
+    uint64_t timer_deadline_us;
+    jitter_histogram_t jitter;
+    footprint_t footprint;
+
+    sensors_snapshot_t snapshot;
+    uint64_t last_sample_nr;
+    int oled_refresh;
+    signal_filter_t temp_filter;
+    signal_filter_t freq_filter;
+
+    const fan_curves_t* host_curves;
+    fan_pid_t pid;
+    int pid_enabled;
+    uint8_t fan_duty[FAN_CHANNELS];
+
+    sensors_values_t display_sent;
+    int lcd_refresh;
+
+    cooler_status_t cooler_status;
+    int cooler_status_valid;
+    int cooler_failures;        // consecutive failed reads
+    uint64_t cooler_read_errors;
+
+    telemetry_t telemetry;
+    uint32_t telemetry_read;    // bit mask of the metrics read at least once
+} monitor = { .fd_timer = -1, .fd_signal = -1 };
 
 /**
- * Monitor the CPU temperature and send it to the AIO.
+ * Sets the duty cycles of the fans if they changed.
+ */
+void push_fan_duty(const uint8_t duty[FAN_CHANNELS])
+{
+    if (memcmp(duty, monitor.fan_duty, FAN_CHANNELS)) {
+        set_fan_duty(monitor.handle_cl, duty);
+        memcpy(monitor.fan_duty, duty, FAN_CHANNELS);
+        write_stats.fan_writes++;
+    }
+}
+
+/**
+ * Feeds the closed-loop controller with a new measurement and applies its
+ * output to all fans. The pump keeps its minimum duty cycle.
+ */
+void run_fan_pid(float measured)
+{
+    const sensors_values_t *data = &monitor.snapshot.values;
+    uint8_t duty[FAN_CHANNELS];
+
+    int output = fan_pid_update(&monitor.pid, measured, data->cpu_usage, data->cpu_power, monotonic_us());
+
+    memset(duty, output, sizeof(duty));
+    if (duty[FAN_CHANNEL_PUMP] < FAN_CURVE_PUMP_MIN_DUTY)
+        duty[FAN_CHANNEL_PUMP] = FAN_CURVE_PUMP_MIN_DUTY;
+
+    push_fan_duty(duty);
+}
+
+/**
+ * Records the latest telemetry in the history, the on-disk log, the
+ * shared-memory segment and the hwmon filesystem, pushes it to the stream
+ * subscribers, then publishes it on D-Bus within the deadbands and rate
+ * limit of the configuration. The log records hold all the metrics, so
+ * they start once each metric was read.
  *
- * \param handle handle on the AIO device
+ * \param first first metric updated
+ * \param last last metric updated
  */
-void monitor_cpu_temperature(
-    coreliquid_device* handle_s,
-    coreliquid_device* handle_cl,
-    __attribute__((unused)) dbus_device* handle_dbus)
+void publish_telemetry(int first, int last)
 {
-    sensors_values_t data = {0};
+    uint64_t now_s = history_time_s();
+    uint64_t now_us = monotonic_us();
+
+    for (int metric = first; metric <= last; metric++) {
+        record_history(metric, monitor.telemetry.values[metric], now_s);
+    }
+
+    monitor.telemetry_read |= ((2U << last) - 1) & ~((1U << first) - 1);
+    if (monitor.telemetry_read == (1U << METRIC_COUNT) - 1)
+        append_telemetry_log(&monitor.telemetry);
+    publish_telemetry_shm(&monitor.telemetry, now_us);
+    publish_telemetry_stream(&monitor.telemetry, first, last, now_us);
+#ifdef HAVE_FUSE
+    update_fuse_hwmon(&monitor.telemetry, monitor.fan_duty, monitor.cooler_status_valid);
+#endif
+
 #ifdef HAVE_SYSTEMD_BUS
-    dbus_cooler_stats_t dbus_stats = {0};
-    cooler_status_t cooler_status = {0};
+    update_telemetry(monitor.handle_dbus, &monitor.telemetry, now_us);
 #endif
+}
 
-    // Listen to temperature in an infinite loop
-    while (!is_stop) {
-        if (is_suspend) {
-            loginfo("Suspended, waiting ...\n");
-            pause();
-            loginfo("Waked up ...\n");
-        }
+/**
+ * Temperature task: conditions the latest sample and sends it to the AIO,
+ * which picks the fan speed from it (or sets the fan speed itself when the
+ * curves are host-driven).
+ */
+void push_oled_status(__attribute__((unused)) void *userdata)
+{
+    const sensors_values_t *data = &monitor.snapshot.values;
 
-        fetch_sensor_values(&data);
+    // In eco mode the sensors are read in the same wakeup as the HID writes
+    if (eco_config.align_us > 0)
+        sample_sensors_once();
 
-        if (data.cpu_temp > 0 && data.cpu_freq > 0) {
-            set_oled_cpu_status(handle_cl, data.cpu_temp, data.cpu_freq);
-            usleep(OPERATION_DELAY_US);
-            send_cpu_info(handle_s, data.cpu_temp, data.cpu_freq);
-            usleep(OPERATION_DELAY_US);
+    // Latest sample, never blocks on sysfs
+    if (!read_sensors_snapshot(&monitor.snapshot) || monitor.snapshot.sample_nr == monitor.last_sample_nr
+            || data->cpu_temp <= 0 || (data->cpu_freq <= 0 && (config.sensors & SENSOR_CPU_FREQ))) {
+        return;
+    }
+    monitor.last_sample_nr = monitor.snapshot.sample_nr;
+
+    // Condition the values so that sensor jitter neither makes the
+    // fans hunt nor turns into USB writes
+    int changed = filter_sample(&monitor.temp_filter, data->cpu_temp);
+    changed |= filter_sample(&monitor.freq_filter, data->cpu_freq);
+
+    monitor.oled_refresh = (monitor.oled_refresh + 1) % REFRESH_SAMPLES;
+
+    if (changed || monitor.oled_refresh == 0) {
+        set_oled_cpu_status(monitor.handle_cl, monitor.temp_filter.output, monitor.freq_filter.output);
+        write_stats.oled_writes++;
+    } else {
+        write_stats.oled_suppressed++;
+    }
+
+    if (monitor.pid_enabled && monitor.pid.config.source == PID_SOURCE_CPU) {
+        run_fan_pid(monitor.temp_filter.output);
+    } else if (monitor.host_curves) {
+        uint8_t duty[FAN_CHANNELS];
+        fan_curve_duty(monitor.host_curves, monitor.temp_filter.output, duty);
+        push_fan_duty(duty);
+    }
+
+    uint16_t *values = monitor.telemetry.values;
+    values[METRIC_CPU_TEMP] = (uint16_t) monitor.temp_filter.output;
+    values[METRIC_CPU_FREQ] = (uint16_t) monitor.freq_filter.output;
+    values[METRIC_CPU_USAGE] = (uint16_t) data->cpu_usage;
+    values[METRIC_GPU_TEMP] = (uint16_t) data->gpu_temp;
+    values[METRIC_GPU_FREQ] = (uint16_t) data->gpu_freq;
+    values[METRIC_GPU_USAGE] = (uint16_t) data->gpu_usage;
+    publish_telemetry(METRIC_CPU_TEMP, METRIC_GPU_USAGE);
+}
 
+/**
+ * Display task: sends the host readings to the LCD.
+ */
+void push_lcd_info(__attribute__((unused)) void *userdata)
+{
+    sensors_values_t display = monitor.snapshot.values;
+
+    if (!monitor.temp_filter.primed)
+        return;
+
+    display.cpu_temp = monitor.temp_filter.output;
+    display.cpu_freq = monitor.freq_filter.output;
+
+    monitor.lcd_refresh = (monitor.lcd_refresh + 1) % REFRESH_SAMPLES;
+
+    if (hw_info_changed(&monitor.display_sent, &display) || monitor.lcd_refresh == 0) {
+        send_hw_info(monitor.handle_s, &display);
+        monitor.display_sent = display;
+        write_stats.lcd_writes++;
+    } else {
+        write_stats.lcd_suppressed++;
+    }
+}
+
+/**
+ * Publishes the active mode and the health of the daemon on D-Bus, which
+ * signals only what changed.
+ */
+void publish_state(void)
+{
 #ifdef HAVE_SYSTEMD_BUS
-            if (get_cooler_status(handle_cl, &cooler_status) > 0) {
-                dbus_stats.fan_radiator_speed = cooler_status.fan_radiator_speed;
-                dbus_stats.fan_water_block_speed = cooler_status.fan_water_block_speed;
-                dbus_stats.pump_speed = cooler_status.pump_speed;
-                dbus_stats.liquid_temperature = cooler_status.liquid_temperature;
+    dbus_health_t health = DBUS_HEALTH_OK;
 
-                update_aio_status(handle_dbus, &dbus_stats);
-            }
+    if (monitor.is_suspend) {
+        health = DBUS_HEALTH_SUSPENDED;
+    } else if (monitor.cooler_failures >= HEALTH_FAILED_READS) {
+        health = DBUS_HEALTH_DEVICE_ERROR;
+    }
+
+    update_daemon_state(monitor.handle_dbus, config.fan_mode, health);
 #endif
+}
+
+/**
+ * Writes the metrics of a scrape: readings, cooler status, HID latencies
+ * and errors, task run times and device write counters. Runs on the event
+ * loop, from the cached values only.
+ */
+void render_metrics(metrics_writer_t* writer, __attribute__((unused)) void *userdata)
+{
+    static const char* const fan_labels[] = { "fan=\"radiator\"", "fan=\"water_block\"", "fan=\"pump\"" };
+    const sensors_values_t *data = &monitor.snapshot.values;
+    const cooler_status_t *cooler = &monitor.cooler_status;
+    const hid_stats_t *hid = get_hid_stats();
+    char labels[64];
+
+    metrics_family(writer, "coreliquid_cpu_temperature_celsius", "gauge", "celsius", "CPU temperature, conditioned");
+    metrics_int(writer, "coreliquid_cpu_temperature_celsius", NULL, monitor.temp_filter.output);
+    metrics_family(writer, "coreliquid_cpu_frequency_hertz", "gauge", "hertz", "CPU frequency, conditioned");
+    metrics_int(writer, "coreliquid_cpu_frequency_hertz", NULL, monitor.freq_filter.output * 1000000LL);
+    metrics_family(writer, "coreliquid_cpu_usage_percent", "gauge", "percent", "CPU usage");
+    metrics_int(writer, "coreliquid_cpu_usage_percent", NULL, data->cpu_usage);
+    metrics_family(writer, "coreliquid_cpu_power_watts", "gauge", "watts", "CPU package power");
+    metrics_int(writer, "coreliquid_cpu_power_watts", NULL, data->cpu_power);
+    metrics_family(writer, "coreliquid_cpu_pressure_percent", "gauge", "percent", "CPU pressure stall, avg10");
+    metrics_int(writer, "coreliquid_cpu_pressure_percent", NULL, data->cpu_pressure);
+    metrics_family(writer, "coreliquid_gpu_temperature_celsius", "gauge", "celsius", "GPU temperature");
+    metrics_int(writer, "coreliquid_gpu_temperature_celsius", NULL, data->gpu_temp);
+    metrics_family(writer, "coreliquid_gpu_frequency_hertz", "gauge", "hertz", "GPU frequency");
+    metrics_int(writer, "coreliquid_gpu_frequency_hertz", NULL, data->gpu_freq * 1000000LL);
+    metrics_family(writer, "coreliquid_gpu_usage_percent", "gauge", "percent", "GPU usage");
+    metrics_int(writer, "coreliquid_gpu_usage_percent", NULL, data->gpu_usage);
+
+    metrics_family(writer, "coreliquid_cooler_status_valid", "gauge", NULL, "1 if the last cooler status read succeeded");
+    metrics_int(writer, "coreliquid_cooler_status_valid", NULL, monitor.cooler_status_valid);
+    metrics_family(writer, "coreliquid_fan_speed_rpm", "gauge", "rpm", "Fan and pump speeds reported by the AIO");
+    metrics_int(writer, "coreliquid_fan_speed_rpm", fan_labels[0], cooler->fan_radiator_speed);
+    metrics_int(writer, "coreliquid_fan_speed_rpm", fan_labels[1], cooler->fan_water_block_speed);
+    metrics_int(writer, "coreliquid_fan_speed_rpm", fan_labels[2], cooler->pump_speed);
+    metrics_family(writer, "coreliquid_liquid_temperature_celsius", "gauge", "celsius", "Liquid temperature reported by the AIO");
+    metrics_int(writer, "coreliquid_liquid_temperature_celsius", NULL, cooler->liquid_temperature);
+    metrics_family(writer, "coreliquid_cooler_read_errors", "counter", NULL, "Failed cooler status reads");
+    metrics_int(writer, "coreliquid_cooler_read_errors_total", NULL, (int64_t)monitor.cooler_read_errors);
+    metrics_family(writer, "coreliquid_suspended", "gauge", NULL, "1 while the system is suspended");
+    metrics_int(writer, "coreliquid_suspended", NULL, monitor.is_suspend);
+
+    metrics_family(writer, "coreliquid_hid_latency_seconds", "histogram", "seconds", "Duration of the HID transactions, retries included");
+    for (int op = 0; op < HID_OP_COUNT; op++) {
+        snprintf(labels, sizeof(labels), "op=\"%s\"", hid_op_names[op]);
+        metrics_histogram(writer, "coreliquid_hid_latency_seconds", labels, &hid->latency[op]);
+    }
+    metrics_family(writer, "coreliquid_hid_retries", "counter", NULL, "HID transactions retried");
+    for (int op = 0; op < HID_OP_COUNT; op++) {
+        snprintf(labels, sizeof(labels), "op=\"%s\"", hid_op_names[op]);
+        metrics_int(writer, "coreliquid_hid_retries_total", labels, (int64_t)hid->retries[op]);
+    }
+    metrics_family(writer, "coreliquid_hid_errors", "counter", NULL, "HID transactions failed");
+    for (int op = 0; op < HID_OP_COUNT; op++) {
+        snprintf(labels, sizeof(labels), "op=\"%s\"", hid_op_names[op]);
+        metrics_int(writer, "coreliquid_hid_errors_total", labels, (int64_t)hid->errors[op]);
+    }
+
+    metrics_family(writer, "coreliquid_task_duration_seconds", "histogram", "seconds", "Run time of the periodic tasks");
+    for (int i = 0; i < monitor.scheduler.count; i++) {
+        snprintf(labels, sizeof(labels), "task=\"%s\"", monitor.scheduler.tasks[i].name);
+        metrics_histogram(writer, "coreliquid_task_duration_seconds", labels, &monitor.scheduler.tasks[i].run_time);
+    }
+    metrics_family(writer, "coreliquid_task_missed", "counter", NULL, "Task periods skipped because a run started too late");
+    for (int i = 0; i < monitor.scheduler.count; i++) {
+        snprintf(labels, sizeof(labels), "task=\"%s\"", monitor.scheduler.tasks[i].name);
+        metrics_int(writer, "coreliquid_task_missed_total", labels, (int64_t)monitor.scheduler.tasks[i].missed);
+    }
+    metrics_family(writer, "coreliquid_wakeup_latency_seconds", "histogram", "seconds", "Delay between a task deadline and the wakeup");
+    metrics_histogram(writer, "coreliquid_wakeup_latency_seconds", NULL, &monitor.jitter);
+
+    footprint_stats_t footprint;
+    if (read_footprint(&monitor.footprint, &footprint)) {
+        metrics_family(writer, "coreliquid_wakeups_per_second", "gauge", NULL, "Voluntary context switches of the daemon per second, since startup");
+        metrics_float(writer, "coreliquid_wakeups_per_second", NULL, footprint.wakeups_per_s);
+        metrics_family(writer, "coreliquid_cpu_seconds_per_hour", "gauge", NULL, "CPU time of the daemon per hour, since startup");
+        metrics_float(writer, "coreliquid_cpu_seconds_per_hour", NULL, footprint.cpu_s_per_hour);
+    }
+
+    // Adaptive sampling, not in eco mode
+    if (monitor.snapshot.interval_us > 0) {
+        metrics_family(writer, "coreliquid_sampling_interval_seconds", "gauge", "seconds", "Current interval of the sensor sampling");
+        metrics_float(writer, "coreliquid_sampling_interval_seconds", NULL, monitor.snapshot.interval_us / 1e6);
+        metrics_family(writer, "coreliquid_sampling_interval_time_seconds", "counter", "seconds", "Time spent sampling at intervals up to the given one");
+        // Cumulative like histogram buckets: +Inf is the whole sampling time
+        long bound = RATE_BUCKET_BASE_US;
+        uint64_t cumulative_us = 0;
+        for (int i = 0; i < RATE_BUCKETS; i++, bound *= 2) {
+            if (i < RATE_BUCKETS - 1)
+                snprintf(labels, sizeof(labels), "interval=\"%g\"", bound / 1e6);
+            else
+                snprintf(labels, sizeof(labels), "interval=\"+Inf\"");
+            cumulative_us += monitor.snapshot.time_at_rate_us[i];
+            metrics_float(writer, "coreliquid_sampling_interval_time_seconds_total", labels, cumulative_us / 1e6);
         }
+    }
+
+    metrics_family(writer, "coreliquid_device_writes", "counter", NULL, "Status writes sent to the devices");
+    metrics_int(writer, "coreliquid_device_writes_total", "target=\"oled\"", write_stats.oled_writes);
+    metrics_int(writer, "coreliquid_device_writes_total", "target=\"lcd\"", write_stats.lcd_writes);
+    metrics_int(writer, "coreliquid_device_writes_total", "target=\"fan_duty\"", write_stats.fan_writes);
+    metrics_family(writer, "coreliquid_device_writes_suppressed", "counter", NULL, "Status writes skipped because the values did not change");
+    metrics_int(writer, "coreliquid_device_writes_suppressed_total", "target=\"oled\"", write_stats.oled_suppressed);
+    metrics_int(writer, "coreliquid_device_writes_suppressed_total", "target=\"lcd\"", write_stats.lcd_suppressed);
+
+    if (monitor.pid_enabled) {
+        const pid_metrics_t *pid = &monitor.pid.metrics;
+        metrics_family(writer, "coreliquid_pid_output_percent", "gauge", "percent", "Fan duty set by the PID controller");
+        metrics_float(writer, "coreliquid_pid_output_percent", NULL, monitor.pid.output);
+        metrics_family(writer, "coreliquid_pid_steps", "counter", NULL, "Disturbances and target changes seen by the PID controller");
+        metrics_int(writer, "coreliquid_pid_steps_total", NULL, pid->steps);
+        metrics_family(writer, "coreliquid_pid_steps_settled", "counter", NULL, "Steps that settled within the band");
+        metrics_int(writer, "coreliquid_pid_steps_settled_total", NULL, pid->settled);
+        metrics_family(writer, "coreliquid_pid_settling_time_seconds", "gauge", "seconds", "Settling time of the last and of the slowest step");
+        metrics_float(writer, "coreliquid_pid_settling_time_seconds", "step=\"last\"", pid->settling_time_us / 1e6);
+        metrics_float(writer, "coreliquid_pid_settling_time_seconds", "step=\"max\"", pid->max_settling_time_us / 1e6);
+        metrics_family(writer, "coreliquid_pid_overshoot_celsius", "gauge", "celsius", "Overshoot past the target of the last and of the largest step");
+        metrics_float(writer, "coreliquid_pid_overshoot_celsius", "step=\"last\"", pid->overshoot);
+        metrics_float(writer, "coreliquid_pid_overshoot_celsius", "step=\"max\"", pid->max_overshoot);
+    }
+}
+
+/**
+ * Cooler task: reads the fan, pump and liquid status from the AIO.
+ */
+void read_cooler_status(__attribute__((unused)) void *userdata)
+{
+    monitor.cooler_status_valid = get_cooler_status(monitor.handle_cl, &monitor.cooler_status) > 0;
+    monitor.cooler_failures = monitor.cooler_status_valid ? 0 : monitor.cooler_failures + 1;
+    monitor.cooler_read_errors += !monitor.cooler_status_valid;
+    publish_state();
+
+    if (!monitor.cooler_status_valid)
+        return;
+
+    if (monitor.pid_enabled && monitor.pid.config.source == PID_SOURCE_LIQUID)
+        run_fan_pid(monitor.cooler_status.liquid_temperature);
+
+    uint16_t *values = monitor.telemetry.values;
+    values[METRIC_FAN_RADIATOR] = monitor.cooler_status.fan_radiator_speed;
+    values[METRIC_FAN_WATER_BLOCK] = monitor.cooler_status.fan_water_block_speed;
+    values[METRIC_PUMP] = monitor.cooler_status.pump_speed;
+    values[METRIC_LIQUID_TEMP] = monitor.cooler_status.liquid_temperature;
+    publish_telemetry(METRIC_FAN_RADIATOR, METRIC_LIQUID_TEMP);
+}
+
+/**
+ * D-Bus task: emits the telemetry changes held back by the rate limit.
+ */
+void emit_telemetry(__attribute__((unused)) void *userdata)
+{
+#ifdef HAVE_SYSTEMD_BUS
+    flush_telemetry(monitor.handle_dbus, monotonic_us());
+#endif
+}
+
+/**
+ * Runs the due tasks and arms the timer at the next deadline.
+ */
+void run_scheduler(void)
+{
+    monitor.timer_deadline_us = scheduler_run_due(&monitor.scheduler, monotonic_us());
+    set_timer_deadline(monitor.fd_timer, monitor.timer_deadline_us);
+}
+
+/**
+ * Timer handler: records the wakeup latency and runs the tasks whose
+ * deadline has come.
+ */
+void on_timer(int fd, __attribute__((unused)) uint32_t events, __attribute__((unused)) void *userdata)
+{
+    if (read_timer(fd) == 0)
+        return;
+
+    uint64_t now_us = monotonic_us();
+    if (monitor.timer_deadline_us && now_us > monitor.timer_deadline_us)
+        record_jitter(&monitor.jitter, now_us - monitor.timer_deadline_us);
 
-        // Wait 1s
-        usleep(POLL_INTERVAL_US);
+    run_scheduler();
+}
+
+/**
+ * Sampler handler: runs the temperature task as soon as a new sample is
+ * published. The sampler tightens its interval while readings change
+ * quickly or on a CPU pressure step, so a load burst is pushed to the AIO
+ * before the temperature catches up.
+ */
+void on_sampler_event(
+    __attribute__((unused)) int fd,
+    __attribute__((unused)) uint32_t events,
+    __attribute__((unused)) void *userdata)
+{
+    if (clear_sampler_event() && !monitor.is_suspend) {
+        scheduler_run_now(&monitor.scheduler, &monitor.scheduler.tasks[TASK_TEMPERATURE], monotonic_us());
     }
 }
 
 /**
- * Signal handler to stop the daemon.
- * Can take up to 2s to stop (sleeping time between temperature reads).
+ * Sends the device configuration (fan mode or curves, LCD settings).
+ *
+ * \param handle_cl handle on the AIO device
+ * \param handle_s handle on the LCD device
  */
-void stopit(__attribute__((unused)) int sig)
+void apply_device_config(coreliquid_device* handle_cl, coreliquid_device* handle_s)
 {
-    is_stop = 1;
+    if (config.fan_mode == FAN_MODE_CUSTOM) {
+        set_fan_curves(handle_cl, config.fan_curves.points);
+    } else {
+        set_fan_mode(handle_cl, config.fan_mode);
+    }
+
+    set_lcm_back_light(handle_s, config.brightness);
+    set_lcm_direction(handle_s, config.direction);
+    set_temperature_unit(handle_s, config.temperature_unit);
+    set_display_mode(handle_s, config.display_features, config.display_style);
 }
 
 /**
- * Signal handler to suspend the daemon.
- * Can take up to 2s to suspend (sleeping time between temperature reads).
+ * Selects who drives the fans in custom mode: the AIO following the curves
+ * sent to it, the host evaluating the curves, or the closed-loop controller.
+ *
+ * \param old previous configuration, NULL at startup
  */
-void suspendit(__attribute__((unused)) int sig)
+void update_fan_control(const daemon_config_t* old)
 {
-    is_suspend = 1;
+    int custom = config.fan_mode == FAN_MODE_CUSTOM;
+    int pid_enabled = custom && config.pid.target > 0;
+
+    // The controller owns the fan duty: curves evaluated on the host would overwrite its output
+    monitor.host_curves = custom && config.fan_curves.host_driven && !pid_enabled ? &config.fan_curves : NULL;
+    if (pid_enabled && config.fan_curves.host_driven && (!old || !monitor.pid_enabled))
+        loginfo("Fan PID enabled, host-driven curves are not evaluated\n");
+
+    if (pid_enabled) {
+        pid_config_t retargeted = old ? old->pid : config.pid;
+        retargeted.target = config.pid.target;
+
+        // A new target alone keeps the controller state, so the fans do not jump
+        if (monitor.pid_enabled && !memcmp(&retargeted, &config.pid, sizeof(retargeted))) {
+            fan_pid_set_target(&monitor.pid, config.pid.target, monotonic_us());
+        } else {
+            init_fan_pid(&monitor.pid, &config.pid);
+        }
+    }
+    monitor.pid_enabled = pid_enabled;
 }
 
 /**
- * Signal handler to resume the daemon.
+ * Stops all device traffic, e.g. before the system sleeps.
  */
-void resumeit(__attribute__((unused)) int sig)
+void suspend_monitor(void)
 {
-    is_suspend = 0;
+    if (monitor.is_suspend)
+        return;
+
+    loginfo("Suspended, waiting ...\n");
+    monitor.is_suspend = 1;
+    set_timer_deadline(monitor.fd_timer, 0);
+    publish_state();
 }
 
 /**
- * Main program
+ * Replays the device configuration, which the devices lose while powered
+ * down, then pushes the current readings and restarts the schedule.
  */
-int main(int argc, char *argv[])
+void resume_monitor(void)
+{
+    if (!monitor.is_suspend)
+        return;
+
+    uint64_t start_us = monotonic_us();
+    monitor.is_suspend = 0;
+
+    apply_device_config(monitor.handle_cl, monitor.handle_s);
+
+    // Force the status writes, the cached values no longer match the devices
+    monitor.last_sample_nr = 0;
+    monitor.oled_refresh = REFRESH_SAMPLES - 1;
+    monitor.lcd_refresh = REFRESH_SAMPLES - 1;
+    memset(monitor.fan_duty, 0xff, sizeof(monitor.fan_duty));
+
+    scheduler_run_now(&monitor.scheduler, &monitor.scheduler.tasks[TASK_TEMPERATURE], monotonic_us());
+    scheduler_run_now(&monitor.scheduler, &monitor.scheduler.tasks[TASK_DISPLAY], monotonic_us());
+
+    loginfo("Waked up, devices restored in %llu ms\n", (unsigned long long)((monotonic_us() - start_us) / 1000));
+    publish_state();
+
+    scheduler_start(&monitor.scheduler, monotonic_us());
+    run_scheduler();
+}
+
+/**
+ * Parses the command line. Startup-only options are stored in options,
+ * the other ones update the configuration.
+ *
+ * \param config the configuration to update
+ */
+void parse_options(int argc, char *argv[], daemon_config_t* config)
 {
-    int exit_status = EXIT_SUCCESS;
-    int fan_mode = FAN_MODE_SMART;
-    int start_daemon = 0;
     int opt;
 
-     while ((opt = getopt(argc, argv, "M:")) != -1) {
+    while ((opt = getopt(argc, argv, "M:R:F:I:T:C:P:S:E:B:U:O:L:H:c:")) != -1) {
         switch (opt) {
             case 'M':
-                fan_mode = atoi(optarg);
-                if ((fan_mode < 0) || (fan_mode > 5) || (fan_mode == 3)) {
+                config->fan_mode = atoi(optarg);
+                if ((config->fan_mode < 0) || (config->fan_mode > 5)) {
                     printf("Allowed modes:\n");
                     printf("0 : silent\n");
                     printf("1 : balance\n"),
                     printf("2 : game\n");
+                    printf("3 : custom (curves from -C)\n");
                     printf("4 : default (constant)\n");
                     printf("5 : smart\n");
 
@@ -134,6 +622,91 @@ int main(int argc, char *argv[])
                 }
                 break;
 
+            case 'R':
+                options.sensors_root = optarg;
+                break;
+
+            case 'F':
+                if (!parse_filter_config(optarg, &config->temp_filter)) {
+                    fprintf(stderr, "Invalid filter: %s\n", optarg);
+                    printf("Filter keys: median=1..%d, ema=(0,1], deadband=N, rise=N, fall=N\n", FILTER_MEDIAN_MAX);
+                    exit(0);
+                }
+                break;
+
+            case 'I':
+                if (!parse_adaptive_rate_config(optarg, &config->rate)) {
+                    fprintf(stderr, "Invalid sampling interval: %s\n", optarg);
+                    printf("Sampling interval: floor_ms:ceiling_ms (e.g. 100:5000)\n");
+                    exit(0);
+                }
+                break;
+
+            case 'B':
+                options.bus_address = optarg;
+                break;
+
+            case 'U':
+                options.stream_path = strcmp(optarg, "off") ? optarg : NULL;
+                break;
+
+            case 'O':
+                options.metrics_address = strcmp(optarg, "off") ? optarg : NULL;
+                break;
+
+            case 'L':
+                if (!parse_telemetry_log_config(optarg, &options.log)) {
+                    fprintf(stderr, "Invalid telemetry log: %s\n", optarg);
+                    printf("Telemetry log: path[:cap_mb] (default cap %d MB)\n", TELEMETRY_LOG_DEFAULT_CAP_MB);
+                    exit(0);
+                }
+                break;
+
+            case 'H':
+                options.hwmon_path = optarg;
+                break;
+
+            case 'c':
+                options.config_file = optarg;
+                break;
+
+            case 'C':
+                options.curve_file = optarg;
+                break;
+
+            case 'P':
+                if (!parse_pid_config(optarg, &config->pid) || config->pid.target == 0) {
+                    fprintf(stderr, "Invalid controller: %s\n", optarg);
+                    printf("Controller keys: target=20..95, source=liquid|cpu, kp, ki, kd, min, max, step, load, power, band, hold\n");
+                    exit(0);
+                }
+                break;
+
+            case 'S':
+                if (!parse_rt_config(optarg, &rt_config)) {
+                    fprintf(stderr, "Invalid real-time mode: %s\n", optarg);
+                    printf("Real-time mode: priority[:cpu] (priority 1-99)\n");
+                    exit(0);
+                }
+                break;
+
+            case 'E':
+                if (!parse_eco_config(optarg, &eco_config)) {
+                    fprintf(stderr, "Invalid eco mode: %s\n", optarg);
+                    printf("Eco mode: tick alignment in ms (at least 100, e.g. 1000)\n");
+                    exit(0);
+                }
+                break;
+
+            case 'T':
+                if (!parse_task_config(optarg, config->tasks, TASK_COUNT)) {
+                    fprintf(stderr, "Invalid task timing: %s\n", optarg);
+                    printf("Task timing: name=period_ms[:phase_ms[:priority]],...\n");
+                    printf("Tasks: temperature, display, cooler, dbus\n");
+                    exit(0);
+                }
+                break;
+
             case '?': // Unrecognized option
                 fprintf(stderr, "Unknown option: %c\n", optopt);
                 break;
@@ -143,15 +716,432 @@ int main(int argc, char *argv[])
                 break;
         }
     }
+}
+
+/**
+ * Builds the configuration: defaults, then the configuration file and the
+ * curve file, then the command line, then the settings changed over D-Bus
+ * since startup, which win.
+ *
+ * \param next the configuration to build
+ * \return 1 on success, 0 if a file is invalid
+ */
+int build_config(daemon_config_t* next)
+{
+    init_daemon_config(next);
+
+    if (options.config_file) {
+        if (access(options.config_file, F_OK) == 0) {
+            if (!load_daemon_config(options.config_file, next)) {
+                logerror("Invalid configuration in %s\n", options.config_file);
+                return 0;
+            }
+        } else {
+            loginfo("No configuration file %s, using the defaults\n", options.config_file);
+        }
+    }
+
+    if (options.curve_file && !load_fan_curves(options.curve_file, &next->fan_curves)) {
+        logerror("Invalid fan curves in %s\n", options.curve_file);
+        return 0;
+    }
+
+    // Validated at startup, cannot fail here
+    optind = 1;
+    parse_options(options.argc, options.argv, next);
+
+    if (overrides.fan_mode >= 0)
+        next->fan_mode = overrides.fan_mode;
+    if (overrides.brightness >= 0)
+        next->brightness = overrides.brightness;
+    if (overrides.display_features) {
+        next->display_features = (display_features_t) overrides.display_features;
+        next->display_style = (monitor_style_t) overrides.display_style;
+    }
+    return 1;
+}
+
+/**
+ * Applies the settings that differ from the previous configuration. Only
+ * the device commands of changed settings are sent; sensors and devices
+ * are not reinitialized.
+ *
+ * \param old the previous configuration
+ */
+void apply_config_changes(const daemon_config_t* old)
+{
+    int fan_changed = config.fan_mode != old->fan_mode
+        || (config.fan_mode == FAN_MODE_CUSTOM && memcmp(&config.fan_curves, &old->fan_curves, sizeof(config.fan_curves)));
+    int display_changed = config.display_features != old->display_features || config.display_style != old->display_style;
+
+    // While suspended, resume_monitor() replays the whole configuration
+    if (!monitor.is_suspend) {
+        if (fan_changed) {
+            if (config.fan_mode == FAN_MODE_CUSTOM) {
+                set_fan_curves(monitor.handle_cl, config.fan_curves.points);
+            } else {
+                set_fan_mode(monitor.handle_cl, config.fan_mode);
+            }
+        }
+        if (config.brightness != old->brightness)
+            set_lcm_back_light(monitor.handle_s, config.brightness);
+        if (config.direction != old->direction)
+            set_lcm_direction(monitor.handle_s, config.direction);
+        if (config.temperature_unit != old->temperature_unit)
+            set_temperature_unit(monitor.handle_s, config.temperature_unit);
+        if (display_changed)
+            set_display_mode(monitor.handle_s, config.display_features, config.display_style);
+    }
+
+    if (fan_changed || memcmp(&config.pid, &old->pid, sizeof(config.pid))) {
+        update_fan_control(old);
+        memset(monitor.fan_duty, 0xff, sizeof(monitor.fan_duty));
+    }
+
+    if (memcmp(&config.temp_filter, &old->temp_filter, sizeof(config.temp_filter)))
+        init_signal_filter(&monitor.temp_filter, &config.temp_filter);
+
+    if (memcmp(&config.rate, &old->rate, sizeof(config.rate)))
+        set_sampler_rate(&config.rate);
+
+    if (config.sensors != old->sensors)
+        set_sensor_collectors(config.sensors);
+
+#ifdef HAVE_SYSTEMD_BUS
+    if (memcmp(&config.telemetry, &old->telemetry, sizeof(config.telemetry)))
+        set_telemetry_config(&config.telemetry);
+#endif
+
+    if (memcmp(config.tasks, old->tasks, sizeof(config.tasks))) {
+        for (int i = 0; i < TASK_COUNT; i++) {
+            scheduler_configure_task(&monitor.scheduler, &config.tasks[i]);
+        }
+        if (eco_config.align_us > 0)
+            scheduler_align(&monitor.scheduler, eco_config.align_us);
+
+        if (!monitor.is_suspend) {
+            scheduler_start(&monitor.scheduler, monotonic_us());
+            run_scheduler();
+        }
+    }
+
+    publish_state();
+}
+
+/**
+ * Replaces the configuration with a single assignment, then applies what
+ * changed.
+ *
+ * \param next the new configuration
+ */
+void swap_config(const daemon_config_t* next)
+{
+    daemon_config_t old = config;
+
+    config = *next;
+    apply_config_changes(&old);
+}
+
+/**
+ * Reloads the configuration. The new configuration is built and validated
+ * aside, then swapped in between two ticks; the current one is kept if it
+ * is invalid.
+ */
+void reload_config(void)
+{
+    uint64_t start_us = monotonic_us();
+    daemon_config_t next;
+
+    if (!build_config(&next)) {
+        logerror("Keeping the current configuration\n");
+        return;
+    }
+
+    swap_config(&next);
+
+    loginfo("Configuration reloaded in %llu us\n", (unsigned long long)(monotonic_us() - start_us));
+}
+
+/**
+ * Signal handler (signalfd): stops, suspends or resumes the daemon, or
+ * reloads its configuration.
+ * Takes effect immediately, no tick has to elapse.
+ */
+void on_signal(int fd, __attribute__((unused)) uint32_t events, __attribute__((unused)) void *userdata)
+{
+    struct signalfd_siginfo info;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGTERM:
+            case SIGINT:
+                loginfo("Stopping ...\n");
+                stop_event_loop();
+                break;
+
+            case SIGTSTP:
+                suspend_monitor();
+                break;
+
+            case SIGCONT:
+                resume_monitor();
+                break;
+
+            case SIGHUP:
+                reload_config();
+                break;
+        }
+    }
+}
+
+#ifdef HAVE_SYSTEMD_BUS
+/**
+ * D-Bus handler: answers requests as soon as they arrive.
+ */
+void on_dbus(__attribute__((unused)) int fd, __attribute__((unused)) uint32_t events, void *userdata)
+{
+    process_dbus((dbus_device*) userdata);
+}
+
+/**
+ * SetFanMode handler: switches the cooling mode without restarting the
+ * daemon, a single USB command (the curves in custom mode). The mode is
+ * kept across reloads.
+ */
+int on_set_fan_mode(int mode, __attribute__((unused)) void *userdata)
+{
+    daemon_config_t next = config;
+
+    if (mode < FAN_MODE_SILENT || mode > FAN_MODE_SMART)
+        return 0;
+
+    next.fan_mode = mode;
+    overrides.fan_mode = mode;
+    swap_config(&next);
+
+    loginfo("Fan mode set to %d\n", mode);
+    return 1;
+}
+
+/**
+ * SetBrightness handler: sets the LCD backlight, kept across reloads.
+ */
+int on_set_brightness(int brightness, __attribute__((unused)) void *userdata)
+{
+    daemon_config_t next = config;
+
+    if (brightness < 0 || brightness > 100)
+        return 0;
+
+    next.brightness = brightness;
+    overrides.brightness = brightness;
+    swap_config(&next);
+    return 1;
+}
+
+/**
+ * SetDisplayFeatures handler: sets the features and style of the LCD, kept
+ * across reloads.
+ */
+int on_set_display_features(uint32_t features, int style, __attribute__((unused)) void *userdata)
+{
+    daemon_config_t next = config;
+
+    if (features == 0 || features >= (1u << DISPLAY_FEATURES_COUNT) || style < STYLE_1 || style > STYLE_4)
+        return 0;
+
+    next.display_features = (display_features_t) features;
+    next.display_style = (monitor_style_t) style;
+    overrides.display_features = features;
+    overrides.display_style = style;
+    swap_config(&next);
+    return 1;
+}
+
+/**
+ * logind handler: quiesces the devices before sleep (logind waits for it
+ * thanks to the delay inhibitor) and restores them right after resume.
+ */
+void on_sleep(int sleeping, __attribute__((unused)) void *userdata)
+{
+    if (sleeping) {
+        suspend_monitor();
+    } else {
+        resume_monitor();
+    }
+}
+
+/**
+ * Updates the events watched on the bus connection before each wait.
+ */
+void prepare_dbus(void *userdata)
+{
+    dbus_device* handle_dbus = (dbus_device*) userdata;
+    event_loop_modify(get_dbus_fd(handle_dbus), get_dbus_events(handle_dbus));
+}
+#endif
+
+/**
+ * Monitor the CPU temperature and send it to the AIO.
+ *
+ * Runs an epoll loop over a timerfd armed at the next task deadline, a
+ * signalfd (SIGTERM, SIGINT, SIGTSTP, SIGCONT, SIGHUP), the sensor
+ * sampler events and the D-Bus connection. The signals must be blocked
+ * by the caller.
+ *
+ * \param handle handle on the AIO device
+ */
+void monitor_cpu_temperature(
+    coreliquid_device* handle_s,
+    coreliquid_device* handle_cl,
+    dbus_device* handle_dbus,
+    const sigset_t* signals)
+{
+    monitor.handle_s = handle_s;
+    monitor.handle_cl = handle_cl;
+    monitor.handle_dbus = handle_dbus;
+    memset(monitor.fan_duty, 0xff, sizeof(monitor.fan_duty));
+
+    update_fan_control(NULL);
+
+    size_t history_size = init_telemetry_history();
+    loginfo("Telemetry history: %zu KB\n", history_size / 1024);
+
+    // Optional, readers fall back to D-Bus
+    open_telemetry_shm();
+    if (options.log.path[0])
+        open_telemetry_log(&options.log);
+#ifdef HAVE_FUSE
+    if (options.hwmon_path)
+        start_fuse_hwmon(options.hwmon_path);
+#endif
+
+    init_signal_filter(&monitor.temp_filter, &config.temp_filter);
+    init_signal_filter(&monitor.freq_filter, &freq_filter_config);
+
+    init_scheduler(&monitor.scheduler);
+    scheduler_add_task(&monitor.scheduler, &config.tasks[TASK_TEMPERATURE], push_oled_status, NULL);
+    scheduler_add_task(&monitor.scheduler, &config.tasks[TASK_DISPLAY], push_lcd_info, NULL);
+    scheduler_add_task(&monitor.scheduler, &config.tasks[TASK_COOLER], read_cooler_status, NULL);
+    scheduler_add_task(&monitor.scheduler, &config.tasks[TASK_DBUS], emit_telemetry, NULL);
+    if (eco_config.align_us > 0)
+        scheduler_align(&monitor.scheduler, eco_config.align_us);
+
+    if (!init_event_loop())
+        return;
+
+    monitor.fd_timer = create_timer();
+    monitor.fd_signal = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (monitor.fd_timer < 0 || monitor.fd_signal < 0) {
+        logerror("Unable to set up the monitoring loop\n");
+        goto exit_loop;
+    }
 
-    if (!strcmp(argv[optind], "startd"))
+    if (!event_loop_add(monitor.fd_timer, EPOLLIN, on_timer, NULL)
+            || !event_loop_add(monitor.fd_signal, EPOLLIN, on_signal, NULL)) {
+        goto exit_loop;
+    }
+
+    // No sampler thread in eco mode
+    if (get_sampler_event_fd() >= 0 && !event_loop_add(get_sampler_event_fd(), EPOLLIN, on_sampler_event, NULL))
+        goto exit_loop;
+
+    // Optional as well, subscribers fall back to the shared memory
+    if (options.stream_path)
+        open_telemetry_stream(options.stream_path);
+    if (options.metrics_address)
+        open_metrics_endpoint(options.metrics_address, render_metrics, NULL);
+
+#ifdef HAVE_SYSTEMD_BUS
+    if (!event_loop_add(get_dbus_fd(handle_dbus), get_dbus_events(handle_dbus), on_dbus, handle_dbus))
+        goto exit_loop;
+
+    event_loop_set_prepare(prepare_dbus, handle_dbus);
+    watch_sleep(handle_dbus, on_sleep, NULL);
+
+    const dbus_control_t control = {
+        .set_fan_mode = on_set_fan_mode,
+        .set_brightness = on_set_brightness,
+        .set_display_features = on_set_display_features,
+    };
+    set_dbus_control(&control);
+    set_telemetry_config(&config.telemetry);
+#endif
+
+    publish_state();
+
+    start_footprint(&monitor.footprint);
+    scheduler_start(&monitor.scheduler, monotonic_us());
+    run_scheduler();
+
+    run_event_loop();
+
+    log_footprint(&monitor.footprint);
+    log_scheduler_stats(&monitor.scheduler);
+    log_jitter_histogram(&monitor.jitter);
+    if (monitor.pid_enabled)
+        log_pid_metrics(&monitor.pid);
+#ifdef HAVE_SYSTEMD_BUS
+    log_telemetry_stats();
+#endif
+    log_stream_stats();
+    loginfo("Filter: %u samples, %u temperature and %u frequency changes suppressed\n",
+        monitor.temp_filter.samples, monitor.temp_filter.suppressed, monitor.freq_filter.suppressed);
+    loginfo("Device writes: OLED %u (%u suppressed), LCD %u (%u suppressed), fan duty %u\n",
+        write_stats.oled_writes, write_stats.oled_suppressed,
+        write_stats.lcd_writes, write_stats.lcd_suppressed, write_stats.fan_writes);
+
+exit_loop:
+    close_metrics_endpoint();
+    close_telemetry_stream();
+    close_telemetry_shm();
+    close_telemetry_log();
+#ifdef HAVE_FUSE
+    stop_fuse_hwmon();
+#endif
+
+    if (monitor.fd_signal >= 0)
+        close(monitor.fd_signal);
+    if (monitor.fd_timer >= 0)
+        close(monitor.fd_timer);
+
+    shutdown_event_loop();
+}
+
+/**
+ * Main program
+ */
+int main(int argc, char *argv[])
+{
+    int exit_status = EXIT_SUCCESS;
+    int start_daemon = 0;
+
+    // Validates the command line and finds the configuration files
+    options.argc = argc;
+    options.argv = argv;
+    init_daemon_config(&config);
+    parse_options(argc, argv, &config);
+
+    if (rt_config.priority > 0 && eco_config.align_us > 0) {
+        fprintf(stderr, "Real-time (-S) and eco (-E) modes are exclusive\n");
+        exit(0);
+    }
+
+    if (optind < argc && !strcmp(argv[optind], "startd"))
             start_daemon = 1;
 
     // Initialize the subsystems
     open_log(start_daemon, APP_IDENTIFIER);
     init_coreliquid();
+    set_sensors_root(options.sensors_root);
     init_sensors();
 
+    if (!build_config(&config)) {
+        exit_status = EXIT_FAILURE;
+        goto exit_shutdown;
+    }
+    set_sensor_collectors(config.sensors);
+
     coreliquid_device* handle_cl = open_device_aio();
     if (!handle_cl) {
         logerror("Failed to open Coreliquid AIO device.\n");
@@ -168,12 +1158,19 @@ int main(int argc, char *argv[])
 
     dbus_device* handle_dbus = NULL;
 #ifdef HAVE_SYSTEMD_BUS
-    handle_dbus = open_dbus();
+    handle_dbus = open_dbus(options.bus_address);
     if (!handle_dbus) {
         logerror("Failed to open system bus.\n");
         exit_status = EXIT_FAILURE;
         goto exit_free;
     }
+#else
+    if (options.bus_address)
+        logerror("Built without D-Bus support, ignoring -B\n");
+#endif
+#ifndef HAVE_FUSE
+    if (options.hwmon_path)
+        logerror("Built without FUSE support, ignoring -H\n");
 #endif
 
     detect_lm_sensors();
@@ -194,8 +1191,6 @@ int main(int argc, char *argv[])
 
     loginfo("LED device firmware version: %d.%d\n", version_high, version_low);
 
-    set_fan_mode(handle_cl, fan_mode);
-
     int fw_version;
     if (!get_device_info(handle_s, &fw_version)) {
         exit_status = EXIT_FAILURE;
@@ -204,21 +1199,43 @@ int main(int argc, char *argv[])
 
     loginfo("Found S device. FW version: %d\n", fw_version);
 
-    set_lcm_back_light(handle_s, LCM_DEFAULT_BRIGHTNESS);
-    set_lcm_direction(handle_s, LCM_DIR_DEFAULT);
-    set_temperature_unit(handle_s, 0);
-    set_display_mode(handle_s, SHOW_CPU_FREQ | SHOW_CPU_TEMP, STYLE_3);
+#ifdef HAVE_SYSTEMD_BUS
+    set_firmware_versions(version_high, version_low, fw_version);
+#endif
+
+    apply_device_config(handle_cl, handle_s);
 
     // Start daemon if requested
     if (start_daemon) {
-        signal(SIGTERM, stopit);
-        signal(SIGINT, stopit);
-        signal(SIGTSTP, suspendit);
-        signal(SIGCONT, resumeit);
+        // Delivered through a signalfd in the monitoring loop
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTSTP);
+        sigaddset(&signals, SIGCONT);
+        sigaddset(&signals, SIGHUP);
+        sigprocmask(SIG_BLOCK, &signals, NULL);
+
+        // Before the sampler starts, so that it inherits the settings
+        if (rt_config.priority > 0 && !enter_rt_mode(&rt_config)) {
+            logerror("Real-time mode not fully applied, continuing\n");
+        }
+
+        if (eco_config.align_us > 0) {
+            if (!enter_eco_mode(&eco_config))
+                logerror("Eco mode not fully applied, continuing\n");
+        } else if (!start_sensors_sampler(&config.rate)) {
+            exit_status = EXIT_FAILURE;
+            goto exit_dbus;
+        }
+
+        monitor_cpu_temperature(handle_s, handle_cl, handle_dbus, &signals);
 
-        monitor_cpu_temperature(handle_s, handle_cl, handle_dbus);
+        stop_sensors_sampler();
     }
 
+exit_dbus:
 #ifdef HAVE_SYSTEMD_BUS
     close_dbus(handle_dbus);
 #endif
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include "openmetrics.h"
+#include "event_loop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+struct metrics_client {
+    int fd;                 // -1 when the slot is free
+    uint64_t connected_us;
+
+    char request[512];
+    size_t request_len;
+
+    // Response: the header, then body_len bytes of the body rendered for this scrape
+    char header[192];
+    size_t header_len;
+    char body[METRICS_BUFFER_SIZE];
+    size_t body_len;
+    size_t sent;
+    int responding;
+};
+
+static struct {
+    int fd_listen;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];     // empty for TCP
+
+    int fd_timer;           // armed at the deadline of the oldest client
+
+    metrics_render_t render;
+    void *userdata;
+
+    struct metrics_client clients[METRICS_MAX_CLIENTS];
+
+    uint64_t scrapes;
+    uint64_t overflows;
+} endpoint = { .fd_listen = -1, .fd_timer = -1 };
+
+/**
+ * Appends formatted text to the exposition. Text that does not fit is
+ * dropped and the overflow is flagged.
+ */
+static void metrics_printf(metrics_writer_t *writer, const char *format, ...)
+{
+    va_list args;
+
+    if (writer->overflow)
+        return;
+
+    va_start(args, format);
+    int len = vsnprintf(writer->buf + writer->len, writer->size - writer->len, format, args);
+    va_end(args);
+
+    if (len < 0 || (size_t)len >= writer->size - writer->len) {
+        writer->overflow = 1;
+        return;
+    }
+    writer->len += len;
+}
+
+/**
+ * Writes the metadata of a metric family.
+ *
+ * @param writer The exposition.
+ * @param name Family name, ending with the unit if any.
+ * @param type "gauge", "counter" or "histogram".
+ * @param unit The unit (e.g. "seconds"), or NULL.
+ * @param help Description of the family.
+ */
+void metrics_family(metrics_writer_t *writer, const char *name, const char *type, const char *unit, const char *help)
+{
+    metrics_printf(writer, "# TYPE %s %s\n", name, type);
+    if (unit)
+        metrics_printf(writer, "# UNIT %s %s\n", name, unit);
+    metrics_printf(writer, "# HELP %s %s\n", name, help);
+}
+
+/**
+ * Writes an integer sample.
+ *
+ * @param writer The exposition.
+ * @param name Sample name (with the _total suffix for counters).
+ * @param labels Labels such as "fan=\"pump\"", or NULL.
+ * @param value The value.
+ */
+void metrics_int(metrics_writer_t *writer, const char *name, const char *labels, int64_t value)
+{
+    if (labels) {
+        metrics_printf(writer, "%s{%s} %lld\n", name, labels, (long long)value);
+    } else {
+        metrics_printf(writer, "%s %lld\n", name, (long long)value);
+    }
+}
+
+/**
+ * Writes a floating-point sample.
+ *
+ * @param writer The exposition.
+ * @param name Sample name.
+ * @param labels Labels, or NULL.
+ * @param value The value.
+ */
+void metrics_float(metrics_writer_t *writer, const char *name, const char *labels, double value)
+{
+    if (labels) {
+        metrics_printf(writer, "%s{%s} %.9g\n", name, labels, value);
+    } else {
+        metrics_printf(writer, "%s %.9g\n", name, value);
+    }
+}
+
+/**
+ * Writes a latency histogram in seconds. Bucket i of the histogram counts
+ * latencies below 2^i us, which becomes the le bound.
+ *
+ * @param writer The exposition.
+ * @param name Family name, ending with _seconds.
+ * @param labels Labels, or NULL.
+ * @param histogram The histogram.
+ */
+void metrics_histogram(metrics_writer_t *writer, const char *name, const char *labels, const jitter_histogram_t *histogram)
+{
+    const char *sep = labels ? "," : "";
+    uint64_t count = 0;
+
+    if (!labels)
+        labels = "";
+
+    for (int i = 0; i < JITTER_BUCKETS - 1; i++) {
+        count += histogram->counts[i];
+        metrics_printf(writer, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep,
+            (double)(1ULL << i) / 1e6, (unsigned long long)count);
+    }
+    metrics_printf(writer, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long)histogram->samples);
+    metrics_printf(writer, "%s_count%s%s%s %llu\n", name, *sep ? "{" : "", labels, *sep ? "}" : "",
+        (unsigned long long)histogram->samples);
+    metrics_printf(writer, "%s_sum%s%s%s %.6f\n", name, *sep ? "{" : "", labels, *sep ? "}" : "",
+        histogram->total_us / 1e6);
+}
+
+/**
+ * Arms the timer at the deadline of the oldest client, or disarms it when
+ * no client is connected.
+ */
+static void arm_timeout(void)
+{
+    uint64_t deadline_us = 0;
+
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        const struct metrics_client *client = &endpoint.clients[i];
+        if (client->fd >= 0 && (!deadline_us || client->connected_us + METRICS_CLIENT_TIMEOUT_US < deadline_us))
+            deadline_us = client->connected_us + METRICS_CLIENT_TIMEOUT_US;
+    }
+
+    set_timer_deadline(endpoint.fd_timer, deadline_us);
+}
+
+/**
+ * Disconnects a client.
+ *
+ * @param client The client.
+ */
+static void drop_client(struct metrics_client *client)
+{
+    event_loop_remove(client->fd);
+    close(client->fd);
+    client->fd = -1;
+    arm_timeout();
+}
+
+/**
+ * Event loop handler of the timer: drops the clients that did not complete
+ * their scrape in time, so that a stalled scraper does not keep a slot.
+ */
+static void on_timeout(int fd, __attribute__((unused)) uint32_t events, __attribute__((unused)) void *userdata)
+{
+    uint64_t now_us = monotonic_us();
+
+    read_timer(fd);
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        struct metrics_client *client = &endpoint.clients[i];
+        if (client->fd >= 0 && now_us >= client->connected_us + METRICS_CLIENT_TIMEOUT_US)
+            drop_client(client);
+    }
+    arm_timeout();
+}
+
+/**
+ * Renders the metrics into the body of a client. Each client gets its own
+ * snapshot, so a slow one never holds back the data served to the others.
+ *
+ * @param client The client.
+ * @return The HTTP status, 500 if the metrics do not fit.
+ */
+static int render_body(struct metrics_client *client)
+{
+    metrics_writer_t writer = {
+        .buf = client->body,
+        .size = sizeof(client->body),
+    };
+
+    endpoint.render(&writer, endpoint.userdata);
+    metrics_printf(&writer, "# EOF\n");
+
+    if (writer.overflow) {
+        if (endpoint.overflows++ == 0)
+            logerror("Metrics do not fit in %d bytes\n", METRICS_BUFFER_SIZE);
+        return 500;
+    }
+
+    client->body_len = writer.len;
+    endpoint.scrapes++;
+    return 200;
+}
+
+/**
+ * Sends what is left of the response without blocking, and closes the
+ * connection once it is all out.
+ *
+ * @param client The client.
+ */
+static void send_response(struct metrics_client *client)
+{
+    while (client->sent < client->header_len + client->body_len) {
+        struct iovec iov[2];
+        int count = 0;
+
+        if (client->sent < client->header_len) {
+            iov[count++] = (struct iovec) {
+                .iov_base = client->header + client->sent,
+                .iov_len = client->header_len - client->sent,
+            };
+        }
+
+        size_t body_sent = client->sent > client->header_len ? client->sent - client->header_len : 0;
+        if (body_sent < client->body_len) {
+            iov[count++] = (struct iovec) {
+                .iov_base = client->body + body_sent,
+                .iov_len = client->body_len - body_sent,
+            };
+        }
+
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = count };
+        ssize_t len = sendmsg(client->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                event_loop_modify(client->fd, EPOLLOUT);
+                return;
+            }
+            break;
+        }
+        client->sent += len;
+    }
+
+    drop_client(client);
+}
+
+/**
+ * Answers a complete request: GET /metrics (or /) gets the exposition.
+ *
+ * @param client The client.
+ */
+static void respond(struct metrics_client *client)
+{
+    int status = 200;
+
+    if (strncmp(client->request, "GET ", 4)) {
+        status = 405;
+    } else if (strncmp(client->request + 4, "/metrics ", 9) && strncmp(client->request + 4, "/ ", 2)) {
+        status = 404;
+    } else {
+        status = render_body(client);
+    }
+
+    if (status != 200)
+        client->body_len = 0;
+    client->header_len = snprintf(client->header, sizeof(client->header),
+        "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        status, status == 200 ? "OK" : status == 404 ? "Not Found" : status == 405 ? "Method Not Allowed" : "Internal Server Error",
+        status == 200 ? METRICS_CONTENT_TYPE : "text/plain", client->body_len);
+    client->sent = 0;
+    client->responding = 1;
+
+    send_response(client);
+}
+
+/**
+ * Event loop handler of a client connection.
+ */
+static void on_client(__attribute__((unused)) int fd, uint32_t events, void *userdata)
+{
+    struct metrics_client *client = userdata;
+
+    if (client->responding) {
+        send_response(client);
+        return;
+    }
+
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        drop_client(client);
+        return;
+    }
+
+    size_t room = sizeof(client->request) - 1 - client->request_len;
+    ssize_t len = recv(client->fd, client->request + client->request_len, room, MSG_DONTWAIT);
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    // Closed, failed, or a request too long for a scrape
+    if (len <= 0 || (size_t)len == room) {
+        drop_client(client);
+        return;
+    }
+
+    client->request_len += len;
+    client->request[client->request_len] = '\0';
+
+    if (strstr(client->request, "\r\n\r\n") || strstr(client->request, "\n\n"))
+        respond(client);
+}
+
+/**
+ * Event loop handler of the listening socket. When all the slots are in
+ * use the oldest connection is dropped.
+ */
+static void on_connect(int fd, __attribute__((unused)) uint32_t events, __attribute__((unused)) void *userdata)
+{
+    int fd_client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd_client < 0)
+        return;
+
+    struct metrics_client *client = NULL;
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        struct metrics_client *slot = &endpoint.clients[i];
+        if (slot->fd < 0) {
+            client = slot;
+            break;
+        }
+        if (!client || slot->connected_us < client->connected_us)
+            client = slot;
+    }
+
+    if (client->fd >= 0)
+        drop_client(client);
+
+    if (!event_loop_add(fd_client, EPOLLIN, on_client, client)) {
+        close(fd_client);
+        return;
+    }
+
+    client->fd = fd_client;
+    client->connected_us = monotonic_us();
+    client->request_len = 0;
+    client->body_len = 0;
+    client->sent = 0;
+    client->responding = 0;
+    arm_timeout();
+}
+
+/**
+ * Creates the listening socket of an address.
+ *
+ * @param address A localhost TCP port, or the path of a unix socket.
+ * @return The socket, or -1 on error.
+ */
+static int listen_metrics(const char *address)
+{
+    char *end;
+    long port = strtol(address, &end, 10);
+    int fd;
+
+    if (address[0] == '/') {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(address) >= sizeof(addr.sun_path))
+            return -1;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", address);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return -1;
+
+        unlink(address);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || chmod(address, 0666) < 0) {
+            close(fd);
+            return -1;
+        }
+        snprintf(endpoint.path, sizeof(endpoint.path), "%s", address);
+    } else if (*end == '\0' && port > 0 && port <= 65535) {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons((uint16_t)port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        int reuse = 1;
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return -1;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (listen(fd, METRICS_MAX_CLIENTS) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Serves the metrics over HTTP, on a localhost TCP port or a unix socket,
+ * from the event loop, which must be initialized.
+ *
+ * Each scrape renders the metrics into the buffer of its slot, allocated
+ * once, and the response is sent without blocking. A client that does not
+ * complete its scrape within METRICS_CLIENT_TIMEOUT_US is dropped, as is
+ * the oldest one when a new scrape needs its slot.
+ *
+ * @param address A port number (e.g. "9101") or a socket path.
+ * @param render Writes the metrics, called for each scrape.
+ * @param userdata Passed to render.
+ * @return 1 on success, 0 otherwise.
+ */
+int open_metrics_endpoint(const char *address, metrics_render_t render, void *userdata)
+{
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        endpoint.clients[i].fd = -1;
+    }
+    endpoint.path[0] = '\0';
+    endpoint.render = render;
+    endpoint.userdata = userdata;
+
+    endpoint.fd_listen = listen_metrics(address);
+    if (endpoint.fd_listen < 0) {
+        logerror("Unable to serve metrics on %s: %s\n", address, strerror(errno));
+        return 0;
+    }
+
+    endpoint.fd_timer = create_timer();
+    if (endpoint.fd_timer < 0 || !event_loop_add(endpoint.fd_timer, EPOLLIN, on_timeout, NULL)
+            || !event_loop_add(endpoint.fd_listen, EPOLLIN, on_connect, NULL)) {
+        close_metrics_endpoint();
+        return 0;
+    }
+
+    loginfo("Serving metrics on %s\n", address);
+    return 1;
+}
+
+/**
+ * Closes the connections and the listening socket.
+ */
+void close_metrics_endpoint(void)
+{
+    if (endpoint.fd_listen < 0)
+        return;
+
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (endpoint.clients[i].fd >= 0)
+            drop_client(&endpoint.clients[i]);
+    }
+
+    event_loop_remove(endpoint.fd_listen);
+    close(endpoint.fd_listen);
+    if (endpoint.path[0])
+        unlink(endpoint.path);
+    endpoint.fd_listen = -1;
+
+    if (endpoint.fd_timer >= 0) {
+        event_loop_remove(endpoint.fd_timer);
+        close(endpoint.fd_timer);
+        endpoint.fd_timer = -1;
+    }
+
+    if (endpoint.scrapes > 0)
+        loginfo("Metrics: %llu scrapes\n", (unsigned long long)endpoint.scrapes);
+}
@@ -0,0 +1,37 @@
+#ifndef _OPENMETRICS__H
+#define _OPENMETRICS__H
+
+#include "rt_mode.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of the buffer the metrics are rendered into */
+#define METRICS_BUFFER_SIZE     (64 * 1024)
+
+/** Scrapes served at the same time, the oldest is dropped for a new one */
+#define METRICS_MAX_CLIENTS     4
+
+/** Time a client has to send its request and read the response */
+#define METRICS_CLIENT_TIMEOUT_US   10000000ULL
+
+/** Appends the exposition into a fixed buffer, overflow is flagged */
+struct metrics_writer {
+    char *buf;
+    size_t size;
+    size_t len;
+    int overflow;
+};
+typedef struct metrics_writer metrics_writer_t;
+
+typedef void (*metrics_render_t)(metrics_writer_t *writer, void *userdata);
+
+int open_metrics_endpoint(const char *address, metrics_render_t render, void *userdata);
+void close_metrics_endpoint(void);
+
+void metrics_family(metrics_writer_t *writer, const char *name, const char *type, const char *unit, const char *help);
+void metrics_int(metrics_writer_t *writer, const char *name, const char *labels, int64_t value);
+void metrics_float(metrics_writer_t *writer, const char *name, const char *labels, double value);
+void metrics_histogram(metrics_writer_t *writer, const char *name, const char *labels, const jitter_histogram_t *histogram);
+
+#endif // _OPENMETRICS__H
@@ -0,0 +1,41 @@
+#ifndef _PROBES__H
+#define _PROBES__H
+
+/**
+ * USDT probes of the "coreliquid" provider, for bpftrace or perf on a live
+ * daemon. A probe is a nop plus an ELF note, but its arguments are still
+ * computed when untraced: they are values the code already has or a few
+ * loads (the command of hid_start). Built without <sys/sdt.h>, the probes
+ * are compiled out.
+ *
+ * A tick is a pass of the main loop: the tasks due on the timer, or a task
+ * run on an event (a sampler wakeup, a resume) with a due count of 1.
+ *
+ *     tick_start(now_us, due_tasks)     tick_end(due_tasks, next_due_us)
+ *     task_start(name)                  task_end(name, run_us)
+ *     sensor_start(name)                sensor_end(name, result)
+ *     hid_start(op, report_id, command, length, report)
+ *     hid_end(op, result, length)
+ *     dbus_emit_start(properties)       dbus_emit_end(result)
+ *
+ * The command of hid_start is the byte after the report ID for the K
+ * series, and the 16-bit code after the magic code for the S series; it is
+ * 0 for reads, whose report is only known once they return.
+ */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+
+#define PROBE1(name, a1)                    DTRACE_PROBE1(coreliquid, name, a1)
+#define PROBE2(name, a1, a2)                DTRACE_PROBE2(coreliquid, name, a1, a2)
+#define PROBE3(name, a1, a2, a3)            DTRACE_PROBE3(coreliquid, name, a1, a2, a3)
+#define PROBE5(name, a1, a2, a3, a4, a5)    DTRACE_PROBE5(coreliquid, name, a1, a2, a3, a4, a5)
+#else
+#define PROBE1(name, a1)                    do { (void)(a1); } while (0)
+#define PROBE2(name, a1, a2)                do { (void)(a1); (void)(a2); } while (0)
+#define PROBE3(name, a1, a2, a3)            do { (void)(a1); (void)(a2); (void)(a3); } while (0)
+#define PROBE5(name, a1, a2, a3, a4, a5) \
+    do { (void)(a1); (void)(a2); (void)(a3); (void)(a4); (void)(a5); } while (0)
+#endif
+
+#endif // _PROBES__H
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+
+#include "rt_mode.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * Touches the stack down to RT_PREFAULT_STACK_SIZE, so that the pages are
+ * mapped (and then locked) before the loop runs.
+ */
+static __attribute__((noinline)) void prefault_stack(void)
+{
+    volatile unsigned char stack[RT_PREFAULT_STACK_SIZE];
+
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+/**
+ * Switches the calling thread to real-time operation: pins it to the
+ * housekeeping CPU, locks and prefaults its memory so that the loop never
+ * waits on a page fault, and schedules it SCHED_FIFO so that a saturated
+ * machine does not delay its wakeups.
+ *
+ * Threads created afterwards inherit the affinity and scheduling policy.
+ * Each step is tried even if a previous one failed.
+ *
+ * @param config Priority and CPU.
+ * @return 1 if all steps succeeded, 0 otherwise.
+ */
+int enter_rt_mode(const rt_config_t *config)
+{
+    int result = 1;
+
+    if (config->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0) {
+            logerror("Unable to pin to CPU %d: %s\n", config->cpu, strerror(ret));
+            result = 0;
+        }
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        logerror("Unable to lock memory: %s\n", strerror(errno));
+        result = 0;
+    }
+    prefault_stack();
+
+    struct sched_param param = { .sched_priority = config->priority };
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret != 0) {
+        logerror("Unable to set SCHED_FIFO priority %d: %s\n", config->priority, strerror(ret));
+        result = 0;
+    }
+
+    if (result) {
+        loginfo("Real-time mode: SCHED_FIFO priority %d, CPU %d\n", config->priority, config->cpu);
+    }
+    return result;
+}
+
+/**
+ * Parses a "priority[:cpu]" specification such as "50:0".
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to update.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_rt_config(const char *spec, rt_config_t *config)
+{
+    int priority, cpu = -1;
+
+    if (sscanf(spec, "%d:%d", &priority, &cpu) < 1)
+        return 0;
+
+    if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO)
+            || cpu < -1 || cpu >= CPU_SETSIZE)
+        return 0;
+
+    config->priority = priority;
+    config->cpu = cpu;
+    return 1;
+}
+
+/**
+ * Records the latency of a wakeup (or the duration of a HID transaction or
+ * a task run, which share the histogram).
+ *
+ * @param histogram The histogram.
+ * @param late_us Time between the deadline and the wakeup in microseconds.
+ */
+void record_jitter(jitter_histogram_t *histogram, uint64_t late_us)
+{
+    int bucket = 0;
+    while (bucket < JITTER_BUCKETS - 1 && late_us >= (1ULL << bucket))
+        bucket++;
+
+    histogram->counts[bucket]++;
+    histogram->samples++;
+    histogram->total_us += late_us;
+    if (late_us > histogram->max_us)
+        histogram->max_us = late_us;
+}
+
+/**
+ * Returns the upper bound of the bucket holding a percentile.
+ */
+static uint64_t jitter_percentile(const jitter_histogram_t *histogram, int percent)
+{
+    uint64_t rank = (histogram->samples * percent + 99) / 100;
+    uint64_t count = 0;
+
+    for (int i = 0; i < JITTER_BUCKETS - 1; i++) {
+        count += histogram->counts[i];
+        if (count >= rank)
+            return 1ULL << i;
+    }
+    return histogram->max_us;
+}
+
+/**
+ * Logs the wakeup latency distribution.
+ *
+ * @param histogram The histogram.
+ */
+void log_jitter_histogram(const jitter_histogram_t *histogram)
+{
+    if (histogram->samples == 0)
+        return;
+
+    loginfo("Wakeup latency: %llu wakeups, avg %llu us, p50 < %llu us, p99 < %llu us, max %llu us\n",
+        (unsigned long long)histogram->samples,
+        (unsigned long long)(histogram->total_us / histogram->samples),
+        (unsigned long long)jitter_percentile(histogram, 50),
+        (unsigned long long)jitter_percentile(histogram, 99),
+        (unsigned long long)histogram->max_us);
+
+    for (int i = 0; i < JITTER_BUCKETS; i++) {
+        if (histogram->counts[i] == 0)
+            continue;
+
+        if (i < JITTER_BUCKETS - 1) {
+            loginfo("  < %llu us: %llu\n", 1ULL << i, (unsigned long long)histogram->counts[i]);
+        } else {
+            loginfo("  >= %llu us: %llu\n", 1ULL << (i - 1), (unsigned long long)histogram->counts[i]);
+        }
+    }
+}
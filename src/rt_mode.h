@@ -0,0 +1,31 @@
+#ifndef _RT_MODE__H
+#define _RT_MODE__H
+
+#include <stdint.h>
+
+/** Stack prefaulted before locking memory */
+#define RT_PREFAULT_STACK_SIZE (128 * 1024)
+
+/** Latency buckets: bucket i counts latencies below 2^i us, the last one the rest */
+#define JITTER_BUCKETS 21
+
+struct rt_config {
+    int priority;           // SCHED_FIFO priority (1-99), 0 disables real-time mode
+    int cpu;                // housekeeping CPU to pin the daemon to, -1 for none
+};
+typedef struct rt_config rt_config_t;
+
+struct jitter_histogram {
+    uint64_t counts[JITTER_BUCKETS];
+    uint64_t samples;
+    uint64_t total_us;
+    uint64_t max_us;
+};
+typedef struct jitter_histogram jitter_histogram_t;
+
+int enter_rt_mode(const rt_config_t *config);
+int parse_rt_config(const char *spec, rt_config_t *config);
+void record_jitter(jitter_histogram_t *histogram, uint64_t late_us);
+void log_jitter_histogram(const jitter_histogram_t *histogram);
+
+#endif // _RT_MODE__H
@@ -1,29 +1,122 @@
 #include "sensors_dbus.h"
+#include "telemetry_history.h"
 #include "logger.h"
+#include "probes.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <systemd/sd-bus.h>
 
-static struct dbus_cooler_stats g_aio_stats;
+/** Telemetry: latest values, and the values last emitted, read by Get so
+ * that a Get returns what the last PropertiesChanged signal carried */
+static struct {
+    telemetry_t latest;
+    telemetry_t emitted;
+    telemetry_config_t config;
+    uint64_t last_emit_us;
 
+    uint32_t updates;               // update_telemetry() calls
+    uint32_t emissions;             // PropertiesChanged signals
+    uint32_t properties;            // properties carried by the signals
+} g_telemetry;
+static struct dbus_control g_control;
+
+/** Daemon state, published with PropertiesChanged when it changes */
+static struct {
+    uint32_t active_mode;
+    dbus_health_t health;
+    char aio_firmware[16];
+    uint32_t lcd_firmware;
+} g_state = { .aio_firmware = "" };
+
+static const char* const health_names[] = {
+    [DBUS_HEALTH_OK] = "ok",
+    [DBUS_HEALTH_SUSPENDED] = "suspended",
+    [DBUS_HEALTH_DEVICE_ERROR] = "device-error",
+};
+
+static int method_set_fan_mode(sd_bus_message *message, void *userdata, sd_bus_error *ret_error);
+static int method_set_brightness(sd_bus_message *message, void *userdata, sd_bus_error *ret_error);
+static int method_set_display_features(sd_bus_message *message, void *userdata, sd_bus_error *ret_error);
+static int method_get_history(sd_bus_message *message, void *userdata, sd_bus_error *ret_error);
+static int get_state_property(sd_bus *bus, const char *path, const char *interface, const char *property,
+    sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+
+// Callers are restricted by the bus policy (io.github.MSICoreliquid.conf)
 static const sd_bus_vtable cooler_vtable[] = {
     SD_BUS_VTABLE_START(0),
-    SD_BUS_PROPERTY("FanRadiatorSpeed", "q", NULL, offsetof(dbus_cooler_stats_t, fan_radiator_speed), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
-    SD_BUS_PROPERTY("FanWaterBlockSpeed", "q", NULL, offsetof(dbus_cooler_stats_t, fan_water_block_speed), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
-    SD_BUS_PROPERTY("PumpSpeed", "q", NULL, offsetof(dbus_cooler_stats_t, pump_speed), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
-    SD_BUS_PROPERTY("LiquidTemp", "q", NULL, offsetof(dbus_cooler_stats_t, liquid_temperature), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_METHOD("SetFanMode", "u", "", method_set_fan_mode, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("SetBrightness", "u", "", method_set_brightness, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("SetDisplayFeatures", "uu", "", method_set_display_features, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("GetHistory", "sut", "ataqaqaq", method_get_history, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_PROPERTY("FanRadiatorSpeed", "q", NULL, offsetof(telemetry_t, values[METRIC_FAN_RADIATOR]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("FanWaterBlockSpeed", "q", NULL, offsetof(telemetry_t, values[METRIC_FAN_WATER_BLOCK]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("PumpSpeed", "q", NULL, offsetof(telemetry_t, values[METRIC_PUMP]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("LiquidTemp", "q", NULL, offsetof(telemetry_t, values[METRIC_LIQUID_TEMP]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("CpuTemp", "q", NULL, offsetof(telemetry_t, values[METRIC_CPU_TEMP]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("CpuFreq", "q", NULL, offsetof(telemetry_t, values[METRIC_CPU_FREQ]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("CpuUsage", "q", NULL, offsetof(telemetry_t, values[METRIC_CPU_USAGE]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("GpuTemp", "q", NULL, offsetof(telemetry_t, values[METRIC_GPU_TEMP]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("GpuFreq", "q", NULL, offsetof(telemetry_t, values[METRIC_GPU_FREQ]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("GpuUsage", "q", NULL, offsetof(telemetry_t, values[METRIC_GPU_USAGE]), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("ActiveMode", "u", get_state_property, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("Health", "s", get_state_property, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+    SD_BUS_PROPERTY("AioFirmwareVersion", "s", get_state_property, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("LcdFirmwareVersion", "u", get_state_property, 0, SD_BUS_VTABLE_PROPERTY_CONST),
     SD_BUS_VTABLE_END
 };
 
 struct dbus_device_ {
     sd_bus *bus;
+
+    sd_bus_slot *sleep_slot;
+    sd_bus_slot *inhibit_slot;      // pending Inhibit call, NULL if none
+    int inhibit_fd;                 // logind delay inhibitor, -1 if not held
+    dbus_sleep_handler_t sleep_handler;
+    void *sleep_userdata;
 };
 typedef struct dbus_device_ dbus_device;
 
 static const char* DBUS_PATH = "/io/github/MSICoreliquid";
 static const char* DBUS_INTERFACE = "io.github.MSICoreliquid";
 
-dbus_device* open_dbus(void)
+static const char* LOGIND_SERVICE = "org.freedesktop.login1";
+static const char* LOGIND_PATH = "/org/freedesktop/login1";
+static const char* LOGIND_INTERFACE = "org.freedesktop.login1.Manager";
+
+/**
+ * Connects to the bus at the given address.
+ *
+ * @param bus Set to the connection.
+ * @param address D-Bus address such as "unix:path=/run/test_bus".
+ * @return 0 on success, a negative errno otherwise.
+ */
+static int open_bus_address(sd_bus **bus, const char *address)
+{
+    int result = sd_bus_new(bus);
+    if (result < 0)
+        return result;
+
+    if ((result = sd_bus_set_address(*bus, address)) < 0
+            || (result = sd_bus_set_bus_client(*bus, 1)) < 0
+            || (result = sd_bus_start(*bus)) < 0) {
+        *bus = sd_bus_unref(*bus);
+    }
+    return result;
+}
+
+/**
+ * Connects to the system bus, or to another bus (e.g. a private bus with a
+ * stand-in for logind) and publishes the cooler object.
+ *
+ * @param address D-Bus address of the bus, NULL for the system bus.
+ * @return The D-Bus handle, or NULL on error.
+ */
+dbus_device* open_dbus(const char *address)
 {
     dbus_device *dbus_handle = NULL;
     int result;
@@ -32,13 +125,19 @@ dbus_device* open_dbus(void)
     if (!dbus_handle)
         return NULL;
 
-    result = sd_bus_open_system(&dbus_handle->bus);
+    dbus_handle->inhibit_fd = -1;
+
+    if (address) {
+        result = open_bus_address(&dbus_handle->bus, address);
+    } else {
+        result = sd_bus_open_system(&dbus_handle->bus);
+    }
     if (result < 0) {
-        logerror("Failed to connect to system bus: %s\n", strerror(-result));
+        logerror("Failed to connect to %s: %s\n", address ? address : "system bus", strerror(-result));
         return NULL;
     }
 
-    result = sd_bus_add_object_vtable(dbus_handle->bus, NULL, DBUS_PATH, DBUS_INTERFACE, cooler_vtable, &g_aio_stats);
+    result = sd_bus_add_object_vtable(dbus_handle->bus, NULL, DBUS_PATH, DBUS_INTERFACE, cooler_vtable, &g_telemetry.emitted);
     if (result < 0) {
         logerror("Failed to add object to system bus: %s\n", strerror(-result));
         return NULL;
@@ -57,11 +156,52 @@ void close_dbus(dbus_device* dbus_handle)
     if (!dbus_handle)
         return;
 
+    if (dbus_handle->inhibit_fd >= 0)
+        close(dbus_handle->inhibit_fd);
+
+    sd_bus_slot_unref(dbus_handle->inhibit_slot);
+    sd_bus_slot_unref(dbus_handle->sleep_slot);
     sd_bus_unref(dbus_handle->bus);
     free(dbus_handle);
 }
 
-int update_aio_status(dbus_device* dbus_handle, dbus_cooler_stats_t* aio_stats)
+/**
+ * Returns the bus connection descriptor, to be watched by the event loop.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @return The descriptor, or -1 on error.
+ */
+int get_dbus_fd(dbus_device* dbus_handle)
+{
+    if (!dbus_handle)
+        return -1;
+
+    return sd_bus_get_fd(dbus_handle->bus);
+}
+
+/**
+ * Returns the poll events the bus connection currently waits for.
+ * Must be queried again after each processing or emission.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @return POLLIN/POLLOUT mask, 0 on error.
+ */
+uint32_t get_dbus_events(dbus_device* dbus_handle)
+{
+    if (!dbus_handle)
+        return 0;
+
+    int events = sd_bus_get_events(dbus_handle->bus);
+    return events < 0 ? 0 : (uint32_t)events;
+}
+
+/**
+ * Processes all pending bus messages (property reads, method calls).
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @return 0 on success, -1 on error.
+ */
+int process_dbus(dbus_device* dbus_handle)
 {
     int result;
 
@@ -73,20 +213,405 @@ int update_aio_status(dbus_device* dbus_handle, dbus_cooler_stats_t* aio_stats)
         logerror("DBus processing error: %s\n", strerror(-result));
         return -1;
     }
+    return 0;
+}
+
+/**
+ * Sets the deadbands and the rate limit of the telemetry emission.
+ *
+ * @param config The configuration, copied.
+ */
+void set_telemetry_config(const telemetry_config_t* config)
+{
+    g_telemetry.config = *config;
+}
 
-    if (!aio_stats)
+/**
+ * Stores the latest telemetry and emits the changes if the rate limit
+ * allows it. Property reads return the values emitted.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @param telemetry The latest values.
+ * @param now_us Current CLOCK_MONOTONIC time in microseconds.
+ * @return Number of properties emitted, negative on error.
+ */
+int update_telemetry(dbus_device* dbus_handle, const telemetry_t* telemetry, uint64_t now_us)
+{
+    if (!dbus_handle || !telemetry)
         return -1;
 
-    memcpy(&g_aio_stats, aio_stats, sizeof(dbus_cooler_stats_t));
+    g_telemetry.latest = *telemetry;
+    g_telemetry.updates++;
+
+    return flush_telemetry(dbus_handle, now_us);
+}
 
-    result = sd_bus_emit_properties_changed(
-        dbus_handle->bus,
-        DBUS_PATH,
-        DBUS_INTERFACE,
-        "FanRadiatorSpeed", "FanWaterBlockSpeed", "PumpSpeed", "LiquidTemp", NULL
-    );
+/**
+ * Emits one PropertiesChanged signal carrying only the properties that
+ * moved past their deadband since they were last emitted. Updates arriving
+ * within the minimum interval of the last emission are coalesced, and go
+ * out with the next call after it.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @param now_us Current CLOCK_MONOTONIC time in microseconds.
+ * @return Number of properties emitted, negative on error.
+ */
+int flush_telemetry(dbus_device* dbus_handle, uint64_t now_us)
+{
+    const char *changed[METRIC_COUNT + 1];
+    int count = 0;
+
+    if (!dbus_handle)
+        return -1;
+
+    if (g_telemetry.emissions > 0 && now_us - g_telemetry.last_emit_us < (uint64_t) g_telemetry.config.min_interval_us)
+        return 0;
+
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        int delta = abs((int) g_telemetry.latest.values[i] - (int) g_telemetry.emitted.values[i]);
+        if (delta > g_telemetry.config.deadband[i]) {
+            changed[count++] = telemetry_properties[i];
+            g_telemetry.emitted.values[i] = g_telemetry.latest.values[i];
+        }
+    }
+    if (count == 0)
+        return 0;
+
+    changed[count] = NULL;
+
+    PROBE1(dbus_emit_start, count);
+    int result = sd_bus_emit_properties_changed_strv(dbus_handle->bus, DBUS_PATH, DBUS_INTERFACE, (char**) changed);
+    PROBE1(dbus_emit_end, result);
     if (result < 0) {
         logerror("Failed to emit notification: %s\n", strerror(-result));
+        return result;
+    }
+
+    g_telemetry.last_emit_us = now_us;
+    g_telemetry.emissions++;
+    g_telemetry.properties += count;
+    return count;
+}
+
+/**
+ * Logs how much of the telemetry was emitted.
+ */
+void log_telemetry_stats(void)
+{
+    loginfo("D-Bus telemetry: %u updates, %u signals carrying %u of %u properties\n",
+        g_telemetry.updates, g_telemetry.emissions, g_telemetry.properties,
+        (unsigned) (g_telemetry.updates * METRIC_COUNT));
+}
+
+/**
+ * Reads a property of the daemon state.
+ */
+static int get_state_property(
+    __attribute__((unused)) sd_bus *bus,
+    __attribute__((unused)) const char *path,
+    __attribute__((unused)) const char *interface,
+    const char *property,
+    sd_bus_message *reply,
+    __attribute__((unused)) void *userdata,
+    __attribute__((unused)) sd_bus_error *ret_error)
+{
+    if (!strcmp(property, "ActiveMode"))
+        return sd_bus_message_append(reply, "u", g_state.active_mode);
+    if (!strcmp(property, "Health"))
+        return sd_bus_message_append(reply, "s", health_names[g_state.health]);
+    if (!strcmp(property, "AioFirmwareVersion"))
+        return sd_bus_message_append(reply, "s", g_state.aio_firmware);
+
+    return sd_bus_message_append(reply, "u", g_state.lcd_firmware);
+}
+
+/**
+ * Sets the firmware versions of the devices. They are constant properties,
+ * to be set before the first bus message is processed.
+ *
+ * @param aio_version_high Major version of the AIO (LED device) firmware.
+ * @param aio_version_low Minor version of the AIO firmware.
+ * @param lcd_version Version of the LCD (S device) firmware.
+ */
+void set_firmware_versions(int aio_version_high, int aio_version_low, int lcd_version)
+{
+    snprintf(g_state.aio_firmware, sizeof(g_state.aio_firmware), "%d.%d", aio_version_high, aio_version_low);
+    g_state.lcd_firmware = (uint32_t) lcd_version;
+}
+
+/**
+ * Publishes the active cooling mode and the health of the daemon. A
+ * PropertiesChanged signal is emitted only for the values that changed,
+ * so clients can subscribe instead of polling.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @param active_mode The cooling mode (0-5).
+ * @param health The health state.
+ * @return 1 if a signal was emitted, 0 if nothing changed, negative on error.
+ */
+int update_daemon_state(dbus_device* dbus_handle, int active_mode, dbus_health_t health)
+{
+    const char *changed[3] = { NULL };
+    int count = 0;
+
+    if (!dbus_handle)
+        return -1;
+
+    if (g_state.active_mode != (uint32_t) active_mode) {
+        g_state.active_mode = (uint32_t) active_mode;
+        changed[count++] = "ActiveMode";
+    }
+    if (g_state.health != health) {
+        g_state.health = health;
+        changed[count++] = "Health";
+    }
+    if (count == 0)
+        return 0;
+
+    PROBE1(dbus_emit_start, count);
+    int result = sd_bus_emit_properties_changed_strv(dbus_handle->bus, DBUS_PATH, DBUS_INTERFACE, (char**) changed);
+    PROBE1(dbus_emit_end, result);
+    if (result < 0) {
+        logerror("Failed to emit state change: %s\n", strerror(-result));
+        return result;
     }
+    return 1;
+}
+
+/**
+ * Sets the handlers of the Set* methods. Until then the methods fail.
+ *
+ * @param control The handlers, copied.
+ */
+void set_dbus_control(const dbus_control_t* control)
+{
+    g_control = *control;
+}
+
+/**
+ * Replies to a Set* method call.
+ *
+ * @param message The method call.
+ * @param applied Result of the handler, -1 if there is no handler.
+ * @param ret_error Set on failure.
+ * @return The sd-bus result.
+ */
+static int reply_control(sd_bus_message *message, int applied, sd_bus_error *ret_error)
+{
+    if (applied < 0)
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_NOT_SUPPORTED, "Control not available");
+    if (!applied)
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Invalid value");
+
+    return sd_bus_reply_method_return(message, "");
+}
+
+/**
+ * Handles SetFanMode(u mode): switches the cooling mode (0-5) in place.
+ */
+static int method_set_fan_mode(sd_bus_message *message, __attribute__((unused)) void *userdata, sd_bus_error *ret_error)
+{
+    uint32_t mode;
+
+    int result = sd_bus_message_read(message, "u", &mode);
+    if (result < 0)
+        return result;
+
+    if (!g_control.set_fan_mode)
+        return reply_control(message, -1, ret_error);
+
+    return reply_control(message, mode <= 5 && g_control.set_fan_mode((int)mode, g_control.userdata), ret_error);
+}
+
+/**
+ * Handles SetBrightness(u brightness): sets the LCD backlight (0-100).
+ */
+static int method_set_brightness(sd_bus_message *message, __attribute__((unused)) void *userdata, sd_bus_error *ret_error)
+{
+    uint32_t brightness;
+
+    int result = sd_bus_message_read(message, "u", &brightness);
+    if (result < 0)
+        return result;
+
+    if (!g_control.set_brightness)
+        return reply_control(message, -1, ret_error);
+
+    return reply_control(message, brightness <= 100 && g_control.set_brightness((int)brightness, g_control.userdata), ret_error);
+}
+
+/**
+ * Handles SetDisplayFeatures(u features, u style): sets the LCD features
+ * (display_features bit mask) and style (1-4).
+ */
+static int method_set_display_features(sd_bus_message *message, __attribute__((unused)) void *userdata, sd_bus_error *ret_error)
+{
+    uint32_t features, style;
+
+    int result = sd_bus_message_read(message, "uu", &features, &style);
+    if (result < 0)
+        return result;
+
+    if (!g_control.set_display_features)
+        return reply_control(message, -1, ret_error);
+
+    return reply_control(message, style <= 4 && g_control.set_display_features(features, (int)style, g_control.userdata), ret_error);
+}
+
+/**
+ * Handles GetHistory(s metric, u resolution, t since): returns the start
+ * times, minimums, maximums and means of the periods of a metric (e.g.
+ * "cpu_temp") at a resolution of 1, 10 or 60 seconds since a Unix time,
+ * as four arrays of equal length.
+ */
+static int method_get_history(sd_bus_message *message, __attribute__((unused)) void *userdata, sd_bus_error *ret_error)
+{
+    // Shared by all calls, which run one at a time on the bus thread
+    static history_series_t series;
+    sd_bus_message *reply = NULL;
+    const char *metric;
+    uint32_t resolution;
+    uint64_t since;
+
+    int result = sd_bus_message_read(message, "sut", &metric, &resolution, &since);
+    if (result < 0)
+        return result;
+
+    if (!query_history(find_telemetry_metric(metric), (int) resolution, since, &series))
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Unknown metric or resolution");
+
+    result = sd_bus_message_new_method_return(message, &reply);
+    if (result >= 0)
+        result = sd_bus_message_append_array(reply, 't', series.time_s, series.count * sizeof(series.time_s[0]));
+    if (result >= 0)
+        result = sd_bus_message_append_array(reply, 'q', series.min, series.count * sizeof(series.min[0]));
+    if (result >= 0)
+        result = sd_bus_message_append_array(reply, 'q', series.max, series.count * sizeof(series.max[0]));
+    if (result >= 0)
+        result = sd_bus_message_append_array(reply, 'q', series.mean, series.count * sizeof(series.mean[0]));
+    if (result >= 0)
+        result = sd_bus_send(NULL, reply, NULL);
+
+    sd_bus_message_unref(reply);
     return result;
-}
\ No newline at end of file
+}
+
+/**
+ * Handles the reply of logind to Inhibit: keeps the inhibitor descriptor.
+ */
+static int on_inhibit_reply(sd_bus_message *reply, void *userdata, __attribute__((unused)) sd_bus_error *ret_error)
+{
+    dbus_device *dbus_handle = (dbus_device*) userdata;
+    int fd = -1;
+
+    dbus_handle->inhibit_slot = sd_bus_slot_unref(dbus_handle->inhibit_slot);
+
+    if (sd_bus_message_is_method_error(reply, NULL)) {
+        logerror("Failed to take sleep inhibitor: %s\n", sd_bus_message_get_error(reply)->message);
+        return 0;
+    }
+
+    int result = sd_bus_message_read(reply, "h", &fd);
+
+    // The descriptor belongs to the reply
+    if (result >= 0 && (dbus_handle->inhibit_fd = fcntl(fd, F_DUPFD_CLOEXEC, 3)) < 0)
+        result = -errno;
+
+    if (result < 0)
+        logerror("Failed to take sleep inhibitor: %s\n", strerror(-result));
+    return 0;
+}
+
+/**
+ * Asks logind for a delay inhibitor for sleep: logind then waits (up to
+ * InhibitDelayMaxSec) for the descriptor to be closed before suspending.
+ * The call is asynchronous, so that the event loop never waits on logind;
+ * the descriptor is kept when the reply comes.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @return 1 if the inhibitor is held or requested, 0 otherwise.
+ */
+static int take_sleep_inhibitor(dbus_device* dbus_handle)
+{
+    if (dbus_handle->inhibit_fd >= 0 || dbus_handle->inhibit_slot)
+        return 1;
+
+    int result = sd_bus_call_method_async(dbus_handle->bus, &dbus_handle->inhibit_slot, LOGIND_SERVICE, LOGIND_PATH,
+        LOGIND_INTERFACE, "Inhibit", on_inhibit_reply, dbus_handle,
+        "ssss", "sleep", "my_msi_coreliquid_driver", "Quiesce and restore the AIO", "delay");
+    if (result < 0) {
+        logerror("Failed to take sleep inhibitor: %s\n", strerror(-result));
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Releases the sleep inhibitor, letting the system suspend. A request
+ * still pending is cancelled.
+ *
+ * @param dbus_handle The D-Bus handle.
+ */
+static void release_sleep_inhibitor(dbus_device* dbus_handle)
+{
+    dbus_handle->inhibit_slot = sd_bus_slot_unref(dbus_handle->inhibit_slot);
+
+    if (dbus_handle->inhibit_fd >= 0) {
+        close(dbus_handle->inhibit_fd);
+        dbus_handle->inhibit_fd = -1;
+    }
+}
+
+/**
+ * Handles the PrepareForSleep signal of logind.
+ */
+static int on_prepare_for_sleep(sd_bus_message *message, void *userdata, __attribute__((unused)) sd_bus_error *ret_error)
+{
+    dbus_device *dbus_handle = (dbus_device*) userdata;
+    int sleeping;
+
+    int result = sd_bus_message_read(message, "b", &sleeping);
+    if (result < 0) {
+        logerror("Invalid PrepareForSleep signal: %s\n", strerror(-result));
+        return 0;
+    }
+
+    dbus_handle->sleep_handler(sleeping, dbus_handle->sleep_userdata);
+
+    if (sleeping) {
+        release_sleep_inhibitor(dbus_handle);
+    } else {
+        take_sleep_inhibitor(dbus_handle);
+    }
+    return 0;
+}
+
+/**
+ * Watches logind for suspend and resume. The handler is called before the
+ * system sleeps, which waits for it thanks to a delay inhibitor, and right
+ * after the system resumed.
+ *
+ * @param dbus_handle The D-Bus handle.
+ * @param handler Called with 1 before sleep and 0 after resume.
+ * @param userdata Passed to the handler.
+ * @return 1 if the signal is watched, 0 otherwise. Without the inhibitor
+ *         (e.g. denied by policy) the signal is still watched.
+ */
+int watch_sleep(dbus_device* dbus_handle, dbus_sleep_handler_t handler, void *userdata)
+{
+    if (!dbus_handle)
+        return 0;
+
+    dbus_handle->sleep_handler = handler;
+    dbus_handle->sleep_userdata = userdata;
+
+    int result = sd_bus_match_signal(dbus_handle->bus, &dbus_handle->sleep_slot, LOGIND_SERVICE, LOGIND_PATH,
+        LOGIND_INTERFACE, "PrepareForSleep", on_prepare_for_sleep, dbus_handle);
+    if (result < 0) {
+        logerror("Failed to watch PrepareForSleep: %s\n", strerror(-result));
+        return 0;
+    }
+
+    take_sleep_inhibitor(dbus_handle);
+    return 1;
+}
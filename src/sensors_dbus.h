@@ -1,21 +1,51 @@
 #ifndef _SENSORS_DBUS__H
 #define _SENSORS_DBUS__H
 
+#include "telemetry.h"
+
 #include <stdint.h>
 
-struct dbus_cooler_stats {
-    uint16_t fan_radiator_speed;
-    uint16_t fan_water_block_speed;
-    uint16_t pump_speed;
-    uint8_t liquid_temperature;
+/** Health of the daemon, the Health property */
+enum dbus_health {
+    DBUS_HEALTH_OK = 0,
+    DBUS_HEALTH_SUSPENDED,          // devices quiesced for system sleep
+    DBUS_HEALTH_DEVICE_ERROR        // the AIO stopped answering
 };
-typedef struct dbus_cooler_stats dbus_cooler_stats_t;
+typedef enum dbus_health dbus_health_t;
 
 struct dbus_device_;
 typedef struct dbus_device_ dbus_device;
 
-dbus_device* open_dbus(void);
+/**
+ * Called when the system is about to sleep (sleeping = 1) and after it
+ * resumed (sleeping = 0).
+ */
+typedef void (*dbus_sleep_handler_t)(int sleeping, void *userdata);
+
+/**
+ * Applies settings requested by clients inside the running daemon.
+ * Each handler returns 1 if the setting was applied, 0 if it is invalid.
+ */
+struct dbus_control {
+    int (*set_fan_mode)(int mode, void *userdata);
+    int (*set_brightness)(int brightness, void *userdata);
+    int (*set_display_features)(uint32_t features, int style, void *userdata);
+    void *userdata;
+};
+typedef struct dbus_control dbus_control_t;
+
+dbus_device* open_dbus(const char *address);
 void close_dbus(dbus_device* dbus_handle);
-int update_aio_status(dbus_device* dbus_handle, dbus_cooler_stats_t* aio_stats);
+void set_telemetry_config(const telemetry_config_t* config);
+int update_telemetry(dbus_device* dbus_handle, const telemetry_t* telemetry, uint64_t now_us);
+int flush_telemetry(dbus_device* dbus_handle, uint64_t now_us);
+void log_telemetry_stats(void);
+void set_firmware_versions(int aio_version_high, int aio_version_low, int lcd_version);
+int update_daemon_state(dbus_device* dbus_handle, int active_mode, dbus_health_t health);
+int get_dbus_fd(dbus_device* dbus_handle);
+uint32_t get_dbus_events(dbus_device* dbus_handle);
+int process_dbus(dbus_device* dbus_handle);
+void set_dbus_control(const dbus_control_t* control);
+int watch_sleep(dbus_device* dbus_handle, dbus_sleep_handler_t handler, void *userdata);
 
 #endif
@@ -0,0 +1,358 @@
+#include "sensors_gpu.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+
+/** Maximum number of DRM file descriptors tracked by the fdinfo fallback */
+#define GPU_MAX_CLIENTS 128
+
+/** Number of /proc entries inspected per tick when looking for new DRM clients */
+#define GPU_SCAN_BUDGET 32
+
+/** Size of the buffer holding one fdinfo file */
+#define GPU_FDINFO_SIZE 1024
+
+struct gpu_client {
+    int fd_fdinfo;          // opened /proc/<pid>/fdinfo/<fd>, read with pread()
+    pid_t pid;
+    uint64_t client_id;     // drm-client-id, shared by dup()ed descriptors
+    uint64_t last_busy_ns;
+};
+
+static struct {
+    char root[PATH_MAX];
+
+    int fd_busy_percent;    // gpu_busy_percent of the first GPU providing it
+
+    // fdinfo fallback
+    struct gpu_client clients[GPU_MAX_CLIENTS];
+    int count;
+    DIR *proc_dir;          // kept open, /proc is walked GPU_SCAN_BUDGET entries per tick
+    struct timespec last_time;
+} gpu_bank = { .fd_busy_percent = -1 };
+
+/**
+ * Looks for a DRM card exposing the gpu_busy_percent attribute (amdgpu).
+ *
+ * @return Opened descriptor of the attribute, or -1 if no card provides it.
+ */
+static int open_busy_percent(void)
+{
+    char path[PATH_MAX];
+
+    // A root too long for the paths finds no card
+    if (snprintf(path, sizeof(path), "%s/sys/class/drm", gpu_bank.root) >= (int)sizeof(path))
+        return -1;
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+
+    int fd = -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Only cards, not connectors ("card0-DP-1") or render nodes
+        if (strncmp(entry->d_name, "card", 4) != 0 || strchr(entry->d_name, '-'))
+            continue;
+
+        if (snprintf(path, sizeof(path), "%s/sys/class/drm/%s/device/gpu_busy_percent", gpu_bank.root, entry->d_name) >= (int)sizeof(path))
+            continue;
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            loginfo("GPU usage from %s\n", path);
+            break;
+        }
+    }
+    closedir(dir);
+    return fd;
+}
+
+/**
+ * Parses the DRM usage stats of one fdinfo file.
+ *
+ * @param buf Contents of the fdinfo file.
+ * @param client_id Pointer to store the drm-client-id.
+ * @param busy_ns Pointer to store the time spent on the gfx/render engine.
+ * @return 1 if the file describes a DRM client, 0 otherwise.
+ */
+static int parse_fdinfo(const char *buf, uint64_t *client_id, uint64_t *busy_ns)
+{
+    int is_drm = 0;
+    const char *line = buf;
+
+    *busy_ns = 0;
+    while (line && *line) {
+        if (strncmp(line, "drm-client-id:", 14) == 0) {
+            *client_id = strtoull(line + 14, NULL, 10);
+            is_drm = 1;
+        } else if (strncmp(line, "drm-engine-gfx:", 15) == 0) {
+            *busy_ns += strtoull(line + 15, NULL, 10);
+        } else if (strncmp(line, "drm-engine-render:", 18) == 0) {
+            *busy_ns += strtoull(line + 18, NULL, 10);
+        }
+
+        line = strchr(line, '\n');
+        if (line)
+            line++;
+    }
+    return is_drm;
+}
+
+/**
+ * Reads a cached fdinfo handle.
+ *
+ * @param client The cached client.
+ * @param client_id Pointer to store the drm-client-id.
+ * @param busy_ns Pointer to store the engine busy time.
+ * @return 1 if the descriptor still refers to a DRM client, 0 otherwise.
+ */
+static int read_client(const struct gpu_client *client, uint64_t *client_id, uint64_t *busy_ns)
+{
+    char buf[GPU_FDINFO_SIZE];
+
+    ssize_t len = pread(client->fd_fdinfo, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return 0;
+
+    buf[len] = '\0';
+    return parse_fdinfo(buf, client_id, busy_ns);
+}
+
+/**
+ * Checks whether a client (or a dup of its descriptor) is already tracked.
+ */
+static int is_client_cached(uint64_t client_id)
+{
+    for (int i = 0; i < gpu_bank.count; i++) {
+        if (gpu_bank.clients[i].client_id == client_id)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Checks whether a process already has a tracked client.
+ */
+static int is_process_cached(pid_t pid)
+{
+    for (int i = 0; i < gpu_bank.count; i++) {
+        if (gpu_bank.clients[i].pid == pid)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Adds the DRM descriptors of a process to the client cache.
+ *
+ * @param pid The process to inspect.
+ */
+static void scan_process(pid_t pid)
+{
+    char path[PATH_MAX];
+    char target[64];
+
+    if (snprintf(path, sizeof(path), "%s/proc/%d/fd", gpu_bank.root, pid) >= (int)sizeof(path))
+        return;
+    DIR *dir = opendir(path);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && gpu_bank.count < GPU_MAX_CLIENTS) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        if (snprintf(path, sizeof(path), "%s/proc/%d/fd/%s", gpu_bank.root, pid, entry->d_name) >= (int)sizeof(path))
+            continue;
+        ssize_t len = readlink(path, target, sizeof(target) - 1);
+        if (len <= 0)
+            continue;
+
+        target[len] = '\0';
+        if (strncmp(target, "/dev/dri/", 9) != 0)
+            continue;
+
+        struct gpu_client *client = &gpu_bank.clients[gpu_bank.count];
+        if (snprintf(path, sizeof(path), "%s/proc/%d/fdinfo/%s", gpu_bank.root, pid, entry->d_name) >= (int)sizeof(path))
+            continue;
+        client->fd_fdinfo = open(path, O_RDONLY | O_CLOEXEC);
+        if (client->fd_fdinfo < 0)
+            continue;
+
+        uint64_t client_id, busy_ns;
+        if (!read_client(client, &client_id, &busy_ns) || is_client_cached(client_id)) {
+            close(client->fd_fdinfo);
+            continue;
+        }
+
+        client->pid = pid;
+        client->client_id = client_id;
+        client->last_busy_ns = busy_ns;
+        gpu_bank.count++;
+    }
+    closedir(dir);
+}
+
+/**
+ * Walks the next GPU_SCAN_BUDGET entries of /proc looking for new DRM clients.
+ * The walk restarts from the beginning once the end of /proc is reached.
+ */
+static void scan_proc_incremental(void)
+{
+    if (!gpu_bank.proc_dir)
+        return;
+
+    for (int budget = GPU_SCAN_BUDGET; budget > 0 && gpu_bank.count < GPU_MAX_CLIENTS; ) {
+        struct dirent *entry = readdir(gpu_bank.proc_dir);
+        if (!entry) {
+            rewinddir(gpu_bank.proc_dir);
+            break;
+        }
+
+        if (!isdigit((unsigned char)entry->d_name[0]))
+            continue;
+
+        budget--;
+
+        pid_t pid = (pid_t)atoi(entry->d_name);
+        if (!is_process_cached(pid))
+            scan_process(pid);
+    }
+}
+
+/**
+ * Removes a client from the cache.
+ *
+ * @param idx Index of the client in the cache.
+ */
+static void drop_client(int idx)
+{
+    close(gpu_bank.clients[idx].fd_fdinfo);
+    gpu_bank.clients[idx] = gpu_bank.clients[--gpu_bank.count];
+}
+
+/**
+ * Calculates the GPU usage from the DRM fdinfo engine counters.
+ *
+ * @return GPU usage percentage (0-100) since the previous call.
+ */
+static int get_fdinfo_usage(void)
+{
+    uint64_t busy_delta_ns = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < gpu_bank.count; ) {
+        struct gpu_client *client = &gpu_bank.clients[i];
+        uint64_t client_id, busy_ns;
+
+        // Process exited, descriptor closed or reused for another client
+        if (!read_client(client, &client_id, &busy_ns) || client_id != client->client_id) {
+            drop_client(i);
+            continue;
+        }
+
+        if (busy_ns > client->last_busy_ns)
+            busy_delta_ns += busy_ns - client->last_busy_ns;
+
+        client->last_busy_ns = busy_ns;
+        i++;
+    }
+
+    int64_t elapsed_ns = (now.tv_sec - gpu_bank.last_time.tv_sec) * 1000000000LL
+                       + (now.tv_nsec - gpu_bank.last_time.tv_nsec);
+    int first_call = gpu_bank.last_time.tv_sec == 0 && gpu_bank.last_time.tv_nsec == 0;
+    gpu_bank.last_time = now;
+
+    // Clients found now get their baseline and are accounted from the next tick
+    scan_proc_incremental();
+
+    if (first_call || elapsed_ns <= 0)
+        return 0;
+
+    uint64_t usage = busy_delta_ns * 100 / (uint64_t)elapsed_ns;
+    return usage > 100 ? 100 : (int)usage;
+}
+
+/**
+ * Sets up the GPU usage collector.
+ *
+ * The gpu_busy_percent attribute is used where the driver provides it,
+ * otherwise the usage is derived from the DRM fdinfo engine counters
+ * of the processes holding a /dev/dri descriptor.
+ *
+ * @param root Prefix prepended to sysfs and procfs paths ("" for the live system).
+ */
+int init_gpu_usage(const char *root)
+{
+    char path[PATH_MAX];
+
+    shutdown_gpu_usage();
+    snprintf(gpu_bank.root, sizeof(gpu_bank.root), "%s", root);
+
+    gpu_bank.fd_busy_percent = open_busy_percent();
+    if (gpu_bank.fd_busy_percent >= 0)
+        return 1;
+
+    if (snprintf(path, sizeof(path), "%s/proc", gpu_bank.root) < (int)sizeof(path))
+        gpu_bank.proc_dir = opendir(path);
+    if (!gpu_bank.proc_dir) {
+        loginfo("GPU usage not available.\n");
+        return 0;
+    }
+
+    loginfo("GPU usage from DRM fdinfo.\n");
+    return 1;
+}
+
+/**
+ * Closes all descriptors held by the GPU usage collector.
+ */
+void shutdown_gpu_usage(void)
+{
+    if (gpu_bank.fd_busy_percent >= 0)
+        close(gpu_bank.fd_busy_percent);
+
+    while (gpu_bank.count > 0)
+        drop_client(gpu_bank.count - 1);
+
+    if (gpu_bank.proc_dir)
+        closedir(gpu_bank.proc_dir);
+
+    memset(&gpu_bank, 0, sizeof(gpu_bank));
+    gpu_bank.fd_busy_percent = -1;
+}
+
+/**
+ * Reads the current GPU usage.
+ *
+ * @return GPU usage percentage (0-100), or 0 if not available.
+ */
+int get_gpu_usage(void)
+{
+    if (gpu_bank.fd_busy_percent >= 0) {
+        char buf[16];
+
+        ssize_t len = pread(gpu_bank.fd_busy_percent, buf, sizeof(buf) - 1, 0);
+        if (len <= 0)
+            return 0;
+
+        buf[len] = '\0';
+        return atoi(buf);
+    }
+
+    if (gpu_bank.proc_dir)
+        return get_fdinfo_usage();
+
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef _SENSORS_GPU__H
+#define _SENSORS_GPU__H
+
+int init_gpu_usage(const char *root);
+void shutdown_gpu_usage(void);
+int get_gpu_usage(void);
+
+#endif // _SENSORS_GPU__H
@@ -0,0 +1,148 @@
+#include "sensors_psi.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/** CPU pressure file, relative to the sensors root */
+#define PSI_CPU_PATH "/proc/pressure/cpu"
+
+/**
+ * Trigger: wake up when tasks were stalled on CPU for 150ms within a 1s window.
+ * The kernel limits the event rate to one per window.
+ */
+#define PSI_TRIGGER "some 150000 1000000"
+
+/** Rise of avg10 (in %) that counts as a pressure step when sampling */
+#define PSI_RISE_THRESHOLD 10
+
+static struct {
+    int fd;             // pressure file, also the trigger fd if armed
+    int trigger_armed;
+    int last_pressure;
+} psi_bank = { .fd = -1 };
+
+/**
+ * Opens the CPU pressure interface and arms a PSI trigger on it.
+ *
+ * With a fixture root the trigger interface is not available (the file
+ * is a regular file), so the pressure is only sampled and rises are
+ * detected by psi_pressure_rising().
+ *
+ * @param root Prefix prepended to procfs paths ("" for the live system).
+ * @return 1 if the pressure file is available, 0 otherwise.
+ */
+int init_psi(const char *root)
+{
+    char path[256];
+
+    shutdown_psi();
+
+    snprintf(path, sizeof(path), "%s" PSI_CPU_PATH, root);
+
+    if (root[0] == '\0') {
+        psi_bank.fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (psi_bank.fd >= 0) {
+            if (write(psi_bank.fd, PSI_TRIGGER, strlen(PSI_TRIGGER) + 1) >= 0) {
+                psi_bank.trigger_armed = 1;
+                loginfo("PSI trigger armed: %s\n", PSI_TRIGGER);
+                return 1;
+            }
+            logerror("Unable to arm PSI trigger, falling back to sampling.\n");
+            close(psi_bank.fd);
+        }
+    }
+
+    psi_bank.fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (psi_bank.fd < 0) {
+        loginfo("CPU pressure information not available.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Closes the pressure file and disarms the trigger.
+ */
+void shutdown_psi(void)
+{
+    if (psi_bank.fd >= 0)
+        close(psi_bank.fd);
+
+    psi_bank.fd = -1;
+    psi_bank.trigger_armed = 0;
+    psi_bank.last_pressure = 0;
+}
+
+/**
+ * Drops a trigger that failed (POLLERR or POLLHUP, e.g. the pressure
+ * interface went away) and falls back to sampling the pressure, so that
+ * the sampler does not poll a dead descriptor in a loop. Only armed on the
+ * live system, so the file is reopened from /.
+ */
+void disarm_psi_trigger(void)
+{
+    if (!psi_bank.trigger_armed)
+        return;
+
+    logerror("PSI trigger failed, falling back to sampling.\n");
+    shutdown_psi();
+
+    psi_bank.fd = open(PSI_CPU_PATH, O_RDONLY | O_CLOEXEC);
+    if (psi_bank.fd < 0)
+        loginfo("CPU pressure information not available.\n");
+}
+
+/**
+ * Returns the descriptor to poll for pressure events.
+ *
+ * The descriptor signals POLLPRI when the trigger fires.
+ *
+ * @return The trigger descriptor, or -1 if no trigger is armed.
+ */
+int get_psi_fd(void)
+{
+    return psi_bank.trigger_armed ? psi_bank.fd : -1;
+}
+
+/**
+ * Reads the "some" CPU pressure averaged over the last 10 seconds.
+ *
+ * @return Share of time (0-100 %) some tasks were stalled on CPU, or 0 on error.
+ */
+int get_cpu_pressure(void)
+{
+    char buf[256];
+    float avg10;
+
+    if (psi_bank.fd < 0)
+        return 0;
+
+    ssize_t len = pread(psi_bank.fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return 0;
+
+    buf[len] = '\0';
+    if (sscanf(buf, "some avg10=%f", &avg10) != 1)
+        return 0;
+
+    return (int)(avg10 + 0.5f);
+}
+
+/**
+ * Detects a pressure step between two consecutive samples.
+ *
+ * Used when no trigger is armed (sampling and fixture mode).
+ *
+ * @param pressure The latest value returned by get_cpu_pressure().
+ * @return 1 if the pressure rose by more than PSI_RISE_THRESHOLD, 0 otherwise.
+ */
+int psi_pressure_rising(int pressure)
+{
+    int rising = (pressure - psi_bank.last_pressure) > PSI_RISE_THRESHOLD;
+    psi_bank.last_pressure = pressure;
+    return rising;
+}
@@ -0,0 +1,11 @@
+#ifndef _SENSORS_PSI__H
+#define _SENSORS_PSI__H
+
+int init_psi(const char *root);
+void shutdown_psi(void);
+int get_psi_fd(void);
+void disarm_psi_trigger(void);
+int get_cpu_pressure(void);
+int psi_pressure_rising(int pressure);
+
+#endif // _SENSORS_PSI__H
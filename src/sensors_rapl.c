@@ -0,0 +1,212 @@
+#include "sensors_rapl.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+/** Maximum number of package domains (sockets) tracked */
+#define RAPL_MAX_PACKAGES 8
+
+/** Powercap class directory, relative to the sensors root */
+#define RAPL_POWERCAP_DIR "/sys/class/powercap"
+
+struct rapl_package {
+    int fd_energy;                  // opened energy_uj, read with pread()
+    uint64_t max_energy_range_uj;   // counter wraps around at this value
+    uint64_t last_energy_uj;
+};
+
+static struct {
+    struct rapl_package packages[RAPL_MAX_PACKAGES];
+    int count;
+    struct timespec last_time;
+    int primed;
+} rapl_bank;
+
+/**
+ * Reads an unsigned decimal value from a sysfs attribute.
+ *
+ * @param fd Descriptor of the attribute file.
+ * @param value Pointer to store the parsed value.
+ * @return 1 if a value was read, 0 otherwise.
+ */
+static int read_u64_fd(int fd, uint64_t *value)
+{
+    char buf[32];
+
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return 0;
+
+    buf[len] = '\0';
+    char *end;
+    *value = strtoull(buf, &end, 10);
+    return end != buf;
+}
+
+/**
+ * Reads an unsigned decimal value from a sysfs attribute given by path.
+ *
+ * @param path Path to the attribute file.
+ * @param value Pointer to store the parsed value.
+ * @return 1 if a value was read, 0 otherwise.
+ */
+static int read_u64_path(const char *path, uint64_t *value)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    int ret = read_u64_fd(fd, value);
+    close(fd);
+    return ret;
+}
+
+/**
+ * Checks whether a powercap zone is a top-level package domain: a zone
+ * directory such as "intel-rapl:0" (neither "intel-rapl" nor the subzone
+ * "intel-rapl:0:0") whose name attribute is "package-N". Other top-level
+ * zones, such as psys, include the package power and would count it twice.
+ *
+ * @param root Prefix prepended to sysfs paths.
+ * @param zone The directory entry name.
+ * @return 1 if the entry is a package zone, 0 otherwise.
+ */
+static int is_package_zone(const char *root, const char *zone)
+{
+    const char *prefix = "intel-rapl:";
+    size_t len = strlen(prefix);
+    char path[256];
+    char name[32] = "";
+
+    if (strncmp(zone, prefix, len) != 0 || zone[len] == '\0' || strchr(zone + len, ':') != NULL)
+        return 0;
+
+    if (snprintf(path, sizeof(path), "%s" RAPL_POWERCAP_DIR "/%s/name", root, zone) >= (int)sizeof(path))
+        return 0;
+    FILE *fp = fopen(path, "re");
+    if (!fp)
+        return 0;
+    int ret = fgets(name, sizeof(name), fp) != NULL && strncmp(name, "package-", strlen("package-")) == 0;
+    fclose(fp);
+
+    return ret;
+}
+
+/**
+ * Discovers the RAPL package domains under the powercap class and keeps
+ * their energy counters open for cheap per-tick reads.
+ *
+ * AMD processors are exposed through the same "intel-rapl" control type.
+ *
+ * @param root Prefix prepended to sysfs paths ("" for the live system,
+ *             or a fixture tree for testing).
+ * @return Number of package domains found.
+ */
+int init_rapl(const char *root)
+{
+    char path[256];
+
+    memset(&rapl_bank, 0, sizeof(rapl_bank));
+
+    DIR *dir = NULL;
+    if (snprintf(path, sizeof(path), "%s" RAPL_POWERCAP_DIR, root) < (int)sizeof(path))
+        dir = opendir(path);
+    if (!dir) {
+        loginfo("RAPL powercap interface not available.\n");
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && rapl_bank.count < RAPL_MAX_PACKAGES) {
+        if (!is_package_zone(root, entry->d_name))
+            continue;
+
+        struct rapl_package *package = &rapl_bank.packages[rapl_bank.count];
+
+        // Paths that do not fit are skipped rather than truncated
+        if (snprintf(path, sizeof(path), "%s" RAPL_POWERCAP_DIR "/%s/max_energy_range_uj", root, entry->d_name) >= (int)sizeof(path)
+                || !read_u64_path(path, &package->max_energy_range_uj))
+            continue;
+
+        if (snprintf(path, sizeof(path), "%s" RAPL_POWERCAP_DIR "/%s/energy_uj", root, entry->d_name) >= (int)sizeof(path))
+            continue;
+        package->fd_energy = open(path, O_RDONLY | O_CLOEXEC);
+        if (package->fd_energy < 0) {
+            logerror("Unable to open %s\n", path);
+            continue;
+        }
+
+        loginfo("RAPL package domain: %s\n", entry->d_name);
+        rapl_bank.count++;
+    }
+    closedir(dir);
+
+    return rapl_bank.count;
+}
+
+/**
+ * Closes the energy counters opened by init_rapl().
+ */
+void shutdown_rapl(void)
+{
+    for (int i = 0; i < rapl_bank.count; i++) {
+        close(rapl_bank.packages[i].fd_energy);
+    }
+    memset(&rapl_bank, 0, sizeof(rapl_bank));
+}
+
+/**
+ * Calculates the package power drawn since the previous call.
+ *
+ * Energy counters of all package domains are summed. A counter that went
+ * backwards has wrapped around at max_energy_range_uj.
+ *
+ * @return Package power in milliwatts, or 0 on the first call or on error.
+ */
+int get_rapl_package_power(void)
+{
+    uint64_t delta_uj = 0;
+    struct timespec now;
+
+    if (rapl_bank.count == 0)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < rapl_bank.count; i++) {
+        struct rapl_package *package = &rapl_bank.packages[i];
+        uint64_t energy_uj;
+
+        if (!read_u64_fd(package->fd_energy, &energy_uj))
+            continue;
+
+        if (energy_uj >= package->last_energy_uj) {
+            delta_uj += energy_uj - package->last_energy_uj;
+        } else {
+            delta_uj += package->max_energy_range_uj - package->last_energy_uj + energy_uj;
+        }
+        package->last_energy_uj = energy_uj;
+    }
+
+    int64_t elapsed_us = (now.tv_sec - rapl_bank.last_time.tv_sec) * 1000000LL
+                       + (now.tv_nsec - rapl_bank.last_time.tv_nsec) / 1000;
+    rapl_bank.last_time = now;
+
+    if (!rapl_bank.primed) {
+        rapl_bank.primed = 1;
+        return 0;
+    }
+
+    if (elapsed_us <= 0)
+        return 0;
+
+    // uJ / us = W, scaled to mW
+    return (int)(delta_uj * 1000 / (uint64_t)elapsed_us);
+}
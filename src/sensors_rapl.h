@@ -0,0 +1,8 @@
+#ifndef _SENSORS_RAPL__H
+#define _SENSORS_RAPL__H
+
+int init_rapl(const char *root);
+void shutdown_rapl(void);
+int get_rapl_package_power(void);
+
+#endif // _SENSORS_RAPL__H
@@ -0,0 +1,319 @@
+#include "sensors_sampler.h"
+#include "sensors_psi.h"
+#include "event_loop.h"
+#include "logger.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/** Stack of the sampler thread, locked in memory in real-time mode */
+#define SAMPLER_STACK_SIZE (256 * 1024)
+
+static struct {
+    pthread_t thread;
+    int running;
+    adaptive_rate_t rate;
+
+    // Configuration handed over by set_sampler_rate(), applied by the thread
+    pthread_mutex_t rate_lock;
+    adaptive_rate_config_t pending_rate;
+    atomic_int rate_changed;
+
+    int fd_stop;            // eventfd, wakes the sampler thread up to exit
+    int fd_event;           // eventfd, signalled to consumers on each new snapshot
+    int fd_timer;           // timerfd, armed at the absolute time of the next sample
+
+    // Seqlock protected snapshot: odd sequence while the writer is copying
+    _Atomic uint32_t sequence;
+    sensors_snapshot_t snapshot;
+} sampler = { .fd_stop = -1, .fd_event = -1, .fd_timer = -1, .rate_lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * Publishes a new snapshot.
+ *
+ * Only the sampler thread writes, so the seqlock needs no writer lock.
+ *
+ * @param snapshot The snapshot to publish.
+ */
+static void publish_snapshot(const sensors_snapshot_t *snapshot)
+{
+    uint32_t seq = atomic_load_explicit(&sampler.sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&sampler.sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(&sampler.snapshot, snapshot, sizeof(sampler.snapshot));
+
+    atomic_store_explicit(&sampler.sequence, seq + 2, memory_order_release);
+}
+
+/**
+ * Waits for the next sample.
+ *
+ * The deadline is absolute, so the time spent reading the sensors does not
+ * stretch the interval.
+ *
+ * @param deadline_us CLOCK_MONOTONIC time of the next sample in microseconds
+ * @return 1 if woken by a pressure event, 0 on timeout, -1 if asked to stop
+ */
+static int wait_next_sample(uint64_t deadline_us)
+{
+    struct pollfd pfds[3] = {
+        { .fd = sampler.fd_stop,  .events = POLLIN },
+        { .fd = sampler.fd_timer, .events = POLLIN },
+        { .fd = get_psi_fd(),     .events = POLLPRI },
+    };
+
+    set_timer_deadline(sampler.fd_timer, deadline_us);
+
+    int ret = poll(pfds, pfds[2].fd >= 0 ? 3 : 2, -1);
+    if (ret <= 0)
+        return 0;
+
+    if (pfds[0].revents & POLLIN)
+        return -1;
+
+    if (pfds[1].revents & POLLIN)
+        read_timer(sampler.fd_timer);
+
+    // A failed trigger would wake poll() at once forever, only the timer is left
+    if (pfds[2].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        disarm_psi_trigger();
+        return 0;
+    }
+
+    return (pfds[2].revents & POLLPRI) ? 1 : 0;
+}
+
+/**
+ * Sampler thread: reads the sensors at its own cadence so that slow sysfs
+ * reads never delay the HID and D-Bus work of the main loop.
+ *
+ * The cadence adapts to how fast the readings change, and drops to the
+ * floor interval on a CPU pressure step.
+ */
+static void* sampler_thread(__attribute__((unused)) void *arg)
+{
+    sensors_snapshot_t snapshot = {0};
+    struct timespec end;
+    int pressure_event = 0;
+
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &snapshot.timestamp);
+        fetch_sensor_values(&snapshot.values);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        snapshot.fetch_time_us = (end.tv_sec - snapshot.timestamp.tv_sec) * 1000000L
+                               + (end.tv_nsec - snapshot.timestamp.tv_nsec) / 1000;
+        snapshot.sample_nr++;
+
+        if (atomic_exchange(&sampler.rate_changed, 0)) {
+            pthread_mutex_lock(&sampler.rate_lock);
+            set_adaptive_rate_config(&sampler.rate, &sampler.pending_rate);
+            pthread_mutex_unlock(&sampler.rate_lock);
+        }
+
+        adaptive_rate_next(&sampler.rate, &snapshot.values, &snapshot.timestamp);
+
+        // Without a PSI trigger, a pressure step is detected between samples
+        if (psi_pressure_rising(snapshot.values.cpu_pressure) || pressure_event)
+            adaptive_rate_boost(&sampler.rate);
+
+        snapshot.interval_us = sampler.rate.interval_us;
+        memcpy(snapshot.time_at_rate_us, sampler.rate.time_at_rate_us, sizeof(snapshot.time_at_rate_us));
+        publish_snapshot(&snapshot);
+
+        uint64_t one = 1;
+        if (write(sampler.fd_event, &one, sizeof(one)) < 0) {
+            logerror("Unable to signal sampler event\n");
+        }
+
+        uint64_t start_us = (uint64_t)snapshot.timestamp.tv_sec * 1000000ULL + snapshot.timestamp.tv_nsec / 1000;
+        pressure_event = wait_next_sample(start_us + snapshot.interval_us);
+        if (pressure_event < 0)
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * Starts the sensor sampler thread.
+ *
+ * Sensors must be initialized and detected before.
+ *
+ * @param rate_config Bounds and slopes of the adaptive sampling interval.
+ * @return 1 if the thread was started, 0 otherwise.
+ */
+int start_sensors_sampler(const adaptive_rate_config_t *rate_config)
+{
+    if (sampler.running)
+        return 1;
+
+    init_adaptive_rate(&sampler.rate, rate_config);
+    atomic_store(&sampler.sequence, 0);
+
+    sampler.fd_stop = eventfd(0, EFD_CLOEXEC);
+    sampler.fd_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    sampler.fd_timer = create_timer();
+    if (sampler.fd_stop < 0 || sampler.fd_event < 0 || sampler.fd_timer < 0) {
+        logerror("Unable to create sampler eventfd\n");
+        stop_sensors_sampler();
+        return 0;
+    }
+
+    // Signals are handled by the main thread only
+    sigset_t all_signals, old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+    // The thread inherits the scheduling policy and CPU affinity of the caller
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SAMPLER_STACK_SIZE);
+
+    int ret = pthread_create(&sampler.thread, &attr, sampler_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        logerror("Unable to start sampler thread\n");
+        stop_sensors_sampler();
+        return 0;
+    }
+
+    sampler.running = 1;
+    return 1;
+}
+
+/**
+ * Stops the sensor sampler thread and waits for it to exit.
+ */
+void stop_sensors_sampler(void)
+{
+    if (sampler.running) {
+        uint64_t one = 1;
+        if (write(sampler.fd_stop, &one, sizeof(one)) < 0) {
+            logerror("Unable to stop sampler thread\n");
+        }
+        pthread_join(sampler.thread, NULL);
+        sampler.running = 0;
+
+        log_adaptive_rate_stats(sampler.rate.time_at_rate_us);
+    }
+
+    if (sampler.fd_stop >= 0)
+        close(sampler.fd_stop);
+    if (sampler.fd_event >= 0)
+        close(sampler.fd_event);
+    if (sampler.fd_timer >= 0)
+        close(sampler.fd_timer);
+
+    sampler.fd_stop = -1;
+    sampler.fd_event = -1;
+    sampler.fd_timer = -1;
+}
+
+/**
+ * Changes the bounds and slopes of the sampling interval without restarting
+ * the sampler. The thread picks the configuration up on its next sample,
+ * which is brought forward to now.
+ *
+ * @param rate_config The new configuration.
+ */
+void set_sampler_rate(const adaptive_rate_config_t *rate_config)
+{
+    if (!sampler.running) {
+        set_adaptive_rate_config(&sampler.rate, rate_config);
+        return;
+    }
+
+    pthread_mutex_lock(&sampler.rate_lock);
+    sampler.pending_rate = *rate_config;
+    pthread_mutex_unlock(&sampler.rate_lock);
+    atomic_store(&sampler.rate_changed, 1);
+
+    set_timer_deadline(sampler.fd_timer, monotonic_us());
+}
+
+/**
+ * Reads the sensors from the calling thread and publishes the snapshot,
+ * for use instead of the sampler thread (eco mode): the sensor reads then
+ * share the wakeup of the caller.
+ *
+ * @return 1 if a snapshot was published, 0 if the sampler thread is running.
+ */
+int sample_sensors_once(void)
+{
+    static sensors_snapshot_t snapshot;
+    struct timespec end;
+
+    if (sampler.running)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &snapshot.timestamp);
+    fetch_sensor_values(&snapshot.values);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    snapshot.fetch_time_us = (end.tv_sec - snapshot.timestamp.tv_sec) * 1000000L
+                           + (end.tv_nsec - snapshot.timestamp.tv_nsec) / 1000;
+    snapshot.sample_nr++;
+
+    publish_snapshot(&snapshot);
+    return 1;
+}
+
+/**
+ * Reads the latest published snapshot without blocking.
+ *
+ * The copy is retried only if it overlapped with the sampler publishing
+ * a new snapshot, which takes a few hundred nanoseconds once per interval.
+ *
+ * @param snapshot Pointer to store the snapshot.
+ * @return 1 if a snapshot was read, 0 if none was published yet.
+ */
+int read_sensors_snapshot(sensors_snapshot_t *snapshot)
+{
+    uint32_t seq_begin, seq_end;
+
+    do {
+        seq_begin = atomic_load_explicit(&sampler.sequence, memory_order_acquire);
+        if (seq_begin & 1)
+            continue;
+
+        memcpy(snapshot, &sampler.snapshot, sizeof(*snapshot));
+
+        atomic_thread_fence(memory_order_acquire);
+        seq_end = atomic_load_explicit(&sampler.sequence, memory_order_relaxed);
+    } while ((seq_begin & 1) || seq_begin != seq_end);
+
+    return seq_begin != 0;
+}
+
+/**
+ * Returns the descriptor signalled when the sampler publishes a new
+ * snapshot, so that consumers can react before their next tick.
+ *
+ * @return The eventfd, readable when an event is pending.
+ */
+int get_sampler_event_fd(void)
+{
+    return sampler.fd_event;
+}
+
+/**
+ * Acknowledges pending sampler events.
+ *
+ * @return 1 if an event was pending, 0 otherwise.
+ */
+int clear_sampler_event(void)
+{
+    uint64_t count;
+
+    return read(sampler.fd_event, &count, sizeof(count)) == sizeof(count);
+}
@@ -0,0 +1,28 @@
+#ifndef _SENSORS_SAMPLER__H
+#define _SENSORS_SAMPLER__H
+
+#include "sensors_wrap.h"
+#include "adaptive_rate.h"
+
+#include <stdint.h>
+#include <time.h>
+
+struct sensors_snapshot {
+    sensors_values_t values;
+    struct timespec timestamp;  // CLOCK_MONOTONIC time the sample was taken
+    uint32_t fetch_time_us;     // time spent in fetch_sensor_values()
+    uint64_t sample_nr;         // number of samples published so far
+    long interval_us;           // interval until the next sample
+    uint64_t time_at_rate_us[RATE_BUCKETS];
+};
+typedef struct sensors_snapshot sensors_snapshot_t;
+
+int start_sensors_sampler(const adaptive_rate_config_t *rate_config);
+void stop_sensors_sampler(void);
+void set_sampler_rate(const adaptive_rate_config_t *rate_config);
+int sample_sensors_once(void);
+int read_sensors_snapshot(sensors_snapshot_t *snapshot);
+int get_sampler_event_fd(void);
+int clear_sampler_event(void);
+
+#endif // _SENSORS_SAMPLER__H
@@ -1,13 +1,25 @@
 #include "sensors_wrap.h"
+#include "sensors_rapl.h"
+#include "sensors_psi.h"
+#include "sensors_gpu.h"
 #include "coreliquid_hid.h"
 #include "logger.h"
+#include "probes.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <sensors/sensors.h>
 
+/** Prefix for all sysfs/procfs paths ("" for the live system) */
+static char sensors_root[PATH_MAX] = "";
+
+/** Enabled SENSOR_* collectors, changed by the main thread while the sampler reads */
+static _Atomic unsigned int sensor_collectors = SENSOR_ALL;
+
 static struct {
     const sensors_chip_name *name_cpu_temp;
     int idx_cpu_temp;
@@ -124,6 +136,36 @@ int detect_sensor(
     return 1;
 }
 
+/**
+ * Sets the prefix prepended to every sysfs and procfs path read by the
+ * sensor layer. Used to run the collectors against a fixture tree.
+ *
+ * Must be called before init_sensors().
+ *
+ * @param root Directory containing the "sys" and "proc" trees, or NULL/""
+ *             for the live system.
+ */
+void set_sensors_root(const char *root)
+{
+    snprintf(sensors_root, sizeof(sensors_root), "%s", root ? root : "");
+
+    // Strip a trailing slash, paths are appended as "/sys/..."
+    size_t len = strlen(sensors_root);
+    if (len > 0 && sensors_root[len - 1] == '/') {
+        sensors_root[len - 1] = '\0';
+    }
+}
+
+/**
+ * Returns the prefix prepended to sysfs and procfs paths.
+ *
+ * @return The sensors root, "" for the live system.
+ */
+const char* get_sensors_root(void)
+{
+    return sensors_root;
+}
+
 /**
  * Initializes the libsensors library and clears the sensor bank.
  *
@@ -135,6 +177,10 @@ void init_sensors(void)
 {
     memset(&sensors_bank, 0, sizeof(sensors_bank));
 
+    init_rapl(sensors_root);
+    init_psi(sensors_root);
+    init_gpu_usage(sensors_root);
+
     int ret = sensors_init(NULL);
     if (ret != 0) {
         loginfo("Error while initializing libsensor: %d\n", ret);
@@ -151,6 +197,9 @@ void init_sensors(void)
  */
 void shutdown_sensors(void)
 {
+    shutdown_gpu_usage();
+    shutdown_psi();
+    shutdown_rapl();
     sensors_cleanup();
     memset(&sensors_bank, 0, sizeof(sensors_bank));
 }
@@ -215,16 +264,17 @@ int get_active_cores_avg_freq(void) {
     int num_procs = sysconf(_SC_NPROCESSORS_CONF);
 
     for (int i = 0; i < num_procs; i++) {
-        char path[128];
+        char path[PATH_MAX];
         long long cur, min;
+        FILE *f_cur = NULL, *f_min = NULL;
 
-        // Current frequency
-        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
-        FILE *f_cur = fopen(path, "r");
+        // Current frequency, a root too long for the path reads nothing
+        if (snprintf(path, sizeof(path), "%s/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", sensors_root, i) < (int)sizeof(path))
+            f_cur = fopen(path, "r");
 
         // Minimum frequency
-        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_min_freq", i);
-        FILE *f_min = fopen(path, "r");
+        if (snprintf(path, sizeof(path), "%s/sys/devices/system/cpu/cpu%d/cpufreq/scaling_min_freq", sensors_root, i) < (int)sizeof(path))
+            f_min = fopen(path, "r");
 
         if (f_cur && f_min) {
             if (fscanf(f_cur, "%lld", &cur) == 1 && fscanf(f_min, "%lld", &min) == 1) {
@@ -255,8 +305,11 @@ int get_cpu_usage(void)
     static long long last_total_idle, last_total;
     long long total_user, total_nice, total_system, total_idle, total;
     int result = 0;
+    char path[PATH_MAX];
 
-    FILE *fp = fopen("/proc/stat", "r");
+    FILE *fp = NULL;
+    if (snprintf(path, sizeof(path), "%s/proc/stat", sensors_root) < (int)sizeof(path))
+        fp = fopen(path, "r");
     if (fp == NULL) {
         return 0;
     }
@@ -277,12 +330,32 @@ int get_cpu_usage(void)
 }
 
 
+/**
+ * Selects the optional collectors read by fetch_sensor_values(). Disabled
+ * collectors report 0 and cost no file access. Takes effect on the next
+ * sample, without reinitializing the sensors.
+ *
+ * @param collectors Mask of SENSOR_* collectors.
+ */
+void set_sensor_collectors(unsigned int collectors)
+{
+    atomic_store(&sensor_collectors, collectors);
+}
+
+/** Reads a sensor between the sensor_start and sensor_end probes */
+#define READ_SENSOR(name, result, read) do { \
+        PROBE1(sensor_start, name); \
+        result = (read); \
+        PROBE2(sensor_end, name, result); \
+    } while (0)
+
 /**
  * Fetches the current sensor values and stores them in the provided data structure.
  *
  * @param data Pointer to a sensors_values_t structure where the sensor data will be stored.
  *
- * Each sensor value is only retrieved and stored if the corresponding sensor name in sensors_bank is not NULL.
+ * Each sensor value is only retrieved and stored if the corresponding sensor name in sensors_bank is not NULL
+ * and its collector is enabled.
  */
 void fetch_sensor_values(sensors_values_t *data)
 {
@@ -293,31 +366,43 @@ void fetch_sensor_values(sensors_values_t *data)
         return;
     }
 
-    data->cpu_freq = get_active_cores_avg_freq();
-    data->cpu_usage = get_cpu_usage();
+    unsigned int collectors = atomic_load(&sensor_collectors);
+
+    READ_SENSOR("cpu_freq", data->cpu_freq, (collectors & SENSOR_CPU_FREQ) ? get_active_cores_avg_freq() : 0);
+    READ_SENSOR("cpu_usage", data->cpu_usage, (collectors & SENSOR_CPU_USAGE) ? get_cpu_usage() : 0);
+    READ_SENSOR("cpu_power", data->cpu_power, (collectors & SENSOR_CPU_POWER) ? get_rapl_package_power() / 1000 : 0); // to W
+    READ_SENSOR("cpu_pressure", data->cpu_pressure, (collectors & SENSOR_CPU_PRESSURE) ? get_cpu_pressure() : 0);
+    READ_SENSOR("gpu_usage", data->gpu_usage, (collectors & SENSOR_GPU) ? get_gpu_usage() : 0);
 
     if (sensors_bank.name_cpu_temp != NULL) {
-        ret = sensors_get_value(sensors_bank.name_cpu_temp, sensors_bank.idx_cpu_temp, &value);
+        READ_SENSOR("cpu_temp", ret, sensors_get_value(sensors_bank.name_cpu_temp, sensors_bank.idx_cpu_temp, &value));
         if (ret == 0) {
             data->cpu_temp = (int)value;
         }
     }
 
+    if (!(collectors & SENSOR_GPU)) {
+        data->gpu_temp = 0;
+        data->gpu_freq = 0;
+        return;
+    }
+
     if (sensors_bank.name_gpu_temp != NULL) {
-        ret = sensors_get_value(sensors_bank.name_gpu_temp, sensors_bank.idx_gpu_temp, &value);
+        READ_SENSOR("gpu_temp", ret, sensors_get_value(sensors_bank.name_gpu_temp, sensors_bank.idx_gpu_temp, &value));
         if (ret == 0) {
             data->gpu_temp = (int)value;
         }
     }
 
     if (sensors_bank.name_gpu_freq != NULL) {
-        ret = sensors_get_value(sensors_bank.name_gpu_freq, sensors_bank.idx_gpu_freq, &value);
+        READ_SENSOR("gpu_freq", ret, sensors_get_value(sensors_bank.name_gpu_freq, sensors_bank.idx_gpu_freq, &value));
         if (ret == 0) {
             data->gpu_freq = (int)(value / 1000000); // to MHz
         }
     }
 #ifdef _DEBUG
     loginfo("Sensors data: cpu_freq=%d, cpu_temp=%d\n", data->cpu_freq, data->cpu_temp);
-    loginfo("Sensors data: gpu_freq=%d, gpu_temp=%d\n", data->gpu_freq, data->gpu_temp);
+    loginfo("Sensors data: gpu_freq=%d, gpu_temp=%d, gpu_usage=%d\n", data->gpu_freq, data->gpu_temp, data->gpu_usage);
+    loginfo("Sensors data: cpu_power=%d, cpu_pressure=%d\n", data->cpu_power, data->cpu_pressure);
 #endif
 }
@@ -7,13 +7,29 @@ struct sensors_values {
     int cpu_usage;
     int gpu_temp;
     int gpu_freq;
+    int gpu_usage;
+    int cpu_power;      // package power, W
+    int cpu_pressure;   // PSI "some" avg10, %
 };
 typedef struct sensors_values sensors_values_t;
 
+/** Optional collectors, the CPU temperature is always read */
+enum sensor_collector {
+    SENSOR_CPU_FREQ     = 0x01,
+    SENSOR_CPU_USAGE    = 0x02,
+    SENSOR_CPU_POWER    = 0x04,
+    SENSOR_CPU_PRESSURE = 0x08,
+    SENSOR_GPU          = 0x10,     // temperature, frequency and usage
+    SENSOR_ALL          = 0x1f
+};
+
+void set_sensors_root(const char *root);
+const char* get_sensors_root(void);
 void init_sensors(void);
 void shutdown_sensors(void);
 void detect_lm_sensors(void);
 void fetch_sensor_values(sensors_values_t *data);
+void set_sensor_collectors(unsigned int collectors);
 
 
 
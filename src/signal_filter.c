@@ -0,0 +1,135 @@
+#include "signal_filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Initializes a filter and clears its state and counters.
+ *
+ * @param filter The filter to initialize.
+ * @param config The filter chain configuration, copied into the filter.
+ */
+void init_signal_filter(signal_filter_t *filter, const filter_config_t *config)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->config = *config;
+
+    if (filter->config.median_len < 1)
+        filter->config.median_len = 1;
+    if (filter->config.median_len > FILTER_MEDIAN_MAX)
+        filter->config.median_len = FILTER_MEDIAN_MAX;
+    if (filter->config.ema_alpha <= 0.0f || filter->config.ema_alpha > 1.0f)
+        filter->config.ema_alpha = 1.0f;
+}
+
+/**
+ * Returns the median of the samples in the window.
+ *
+ * @param filter The filter holding the window.
+ * @return The median value.
+ */
+static int window_median(const signal_filter_t *filter)
+{
+    int sorted[FILTER_MEDIAN_MAX];
+    int count = filter->window_count;
+
+    // Insertion sort, the window holds at most FILTER_MEDIAN_MAX samples
+    for (int i = 0; i < count; i++) {
+        int value = filter->window[i];
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+    return sorted[count / 2];
+}
+
+/**
+ * Feeds a raw sample through the chain: median-of-N, EMA, deadband and
+ * rise/fall hysteresis.
+ *
+ * @param filter The filter.
+ * @param value The raw sample.
+ * @return 1 if the filtered output changed (and should be written to the
+ *         device), 0 if the sample was suppressed.
+ */
+int filter_sample(signal_filter_t *filter, int value)
+{
+    const filter_config_t *config = &filter->config;
+
+    filter->samples++;
+
+    filter->window[filter->window_pos] = value;
+    filter->window_pos = (filter->window_pos + 1) % config->median_len;
+    if (filter->window_count < config->median_len)
+        filter->window_count++;
+
+    int median = window_median(filter);
+
+    if (!filter->primed) {
+        filter->ema = median;
+        filter->output = median;
+        filter->primed = 1;
+        return 1;
+    }
+
+    filter->ema += config->ema_alpha * (median - filter->ema);
+    int smoothed = (int)(filter->ema >= 0 ? filter->ema + 0.5f : filter->ema - 0.5f);
+
+    int delta = smoothed - filter->output;
+    if (delta == 0
+            || abs(delta) < config->deadband
+            || (delta > 0 && delta < config->hysteresis_rise)
+            || (delta < 0 && -delta < config->hysteresis_fall)) {
+        filter->suppressed++;
+        return 0;
+    }
+
+    filter->output = smoothed;
+    return 1;
+}
+
+/**
+ * Parses a filter chain specification such as
+ * "median=5,ema=0.3,deadband=1,rise=1,fall=2".
+ * Keys not present keep their current value in config.
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to update.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_filter_config(const char *spec, filter_config_t *config)
+{
+    char buf[128];
+    char *saveptr;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(token, '=');
+        if (!value)
+            return 0;
+        *value++ = '\0';
+
+        if (!strcmp(token, "median")) {
+            config->median_len = atoi(value);
+            if (config->median_len < 1 || config->median_len > FILTER_MEDIAN_MAX)
+                return 0;
+        } else if (!strcmp(token, "ema")) {
+            config->ema_alpha = strtof(value, NULL);
+            if (config->ema_alpha <= 0.0f || config->ema_alpha > 1.0f)
+                return 0;
+        } else if (!strcmp(token, "deadband")) {
+            config->deadband = atoi(value);
+        } else if (!strcmp(token, "rise")) {
+            config->hysteresis_rise = atoi(value);
+        } else if (!strcmp(token, "fall")) {
+            config->hysteresis_fall = atoi(value);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
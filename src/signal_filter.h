@@ -0,0 +1,38 @@
+#ifndef _SIGNAL_FILTER__H
+#define _SIGNAL_FILTER__H
+
+#include <stdint.h>
+
+/** Largest median window supported */
+#define FILTER_MEDIAN_MAX 9
+
+struct filter_config {
+    int median_len;         // median-of-N window, 1 disables
+    float ema_alpha;        // exponential moving average weight of a new sample, 1 disables
+    int deadband;           // output holds while |change| < deadband
+    int hysteresis_rise;    // output rises only by at least this much
+    int hysteresis_fall;    // output falls only by at least this much
+};
+typedef struct filter_config filter_config_t;
+
+struct signal_filter {
+    filter_config_t config;
+
+    int window[FILTER_MEDIAN_MAX];
+    int window_pos;
+    int window_count;
+
+    float ema;
+    int output;
+    int primed;
+
+    uint32_t samples;       // samples fed to the filter
+    uint32_t suppressed;    // samples that did not change the output
+};
+typedef struct signal_filter signal_filter_t;
+
+void init_signal_filter(signal_filter_t *filter, const filter_config_t *config);
+int filter_sample(signal_filter_t *filter, int value);
+int parse_filter_config(const char *spec, filter_config_t *config);
+
+#endif // _SIGNAL_FILTER__H
@@ -0,0 +1,293 @@
+#include "task_scheduler.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "probes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Clears the scheduler.
+ *
+ * @param scheduler The scheduler to initialize.
+ */
+void init_scheduler(task_scheduler_t *scheduler)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+}
+
+/**
+ * Adds a periodic task to the scheduler.
+ *
+ * @param scheduler The scheduler.
+ * @param config Name, period, phase offset and priority of the task.
+ * @param run Function run when the task is due.
+ * @param userdata Passed to the task function.
+ * @return 1 on success, 0 if the scheduler is full or the period is invalid.
+ */
+int scheduler_add_task(task_scheduler_t *scheduler, const task_config_t *config, task_fn_t run, void *userdata)
+{
+    if (scheduler->count >= SCHEDULER_MAX_TASKS || config->period_us <= 0) {
+        logerror("Unable to schedule task %s\n", config->name);
+        return 0;
+    }
+
+    scheduler->tasks[scheduler->count++] = (scheduled_task_t) {
+        .name = config->name,
+        .period_us = config->period_us,
+        .phase_us = config->phase_us,
+        .priority = config->priority,
+        .run = run,
+        .userdata = userdata,
+    };
+    return 1;
+}
+
+/**
+ * Changes the period, phase offset and priority of a task added before,
+ * keeping its statistics. Takes effect on the next scheduler_start().
+ *
+ * @param scheduler The scheduler.
+ * @param config The new configuration, the task is looked up by name.
+ * @return 1 on success, 0 if the task is unknown or the period is invalid.
+ */
+int scheduler_configure_task(task_scheduler_t *scheduler, const task_config_t *config)
+{
+    scheduled_task_t *task = scheduler_find_task(scheduler, config->name);
+    if (!task || config->period_us <= 0) {
+        logerror("Unable to configure task %s\n", config->name);
+        return 0;
+    }
+
+    task->period_us = config->period_us;
+    task->phase_us = config->phase_us;
+    task->priority = config->priority;
+    return 1;
+}
+
+/**
+ * Lines all deadlines up on a coarse boundary, so that the tasks share as
+ * few wakeups as possible: periods are rounded up to a multiple of the
+ * boundary and phase offsets are dropped. Applies to the tasks added so far.
+ *
+ * @param scheduler The scheduler.
+ * @param align_us The boundary in microseconds.
+ */
+void scheduler_align(task_scheduler_t *scheduler, long align_us)
+{
+    scheduler->align_us = align_us;
+
+    for (int i = 0; i < scheduler->count; i++) {
+        scheduled_task_t *task = &scheduler->tasks[i];
+
+        task->period_us = (task->period_us + align_us - 1) / align_us * align_us;
+        task->phase_us = 0;
+    }
+}
+
+/**
+ * (Re)starts the schedule: each task first runs at now + its phase offset,
+ * or at the next boundary when the scheduler is aligned. Phase offsets keep
+ * tasks with a common period from bunching up.
+ *
+ * @param scheduler The scheduler.
+ * @param now_us Current CLOCK_MONOTONIC time in microseconds.
+ */
+void scheduler_start(task_scheduler_t *scheduler, uint64_t now_us)
+{
+    if (scheduler->align_us > 0)
+        now_us = (now_us + scheduler->align_us - 1) / scheduler->align_us * scheduler->align_us;
+
+    for (int i = 0; i < scheduler->count; i++) {
+        scheduler->tasks[i].next_due_us = now_us + scheduler->tasks[i].phase_us;
+    }
+}
+
+/**
+ * Runs a task now and records its run time. The schedule of the task is
+ * not changed.
+ *
+ * @param task The task to run.
+ */
+void scheduler_run_task(scheduled_task_t *task)
+{
+    uint64_t start_us = monotonic_us();
+    PROBE1(task_start, task->name);
+    task->run(task->userdata);
+    uint64_t run_us = monotonic_us() - start_us;
+    PROBE2(task_end, task->name, run_us);
+
+    task->runs++;
+    task->total_run_us += run_us;
+    if (run_us > task->max_run_us)
+        task->max_run_us = run_us;
+    record_jitter(&task->run_time, run_us);
+}
+
+/**
+ * Returns the earliest deadline of the tasks.
+ *
+ * @param scheduler The scheduler.
+ * @return Time of the next deadline in microseconds, 0 if there are no tasks.
+ */
+static uint64_t next_deadline(const task_scheduler_t *scheduler)
+{
+    uint64_t next_us = 0;
+
+    for (int i = 0; i < scheduler->count; i++) {
+        if (next_us == 0 || scheduler->tasks[i].next_due_us < next_us)
+            next_us = scheduler->tasks[i].next_due_us;
+    }
+    return next_us;
+}
+
+/**
+ * Runs a task now, out of its schedule (e.g. on an event), as a tick of
+ * its own for the probes, so that tracing sees every pass of the main
+ * loop. The schedule of the task is not changed.
+ *
+ * @param scheduler The scheduler.
+ * @param task The task to run.
+ * @param now_us Current CLOCK_MONOTONIC time in microseconds.
+ */
+void scheduler_run_now(task_scheduler_t *scheduler, scheduled_task_t *task, uint64_t now_us)
+{
+    PROBE2(tick_start, now_us, 1);
+    scheduler_run_task(task);
+    PROBE2(tick_end, 1, next_deadline(scheduler));
+}
+
+/**
+ * Runs all due tasks in priority order and advances their schedule.
+ *
+ * Deadlines advance by whole periods from the previous deadline, so the
+ * schedule does not drift. A task that starts more than a period late
+ * skips the periods it missed, and they are counted.
+ *
+ * @param scheduler The scheduler.
+ * @param now_us Current CLOCK_MONOTONIC time in microseconds.
+ * @return Time of the next deadline in microseconds, 0 if there are no tasks.
+ */
+uint64_t scheduler_run_due(task_scheduler_t *scheduler, uint64_t now_us)
+{
+    scheduled_task_t *due[SCHEDULER_MAX_TASKS];
+    int due_count = 0;
+
+    // Collect the due tasks sorted by priority
+    for (int i = 0; i < scheduler->count; i++) {
+        scheduled_task_t *task = &scheduler->tasks[i];
+        if (task->next_due_us > now_us)
+            continue;
+
+        int j = due_count++;
+        for (; j > 0 && due[j - 1]->priority > task->priority; j--) {
+            due[j] = due[j - 1];
+        }
+        due[j] = task;
+    }
+
+    PROBE2(tick_start, now_us, due_count);
+
+    for (int i = 0; i < due_count; i++) {
+        scheduled_task_t *task = due[i];
+
+        uint64_t start_us = monotonic_us();
+        uint64_t late_us = start_us > task->next_due_us ? start_us - task->next_due_us : 0;
+        if (late_us > task->max_late_us)
+            task->max_late_us = late_us;
+
+        scheduler_run_task(task);
+
+        task->next_due_us += task->period_us;
+        if (late_us >= (uint64_t)task->period_us) {
+            uint64_t skipped = late_us / task->period_us;
+            task->missed += skipped;
+            task->next_due_us += skipped * task->period_us;
+        }
+    }
+
+    uint64_t next_us = next_deadline(scheduler);
+
+    PROBE2(tick_end, due_count, next_us);
+    return next_us;
+}
+
+/**
+ * Looks a task up by name.
+ *
+ * @param scheduler The scheduler.
+ * @param name The task name.
+ * @return The task, or NULL if not found.
+ */
+scheduled_task_t* scheduler_find_task(task_scheduler_t *scheduler, const char *name)
+{
+    for (int i = 0; i < scheduler->count; i++) {
+        if (!strcmp(scheduler->tasks[i].name, name))
+            return &scheduler->tasks[i];
+    }
+    return NULL;
+}
+
+/**
+ * Parses task timings such as "temperature=250:0:0,cooler=2000:500".
+ * Each entry is name=period_ms[:phase_ms[:priority]]. Tasks not present
+ * keep their current configuration.
+ *
+ * @param spec The specification string.
+ * @param configs The task configurations to update.
+ * @param count Number of entries in configs.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_task_config(const char *spec, task_config_t *configs, int count)
+{
+    char buf[256];
+    char *saveptr;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(token, '=');
+        if (!value)
+            return 0;
+        *value++ = '\0';
+
+        task_config_t *config = NULL;
+        for (int i = 0; i < count; i++) {
+            if (!strcmp(configs[i].name, token))
+                config = &configs[i];
+        }
+        if (!config)
+            return 0;
+
+        long period_ms = 0, phase_ms = config->phase_us / 1000;
+        int priority = config->priority;
+        if (sscanf(value, "%ld:%ld:%d", &period_ms, &phase_ms, &priority) < 1 || period_ms <= 0 || phase_ms < 0)
+            return 0;
+
+        config->period_us = period_ms * 1000;
+        config->phase_us = phase_ms * 1000;
+        config->priority = priority;
+    }
+    return 1;
+}
+
+/**
+ * Logs the run time and missed deadline statistics of each task.
+ *
+ * @param scheduler The scheduler.
+ */
+void log_scheduler_stats(const task_scheduler_t *scheduler)
+{
+    for (int i = 0; i < scheduler->count; i++) {
+        const scheduled_task_t *task = &scheduler->tasks[i];
+
+        loginfo("Task %s: %llu runs, avg %llu us, max %llu us, max late %llu us, %llu missed\n",
+            task->name,
+            (unsigned long long)task->runs,
+            (unsigned long long)(task->runs ? task->total_run_us / task->runs : 0),
+            (unsigned long long)task->max_run_us,
+            (unsigned long long)task->max_late_us,
+            (unsigned long long)task->missed);
+    }
+}
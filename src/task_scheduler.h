@@ -0,0 +1,59 @@
+#ifndef _TASK_SCHEDULER__H
+#define _TASK_SCHEDULER__H
+
+#include "rt_mode.h"
+
+#include <stdint.h>
+
+/** Maximum number of tasks per scheduler */
+#define SCHEDULER_MAX_TASKS 8
+
+typedef void (*task_fn_t)(void *userdata);
+
+struct scheduled_task {
+    const char *name;
+    long period_us;
+    long phase_us;          // offset of the first run from the scheduler start
+    int priority;           // lower runs first when several tasks are due
+    task_fn_t run;
+    void *userdata;
+
+    uint64_t next_due_us;
+
+    uint64_t runs;
+    uint64_t missed;        // periods skipped because the task ran too late
+    uint64_t total_run_us;
+    uint64_t max_run_us;
+    uint64_t max_late_us;
+    jitter_histogram_t run_time;
+};
+typedef struct scheduled_task scheduled_task_t;
+
+struct task_scheduler {
+    scheduled_task_t tasks[SCHEDULER_MAX_TASKS];
+    int count;
+    long align_us;          // deadlines lined up on multiples of this, 0 for none
+};
+typedef struct task_scheduler task_scheduler_t;
+
+struct task_config {
+    const char *name;
+    long period_us;
+    long phase_us;
+    int priority;
+};
+typedef struct task_config task_config_t;
+
+void init_scheduler(task_scheduler_t *scheduler);
+int scheduler_add_task(task_scheduler_t *scheduler, const task_config_t *config, task_fn_t run, void *userdata);
+int scheduler_configure_task(task_scheduler_t *scheduler, const task_config_t *config);
+void scheduler_align(task_scheduler_t *scheduler, long align_us);
+void scheduler_start(task_scheduler_t *scheduler, uint64_t now_us);
+uint64_t scheduler_run_due(task_scheduler_t *scheduler, uint64_t now_us);
+void scheduler_run_task(scheduled_task_t *task);
+void scheduler_run_now(task_scheduler_t *scheduler, scheduled_task_t *task, uint64_t now_us);
+scheduled_task_t* scheduler_find_task(task_scheduler_t *scheduler, const char *name);
+int parse_task_config(const char *spec, task_config_t *configs, int count);
+void log_scheduler_stats(const task_scheduler_t *scheduler);
+
+#endif // _TASK_SCHEDULER__H
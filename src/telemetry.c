@@ -0,0 +1,114 @@
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Names in configuration specifications */
+const char* const telemetry_keys[METRIC_COUNT] = {
+    [METRIC_FAN_RADIATOR]    = "fan_radiator",
+    [METRIC_FAN_WATER_BLOCK] = "fan_water_block",
+    [METRIC_PUMP]            = "pump",
+    [METRIC_LIQUID_TEMP]     = "liquid_temp",
+    [METRIC_CPU_TEMP]        = "cpu_temp",
+    [METRIC_CPU_FREQ]        = "cpu_freq",
+    [METRIC_CPU_USAGE]       = "cpu_usage",
+    [METRIC_GPU_TEMP]        = "gpu_temp",
+    [METRIC_GPU_FREQ]        = "gpu_freq",
+    [METRIC_GPU_USAGE]       = "gpu_usage",
+};
+
+/** D-Bus property names */
+const char* const telemetry_properties[METRIC_COUNT] = {
+    [METRIC_FAN_RADIATOR]    = "FanRadiatorSpeed",
+    [METRIC_FAN_WATER_BLOCK] = "FanWaterBlockSpeed",
+    [METRIC_PUMP]            = "PumpSpeed",
+    [METRIC_LIQUID_TEMP]     = "LiquidTemp",
+    [METRIC_CPU_TEMP]        = "CpuTemp",
+    [METRIC_CPU_FREQ]        = "CpuFreq",
+    [METRIC_CPU_USAGE]       = "CpuUsage",
+    [METRIC_GPU_TEMP]        = "GpuTemp",
+    [METRIC_GPU_FREQ]        = "GpuFreq",
+    [METRIC_GPU_USAGE]       = "GpuUsage",
+};
+
+/**
+ * Initializes the emission configuration with the defaults: at most one
+ * emission per second, and deadbands below the noise of each reading.
+ *
+ * @param config The configuration to initialize.
+ */
+void init_telemetry_config(telemetry_config_t *config)
+{
+    *config = (telemetry_config_t) {
+        .min_interval_us = 1000000L,
+        .deadband = {
+            [METRIC_FAN_RADIATOR]    = 50,
+            [METRIC_FAN_WATER_BLOCK] = 50,
+            [METRIC_PUMP]            = 50,
+            [METRIC_LIQUID_TEMP]     = 0,
+            [METRIC_CPU_TEMP]        = 0,
+            [METRIC_CPU_FREQ]        = 100,
+            [METRIC_CPU_USAGE]       = 4,
+            [METRIC_GPU_TEMP]        = 0,
+            [METRIC_GPU_FREQ]        = 50,
+            [METRIC_GPU_USAGE]       = 4,
+        },
+    };
+}
+
+/**
+ * Looks a metric up by its configuration name.
+ *
+ * @param key The metric name, e.g. "cpu_temp".
+ * @return The metric, or -1 if unknown.
+ */
+int find_telemetry_metric(const char *key)
+{
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (!strcmp(telemetry_keys[i], key))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Parses an emission specification such as "interval=500,cpu_freq=200,pump=0".
+ * "interval" is the shortest time between emissions in ms, the other keys
+ * set the deadband of a metric. Keys not present keep their current value.
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to update.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_telemetry_config(const char *spec, telemetry_config_t *config)
+{
+    char buf[256];
+    char *saveptr;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    for (char *token = strtok_r(buf, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(token, '=');
+        if (!value)
+            return 0;
+        *value++ = '\0';
+
+        char *end;
+        long number = strtol(value, &end, 10);
+        if (end == value || *end != '\0' || number < 0)
+            return 0;
+
+        if (!strcmp(token, "interval")) {
+            config->min_interval_us = number * 1000;
+            continue;
+        }
+
+        int metric = find_telemetry_metric(token);
+        if (metric < 0 || number > UINT16_MAX)
+            return 0;
+
+        config->deadband[metric] = (int) number;
+    }
+    return 1;
+}
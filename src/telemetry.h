@@ -0,0 +1,41 @@
+#ifndef _TELEMETRY__H
+#define _TELEMETRY__H
+
+#include <stdint.h>
+
+/** Metrics published by the daemon */
+enum telemetry_metric {
+    METRIC_FAN_RADIATOR = 0,    // rpm
+    METRIC_FAN_WATER_BLOCK,     // rpm
+    METRIC_PUMP,                // rpm
+    METRIC_LIQUID_TEMP,         // C
+    METRIC_CPU_TEMP,            // C, conditioned
+    METRIC_CPU_FREQ,            // MHz, conditioned
+    METRIC_CPU_USAGE,           // %
+    METRIC_GPU_TEMP,            // C
+    METRIC_GPU_FREQ,            // MHz
+    METRIC_GPU_USAGE,           // %
+    METRIC_COUNT
+};
+typedef enum telemetry_metric telemetry_metric_t;
+
+struct telemetry {
+    uint16_t values[METRIC_COUNT];
+};
+typedef struct telemetry telemetry_t;
+
+/** Emission of telemetry changes to subscribers */
+struct telemetry_config {
+    long min_interval_us;           // shortest time between two emissions
+    int deadband[METRIC_COUNT];     // changes up to this much are not emitted
+};
+typedef struct telemetry_config telemetry_config_t;
+
+extern const char* const telemetry_keys[METRIC_COUNT];
+extern const char* const telemetry_properties[METRIC_COUNT];
+
+void init_telemetry_config(telemetry_config_t *config);
+int find_telemetry_metric(const char *key);
+int parse_telemetry_config(const char *spec, telemetry_config_t *config);
+
+#endif // _TELEMETRY__H
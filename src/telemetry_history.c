@@ -0,0 +1,174 @@
+#include "telemetry_history.h"
+
+#include <string.h>
+#include <time.h>
+
+/** Periods kept by each ring */
+#define HISTORY_SLOTS_1S    600     // 10 minutes
+#define HISTORY_SLOTS_10S   360     // 1 hour
+#define HISTORY_SLOTS_60S   1440    // 24 hours
+
+/** Sum of the ring sizes */
+#define HISTORY_TOTAL_SLOTS (HISTORY_SLOTS_1S + HISTORY_SLOTS_10S + HISTORY_SLOTS_60S)
+
+_Static_assert(HISTORY_SLOTS_1S <= HISTORY_MAX_SLOTS && HISTORY_SLOTS_10S <= HISTORY_MAX_SLOTS
+    && HISTORY_SLOTS_60S <= HISTORY_MAX_SLOTS, "a ring does not fit a query result");
+
+/** Rings of a metric: period length and number of periods kept */
+static const struct {
+    int resolution_s;
+    int slots;
+} history_rings[HISTORY_RESOLUTIONS] = {
+    {  1, HISTORY_SLOTS_1S },
+    { 10, HISTORY_SLOTS_10S },
+    { 60, HISTORY_SLOTS_60S },
+};
+
+struct history_bucket {
+    uint32_t period;        // boot time / resolution of the samples, identifies stale buckets
+    uint16_t count;         // 0 if no sample fell in the period
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+};
+
+/** All rings of all metrics, allocated once: recording never allocates */
+static struct {
+    struct history_bucket buckets[METRIC_COUNT][HISTORY_TOTAL_SLOTS];
+    int ring_offset[HISTORY_RESOLUTIONS];
+    uint32_t latest_period[METRIC_COUNT][HISTORY_RESOLUTIONS];
+} history;
+
+/**
+ * Clears the history.
+ *
+ * @return Memory used by the history in bytes.
+ */
+size_t init_telemetry_history(void)
+{
+    int offset = 0;
+
+    memset(&history, 0, sizeof(history));
+    for (int i = 0; i < HISTORY_RESOLUTIONS; i++) {
+        history.ring_offset[i] = offset;
+        offset += history_rings[i].slots;
+    }
+    return sizeof(history);
+}
+
+/**
+ * Returns the time the history is bucketed by: CLOCK_BOOTTIME, which a
+ * step of the wall clock does not move, and which unlike CLOCK_MONOTONIC
+ * goes on during suspend, so the periods slept through stay empty.
+ *
+ * @return Seconds since boot.
+ */
+uint64_t history_time_s(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return (uint64_t)now.tv_sec;
+}
+
+/**
+ * Returns the Unix time of the boot, at the current wall clock.
+ */
+static int64_t boot_unix_time_s(void)
+{
+    struct timespec realtime, boottime;
+
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_BOOTTIME, &boottime);
+    return (int64_t)realtime.tv_sec - (int64_t)boottime.tv_sec;
+}
+
+/**
+ * Adds a sample to the current period of every ring of a metric, keeping
+ * the min, max and sum of the period. A bucket left from an older period
+ * is reset first.
+ *
+ * @param metric The metric.
+ * @param value The sample.
+ * @param time_s Time of the sample (CLOCK_BOOTTIME seconds, see history_time_s()).
+ */
+void record_history(int metric, uint16_t value, uint64_t time_s)
+{
+    if (metric < 0 || metric >= METRIC_COUNT)
+        return;
+
+    for (int i = 0; i < HISTORY_RESOLUTIONS; i++) {
+        uint32_t period = (uint32_t)(time_s / history_rings[i].resolution_s);
+        struct history_bucket *bucket =
+            &history.buckets[metric][history.ring_offset[i] + period % history_rings[i].slots];
+
+        if (bucket->period != period || bucket->count == 0) {
+            *bucket = (struct history_bucket) {
+                .period = period,
+                .min = value,
+                .max = value,
+            };
+        }
+
+        if (bucket->count == UINT16_MAX)
+            continue;
+
+        if (value < bucket->min)
+            bucket->min = value;
+        if (value > bucket->max)
+            bucket->max = value;
+        bucket->sum += value;
+        bucket->count++;
+
+        history.latest_period[metric][i] = period;
+    }
+}
+
+/**
+ * Reads the periods of a metric at a resolution from a given time on,
+ * oldest first. Periods without samples are skipped. Times are converted
+ * between boot and Unix time at the current wall clock.
+ *
+ * @param metric The metric.
+ * @param resolution_s The period length: 1, 10 or 60 seconds.
+ * @param since_s Start time (Unix time), 0 for all the ring holds.
+ * @param series Filled with the periods.
+ * @return 1 on success, 0 if the metric or resolution is unknown.
+ */
+int query_history(int metric, int resolution_s, uint64_t since_s, history_series_t *series)
+{
+    int ring = 0;
+
+    if (metric < 0 || metric >= METRIC_COUNT)
+        return 0;
+
+    for (; ring < HISTORY_RESOLUTIONS && history_rings[ring].resolution_s != resolution_s; ring++) {}
+    if (ring == HISTORY_RESOLUTIONS)
+        return 0;
+
+    const struct history_bucket *buckets = &history.buckets[metric][history.ring_offset[ring]];
+    int slots = history_rings[ring].slots;
+    uint64_t latest = history.latest_period[metric][ring];
+    uint64_t first = latest >= (uint64_t) slots ? latest - slots + 1 : 0;
+    int64_t boot_s = boot_unix_time_s();
+
+    if (since_s > 0) {
+        uint64_t since_boot_s = (int64_t)since_s > boot_s ? since_s - boot_s : 0;
+        if (since_boot_s / resolution_s > first)
+            first = since_boot_s / resolution_s;
+    }
+
+    series->count = 0;
+    for (uint64_t period = first; period <= latest; period++) {
+        const struct history_bucket *bucket = &buckets[period % slots];
+        if (bucket->count == 0 || bucket->period != period)
+            continue;
+
+        int n = series->count++;
+        series->time_s[n] = period * resolution_s + boot_s;
+        series->min[n] = bucket->min;
+        series->max[n] = bucket->max;
+        series->mean[n] = (uint16_t)((bucket->sum + bucket->count / 2) / bucket->count);
+    }
+    return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef _TELEMETRY_HISTORY__H
+#define _TELEMETRY_HISTORY__H
+
+#include "telemetry.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Resolutions kept for every metric */
+#define HISTORY_RESOLUTIONS 3
+
+/** Buckets of the longest ring, the most a query returns */
+#define HISTORY_MAX_SLOTS 1440
+
+/** Min, max and mean of one metric over one period */
+struct history_series {
+    int count;
+    uint64_t time_s[HISTORY_MAX_SLOTS];     // start of each period (Unix time)
+    uint16_t min[HISTORY_MAX_SLOTS];
+    uint16_t max[HISTORY_MAX_SLOTS];
+    uint16_t mean[HISTORY_MAX_SLOTS];
+};
+typedef struct history_series history_series_t;
+
+size_t init_telemetry_history(void);
+uint64_t history_time_s(void);
+void record_history(int metric, uint16_t value, uint64_t time_s);
+int query_history(int metric, int resolution_s, uint64_t since_s, history_series_t *series);
+
+#endif // _TELEMETRY_HISTORY__H
@@ -0,0 +1,382 @@
+#include "telemetry_log.h"
+#include "coreliquid_log.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+_Static_assert(METRIC_COUNT <= CORELIQUID_LOG_METRICS, "telemetry does not fit the log records");
+_Static_assert((TELEMETRY_LOG_QUEUE_LEN & (TELEMETRY_LOG_QUEUE_LEN - 1)) == 0, "queue length must be a power of two");
+
+static struct {
+    void *map;
+    size_t size;
+    coreliquid_log_header_t *header;
+    coreliquid_log_block_t *blocks;
+    uint32_t block_count;
+
+    // Single-producer ring from the control thread to the writer thread
+    coreliquid_log_record_t queue[TELEMETRY_LOG_QUEUE_LEN];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint64_t dropped;
+
+    _Atomic int running;
+    _Atomic int stop;
+    int fd_event;
+    pthread_t thread;
+
+    // Writer thread state
+    coreliquid_log_block_t *current;    // NULL until the first record
+    uint32_t current_slot;
+    uint64_t seq;                       // of the current block
+    coreliquid_log_record_t previous;
+
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t blocks_started;
+} disk_log = { .fd_event = -1 };
+
+/**
+ * Parses a log specification "path[:cap_mb]" such as
+ * "/var/lib/coreliquid/telemetry.log:64".
+ *
+ * @param spec The specification string.
+ * @param config Pointer to the configuration to fill in.
+ * @return 1 if the specification is valid, 0 otherwise.
+ */
+int parse_telemetry_log_config(const char *spec, telemetry_log_config_t *config)
+{
+    long cap_mb = TELEMETRY_LOG_DEFAULT_CAP_MB;
+    size_t path_len = strlen(spec);
+
+    const char *colon = strrchr(spec, ':');
+    if (colon) {
+        char *end;
+        cap_mb = strtol(colon + 1, &end, 10);
+        if (*end != '\0' || cap_mb < 1)
+            return 0;
+        path_len = colon - spec;
+    }
+
+    if (path_len == 0 || path_len >= sizeof(config->path))
+        return 0;
+
+    snprintf(config->path, sizeof(config->path), "%.*s", (int)path_len, spec);
+    config->cap_bytes = cap_mb * 1024 * 1024;
+    return 1;
+}
+
+/**
+ * Checks whether an existing log has the layout of this daemon.
+ */
+static int is_log_compatible(const coreliquid_log_header_t *header, uint32_t block_count)
+{
+    if (header->magic != CORELIQUID_LOG_MAGIC || header->version != CORELIQUID_LOG_VERSION
+            || header->block_size != CORELIQUID_LOG_BLOCK_SIZE || header->block_count != block_count
+            || header->metric_count != METRIC_COUNT) {
+        return 0;
+    }
+
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (strncmp(header->metric_names[i], telemetry_keys[i], CORELIQUID_LOG_NAME_LEN))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Starts the next block of the ring, over the oldest one once it is full.
+ */
+static void start_next_block(void)
+{
+    disk_log.current_slot = (disk_log.current_slot + 1) % disk_log.block_count;
+    disk_log.current = &disk_log.blocks[disk_log.current_slot];
+    coreliquid_log_start_block(disk_log.current, ++disk_log.seq);
+    disk_log.blocks_started++;
+}
+
+/**
+ * Writes a record into the mapped log.
+ *
+ * @param record The record.
+ */
+static void write_record(const coreliquid_log_record_t *record)
+{
+    if (!disk_log.current)
+        start_next_block();
+
+    uint32_t used = disk_log.current->used;
+
+    // Full, or the clock went back
+    if (!coreliquid_log_append(disk_log.current, METRIC_COUNT, &disk_log.previous, record)) {
+        start_next_block();
+        used = 0;
+        coreliquid_log_append(disk_log.current, METRIC_COUNT, &disk_log.previous, record);
+    }
+
+    disk_log.previous = *record;
+    disk_log.records++;
+    disk_log.bytes += disk_log.current->used - used;
+}
+
+/**
+ * Writes the records queued by the control thread.
+ */
+static void drain_queue(void)
+{
+    uint32_t tail = atomic_load_explicit(&disk_log.tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&disk_log.head, memory_order_acquire);
+
+    for (; tail != head; tail++) {
+        write_record(&disk_log.queue[tail & (TELEMETRY_LOG_QUEUE_LEN - 1)]);
+        atomic_store_explicit(&disk_log.tail, tail + 1, memory_order_release);
+    }
+}
+
+/**
+ * Writer thread: wakes up when the queue is half full, and at least every
+ * TELEMETRY_LOG_FLUSH_MS, so that it adds few wakeups.
+ */
+static void* log_thread(__attribute__((unused)) void *arg)
+{
+    struct pollfd pfd = { .fd = disk_log.fd_event, .events = POLLIN };
+
+    while (!atomic_load(&disk_log.stop)) {
+        uint64_t count;
+
+        if (poll(&pfd, 1, TELEMETRY_LOG_FLUSH_MS) > 0 && read(disk_log.fd_event, &count, sizeof(count)) < 0)
+            continue;
+
+        drain_queue();
+    }
+    return NULL;
+}
+
+/**
+ * Starts the writer thread. If it cannot start, the records are written
+ * by the caller of append_telemetry_log().
+ */
+static void start_log_thread(void)
+{
+    atomic_store(&disk_log.stop, 0);
+
+    disk_log.fd_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (disk_log.fd_event < 0) {
+        logerror("Unable to create telemetry log eventfd, writing synchronously\n");
+        return;
+    }
+
+    // Signals are handled by the main thread only
+    sigset_t all_signals, old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    int ret = pthread_create(&disk_log.thread, NULL, log_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (ret != 0) {
+        close(disk_log.fd_event);
+        disk_log.fd_event = -1;
+        logerror("Unable to start telemetry log thread, writing synchronously\n");
+        return;
+    }
+
+    atomic_store(&disk_log.running, 1);
+}
+
+/**
+ * Moves aside a log of another size or with other metrics, to path.old,
+ * so that changing the configuration does not wipe it.
+ *
+ * @param path Path of the log.
+ * @param fd The log, closed.
+ * @return The descriptor of a new empty log, or -1 on error.
+ */
+static int rotate_log(const char *path, int fd)
+{
+    char old_path[sizeof(((telemetry_log_config_t*)0)->path) + 4];
+
+    close(fd);
+    snprintf(old_path, sizeof(old_path), "%s.old", path);
+    if (rename(path, old_path) < 0)
+        return -1;
+
+    loginfo("Telemetry log %s has another layout, moved to %s\n", path, old_path);
+    return open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+}
+
+/**
+ * Opens the telemetry log, or creates it. A log with the same size and
+ * metrics is continued after its newest block, any other one is moved to
+ * path.old and a new log is started.
+ *
+ * The file is mapped and the records are written by a thread: appending is
+ * a copy into a queue, so that neither a page fault nor the writeback of
+ * the pages ever stalls the control loop.
+ *
+ * @param config Path and size cap of the log.
+ * @return 1 on success, 0 otherwise.
+ */
+int open_telemetry_log(const telemetry_log_config_t *config)
+{
+    uint32_t block_count = (uint32_t)(config->cap_bytes / CORELIQUID_LOG_BLOCK_SIZE) - 1;
+    size_t size = (size_t)(block_count + 1) * CORELIQUID_LOG_BLOCK_SIZE;
+    struct stat st;
+
+    int fd = open(config->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        logerror("Unable to open telemetry log %s: %s\n", config->path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+
+    coreliquid_log_header_t header;
+    int compatible = (size_t)st.st_size == size
+        && pread(fd, &header, sizeof(header), 0) == sizeof(header)
+        && is_log_compatible(&header, block_count);
+
+    if (!compatible && st.st_size > 0) {
+        fd = rotate_log(config->path, fd);
+        if (fd < 0) {
+            logerror("Unable to replace telemetry log %s: %s\n", config->path, strerror(errno));
+            return 0;
+        }
+    }
+
+    if (!compatible && ftruncate(fd, size) < 0) {
+        logerror("Unable to size telemetry log %s: %s\n", config->path, strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        logerror("Unable to map telemetry log %s: %s\n", config->path, strerror(errno));
+        return 0;
+    }
+
+    memset(&disk_log, 0, sizeof(disk_log));
+    disk_log.map = map;
+    disk_log.size = size;
+    disk_log.header = map;
+    disk_log.blocks = (coreliquid_log_block_t*)((uint8_t*)map + CORELIQUID_LOG_BLOCK_SIZE);
+    disk_log.block_count = block_count;
+
+    if (compatible) {
+        // Continue after the newest block
+        disk_log.current_slot = block_count - 1;
+        for (uint32_t i = 0; i < block_count; i++) {
+            if (disk_log.blocks[i].seq > disk_log.seq) {
+                disk_log.seq = disk_log.blocks[i].seq;
+                disk_log.current_slot = i;
+            }
+        }
+        loginfo("Telemetry log %s: continuing after block %llu\n", config->path, (unsigned long long)disk_log.seq);
+    } else {
+        coreliquid_log_header_t *fresh = disk_log.header;
+        fresh->magic = CORELIQUID_LOG_MAGIC;
+        fresh->version = CORELIQUID_LOG_VERSION;
+        fresh->metric_count = METRIC_COUNT;
+        fresh->block_size = CORELIQUID_LOG_BLOCK_SIZE;
+        fresh->block_count = block_count;
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            snprintf(fresh->metric_names[i], CORELIQUID_LOG_NAME_LEN, "%s", telemetry_keys[i]);
+        }
+        disk_log.current_slot = block_count - 1;
+        loginfo("Telemetry log %s: new log of %u blocks\n", config->path, block_count);
+    }
+
+    start_log_thread();
+    return 1;
+}
+
+/**
+ * Appends the current values of all the metrics to the log. Never blocks:
+ * the record is queued for the writer thread, and dropped if the queue is
+ * full.
+ *
+ * @param telemetry The values.
+ */
+void append_telemetry_log(const telemetry_t *telemetry)
+{
+    if (!disk_log.map)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    coreliquid_log_record_t record = {
+        .time_ms = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000,
+    };
+    memcpy(record.values, telemetry->values, sizeof(telemetry->values));
+
+    if (!atomic_load_explicit(&disk_log.running, memory_order_relaxed)) {
+        write_record(&record);
+        return;
+    }
+
+    uint32_t head = atomic_load_explicit(&disk_log.head, memory_order_relaxed);
+    uint32_t queued = head - atomic_load_explicit(&disk_log.tail, memory_order_acquire);
+    if (queued == TELEMETRY_LOG_QUEUE_LEN) {
+        disk_log.dropped++;
+        return;
+    }
+
+    disk_log.queue[head & (TELEMETRY_LOG_QUEUE_LEN - 1)] = record;
+    atomic_store_explicit(&disk_log.head, head + 1, memory_order_release);
+
+    if (queued + 1 == TELEMETRY_LOG_QUEUE_LEN / 2) {
+        uint64_t one = 1;
+        if (write(disk_log.fd_event, &one, sizeof(one)) < 0) {
+            // Counter full: the thread has a wakeup pending anyway
+        }
+    }
+}
+
+/**
+ * Stops the writer thread after it has written the queued records, unmaps
+ * the log and logs its statistics.
+ */
+void close_telemetry_log(void)
+{
+    if (!disk_log.map)
+        return;
+
+    if (atomic_load(&disk_log.running)) {
+        atomic_store(&disk_log.running, 0);
+        atomic_store(&disk_log.stop, 1);
+
+        uint64_t one = 1;
+        if (write(disk_log.fd_event, &one, sizeof(one)) < 0) {
+            // Counter full: the thread has a wakeup pending anyway
+        }
+        pthread_join(disk_log.thread, NULL);
+        close(disk_log.fd_event);
+        disk_log.fd_event = -1;
+        drain_queue();
+    }
+
+    munmap(disk_log.map, disk_log.size);
+    disk_log.map = NULL;
+
+    if (disk_log.records > 0 || disk_log.dropped > 0) {
+        loginfo("Telemetry log: %llu records in %llu blocks, %.1f bytes per record, %llu dropped\n",
+            (unsigned long long)disk_log.records, (unsigned long long)disk_log.blocks_started,
+            disk_log.records ? (double)disk_log.bytes / disk_log.records : 0.0,
+            (unsigned long long)disk_log.dropped);
+    }
+}
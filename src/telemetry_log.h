@@ -0,0 +1,26 @@
+#ifndef _TELEMETRY_LOG__H
+#define _TELEMETRY_LOG__H
+
+#include "telemetry.h"
+
+/** Size cap of the log when none is given, in MB */
+#define TELEMETRY_LOG_DEFAULT_CAP_MB 32
+
+/** Records queued for the writer thread, a power of two; more are dropped */
+#define TELEMETRY_LOG_QUEUE_LEN     256
+
+/** Longest time a record waits in the queue, in ms */
+#define TELEMETRY_LOG_FLUSH_MS      1000
+
+struct telemetry_log_config {
+    char path[256];
+    long cap_bytes;
+};
+typedef struct telemetry_log_config telemetry_log_config_t;
+
+int parse_telemetry_log_config(const char *spec, telemetry_log_config_t *config);
+int open_telemetry_log(const telemetry_log_config_t *config);
+void append_telemetry_log(const telemetry_t *telemetry);
+void close_telemetry_log(void);
+
+#endif // _TELEMETRY_LOG__H
@@ -0,0 +1,112 @@
+#include "telemetry_shm.h"
+#include "coreliquid_shm.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+_Static_assert(METRIC_COUNT <= CORELIQUID_SHM_METRICS, "telemetry does not fit the shared-memory sample");
+
+static coreliquid_shm_t *segment;
+
+/**
+ * Creates the shared-memory segment (/dev/shm/my_msi_coreliquid), readable
+ * by everyone, and writes its header. A segment left by a previous run is
+ * replaced.
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+int open_telemetry_shm(void)
+{
+    shm_unlink(CORELIQUID_SHM_NAME);
+
+    int fd = shm_open(CORELIQUID_SHM_NAME, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        logerror("Unable to create shared memory %s: %s\n", CORELIQUID_SHM_NAME, strerror(errno));
+        return 0;
+    }
+
+    // Not affected by the umask
+    fchmod(fd, 0644);
+
+    if (ftruncate(fd, sizeof(coreliquid_shm_t)) < 0) {
+        logerror("Unable to size shared memory: %s\n", strerror(errno));
+        close(fd);
+        shm_unlink(CORELIQUID_SHM_NAME);
+        return 0;
+    }
+
+    void *map = mmap(NULL, sizeof(coreliquid_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        logerror("Unable to map shared memory: %s\n", strerror(errno));
+        shm_unlink(CORELIQUID_SHM_NAME);
+        return 0;
+    }
+
+    segment = map;
+    memset(segment, 0, sizeof(*segment));
+    segment->magic = CORELIQUID_SHM_MAGIC;
+    segment->version = CORELIQUID_SHM_VERSION;
+    segment->size = sizeof(coreliquid_shm_t);
+    segment->metric_count = METRIC_COUNT;
+    segment->writer_pid = getpid();
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        snprintf(segment->metric_names[i], CORELIQUID_SHM_NAME_LEN, "%s", telemetry_keys[i]);
+    }
+    return 1;
+}
+
+/**
+ * Publishes a sample as the latest one and appends it to the history ring.
+ *
+ * Only the main thread writes, so the seqlock needs no writer lock.
+ *
+ * @param telemetry The sample.
+ * @param time_us CLOCK_MONOTONIC time of the sample in microseconds.
+ */
+void publish_telemetry_shm(const telemetry_t *telemetry, uint64_t time_us)
+{
+    if (!segment)
+        return;
+
+    uint32_t seq = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&segment->sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint64_t sample_nr = segment->sample_count + 1;
+    coreliquid_shm_sample_t *sample = &segment->history[(sample_nr - 1) % CORELIQUID_SHM_HISTORY];
+
+    sample->time_us = time_us;
+    sample->sample_nr = sample_nr;
+    memcpy(sample->values, telemetry->values, sizeof(telemetry->values));
+    segment->latest = *sample;
+    segment->sample_count = sample_nr;
+
+    atomic_store_explicit(&segment->sequence, seq + 2, memory_order_release);
+}
+
+/**
+ * Marks the segment closed, so that readers know to reopen it, and removes it.
+ */
+void close_telemetry_shm(void)
+{
+    if (!segment)
+        return;
+
+    uint32_t seq = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    segment->closed = 1;
+    atomic_store_explicit(&segment->sequence, seq + 2, memory_order_release);
+
+    munmap(segment, sizeof(*segment));
+    shm_unlink(CORELIQUID_SHM_NAME);
+    segment = NULL;
+}
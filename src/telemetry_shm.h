@@ -0,0 +1,12 @@
+#ifndef _TELEMETRY_SHM__H
+#define _TELEMETRY_SHM__H
+
+#include "telemetry.h"
+
+#include <stdint.h>
+
+int open_telemetry_shm(void);
+void publish_telemetry_shm(const telemetry_t *telemetry, uint64_t time_us);
+void close_telemetry_shm(void);
+
+#endif // _TELEMETRY_SHM__H
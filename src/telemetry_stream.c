@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+#include "telemetry_stream.h"
+#include "coreliquid_stream.h"
+#include "event_loop.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+_Static_assert(METRIC_COUNT <= CORELIQUID_STREAM_METRICS, "telemetry does not fit the stream frames");
+
+struct stream_client {
+    int fd;                 // -1 when the slot is free
+    uid_t uid;
+    uint32_t metrics;       // subscription, 0 until the client sends one
+    int subscribed;         // 1 once the client sent a subscription
+    uint64_t connect_us;    // CLOCK_MONOTONIC time of the connection
+
+    // Frames the socket did not take yet, oldest at head
+    coreliquid_stream_sample_t queue[STREAM_QUEUE_LEN];
+    int head;
+    int count;
+    int epollout_armed;     // EPOLLOUT watched, until the queue drains
+
+    uint64_t sent;
+    uint64_t dropped;
+};
+
+static struct {
+    int fd_listen;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    struct stream_client clients[STREAM_MAX_CLIENTS];
+    uint64_t sample_nr;
+
+    uint64_t accepted;
+    uint64_t rejected;      // no free slot, too many for the user, invalid or no subscription
+    uint64_t sent;
+    uint64_t dropped;
+} stream = { .fd_listen = -1 };
+
+/**
+ * Disconnects a client and logs what it received.
+ *
+ * @param client The client.
+ */
+static void drop_client(struct stream_client *client)
+{
+    loginfo("Stream client %d left: %llu frames sent, %llu dropped\n", client->fd,
+        (unsigned long long)client->sent, (unsigned long long)client->dropped);
+
+    event_loop_remove(client->fd);
+    close(client->fd);
+    client->fd = -1;
+}
+
+/**
+ * Sends the queued frames until the socket is full, without blocking.
+ * Watches for EPOLLOUT while frames remain.
+ *
+ * @param client The client.
+ * @return 1 if the client is still connected, 0 if it was dropped.
+ */
+static int flush_client(struct stream_client *client)
+{
+    while (client->count > 0) {
+        coreliquid_stream_sample_t *sample = &client->queue[client->head];
+
+        sample->dropped = (uint32_t)client->dropped;
+        if (send(client->fd, sample, CORELIQUID_STREAM_SAMPLE_SIZE(sample->count), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+                break;
+
+            drop_client(client);
+            return 0;
+        }
+
+        client->head = (client->head + 1) % STREAM_QUEUE_LEN;
+        client->count--;
+        client->sent++;
+        stream.sent++;
+    }
+
+    // Only a change of state costs an epoll_ctl
+    if (client->count > 0 && !client->epollout_armed) {
+        event_loop_modify(client->fd, EPOLLIN | EPOLLOUT);
+        client->epollout_armed = 1;
+    } else if (client->count == 0 && client->epollout_armed) {
+        event_loop_modify(client->fd, EPOLLIN);
+        client->epollout_armed = 0;
+    }
+    return 1;
+}
+
+/**
+ * Queues a frame for a client. When the queue is full the oldest frame is
+ * dropped, so that a slow client gets the latest samples.
+ *
+ * @param client The client.
+ * @return The frame to fill in.
+ */
+static coreliquid_stream_sample_t* queue_frame(struct stream_client *client)
+{
+    if (client->count == STREAM_QUEUE_LEN) {
+        client->head = (client->head + 1) % STREAM_QUEUE_LEN;
+        client->count--;
+        client->dropped++;
+        stream.dropped++;
+    }
+
+    return &client->queue[(client->head + client->count++) % STREAM_QUEUE_LEN];
+}
+
+/**
+ * Reads a subscription from a client.
+ *
+ * @param client The client.
+ */
+static void read_subscription(struct stream_client *client)
+{
+    coreliquid_stream_subscribe_t subscribe;
+
+    ssize_t len = recv(client->fd, &subscribe, sizeof(subscribe), MSG_DONTWAIT | MSG_TRUNC);
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    if (len <= 0) {
+        drop_client(client);
+        return;
+    }
+
+    if (len != sizeof(subscribe) || subscribe.magic != CORELIQUID_STREAM_MAGIC
+            || subscribe.version != CORELIQUID_STREAM_VERSION) {
+        logerror("Invalid subscription from stream client %d\n", client->fd);
+        stream.rejected++;
+        drop_client(client);
+        return;
+    }
+
+    client->metrics = subscribe.metrics & ((1U << METRIC_COUNT) - 1);
+    client->subscribed = 1;
+}
+
+/**
+ * Drops the clients that did not subscribe in time, which would otherwise
+ * hold their slot forever.
+ *
+ * @param now_us CLOCK_MONOTONIC time in microseconds.
+ */
+static void drop_idle_clients(uint64_t now_us)
+{
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        struct stream_client *client = &stream.clients[i];
+
+        if (client->fd >= 0 && !client->subscribed && now_us > client->connect_us + STREAM_SUBSCRIBE_TIMEOUT_US) {
+            logerror("Stream client %d did not subscribe\n", client->fd);
+            stream.rejected++;
+            drop_client(client);
+        }
+    }
+}
+
+/**
+ * Counts the clients connected by a user.
+ *
+ * @param uid The user.
+ * @return Number of clients.
+ */
+static int count_clients(uid_t uid)
+{
+    int count = 0;
+
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (stream.clients[i].fd >= 0 && stream.clients[i].uid == uid)
+            count++;
+    }
+    return count;
+}
+
+/**
+ * Event loop handler of a client socket.
+ */
+static void on_client(__attribute__((unused)) int fd, uint32_t events, void *userdata)
+{
+    struct stream_client *client = userdata;
+
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        drop_client(client);
+        return;
+    }
+
+    if ((events & EPOLLOUT) && !flush_client(client))
+        return;
+
+    if (events & EPOLLIN)
+        read_subscription(client);
+}
+
+/**
+ * Event loop handler of the listening socket: accepts a client and sends
+ * it the hello.
+ */
+static void on_connect(int fd, __attribute__((unused)) uint32_t events, __attribute__((unused)) void *userdata)
+{
+    int fd_client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd_client < 0)
+        return;
+
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd_client, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+        close(fd_client);
+        return;
+    }
+
+    uint64_t now_us = monotonic_us();
+    drop_idle_clients(now_us);
+
+    if (cred.uid != 0 && count_clients(cred.uid) >= STREAM_MAX_CLIENTS_PER_UID) {
+        logerror("Too many stream clients for uid %u, rejecting one\n", (unsigned)cred.uid);
+        stream.rejected++;
+        close(fd_client);
+        return;
+    }
+
+    struct stream_client *client = NULL;
+    for (int i = 0; i < STREAM_MAX_CLIENTS && !client; i++) {
+        if (stream.clients[i].fd < 0)
+            client = &stream.clients[i];
+    }
+
+    if (!client) {
+        logerror("Too many stream clients, rejecting one\n");
+        stream.rejected++;
+        close(fd_client);
+        return;
+    }
+
+    coreliquid_stream_hello_t hello = {
+        .magic = CORELIQUID_STREAM_MAGIC,
+        .version = CORELIQUID_STREAM_VERSION,
+        .type = CORELIQUID_STREAM_HELLO,
+        .metric_count = METRIC_COUNT,
+    };
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        snprintf(hello.metric_names[i], CORELIQUID_STREAM_NAME_LEN, "%s", telemetry_keys[i]);
+    }
+
+    // A new connection always has room for the hello
+    if (send(fd_client, &hello, sizeof(hello), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(hello)
+            || !event_loop_add(fd_client, EPOLLIN, on_client, client)) {
+        close(fd_client);
+        return;
+    }
+
+    memset(client, 0, sizeof(*client));
+    client->fd = fd_client;
+    client->uid = cred.uid;
+    client->connect_us = now_us;
+    stream.accepted++;
+    loginfo("Stream client %d of uid %u connected\n", fd_client, (unsigned)cred.uid);
+}
+
+/**
+ * Creates the streaming socket, writable by everyone, and watches it in
+ * the event loop, which must be initialized. A socket left by a previous
+ * run is replaced. Any user can connect, so each user but root gets at
+ * most STREAM_MAX_CLIENTS_PER_UID slots, and a client must subscribe
+ * within STREAM_SUBSCRIBE_TIMEOUT_US to keep its slot.
+ *
+ * @param path Path of the socket.
+ * @return 1 on success, 0 otherwise.
+ */
+int open_telemetry_stream(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        stream.clients[i].fd = -1;
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        logerror("Stream socket path too long: %s\n", path);
+        return 0;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    stream.fd_listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (stream.fd_listen < 0) {
+        logerror("Unable to create stream socket: %s\n", strerror(errno));
+        return 0;
+    }
+
+    unlink(path);
+    if (bind(stream.fd_listen, (struct sockaddr*)&addr, sizeof(addr)) < 0
+            || chmod(path, 0666) < 0
+            || listen(stream.fd_listen, STREAM_MAX_CLIENTS) < 0) {
+        logerror("Unable to listen on %s: %s\n", path, strerror(errno));
+        close(stream.fd_listen);
+        stream.fd_listen = -1;
+        return 0;
+    }
+
+    if (!event_loop_add(stream.fd_listen, EPOLLIN, on_connect, NULL)) {
+        close(stream.fd_listen);
+        unlink(path);
+        stream.fd_listen = -1;
+        return 0;
+    }
+
+    snprintf(stream.path, sizeof(stream.path), "%s", path);
+    loginfo("Streaming telemetry on %s\n", path);
+    return 1;
+}
+
+/**
+ * Pushes a sample to the clients subscribed to one of the updated metrics.
+ *
+ * Frames go out with non-blocking sends. A client whose socket is full
+ * gets them queued, up to STREAM_QUEUE_LEN, and sent when it drains; the
+ * frames that do not fit are dropped and counted. The caller never waits
+ * on a client.
+ *
+ * @param telemetry The sample.
+ * @param first First metric updated.
+ * @param last Last metric updated.
+ * @param time_us CLOCK_MONOTONIC time of the sample in microseconds.
+ */
+void publish_telemetry_stream(const telemetry_t *telemetry, int first, int last, uint64_t time_us)
+{
+    if (stream.fd_listen < 0)
+        return;
+
+    uint32_t updated = ((2U << last) - 1) & ~((1U << first) - 1);
+    stream.sample_nr++;
+
+    drop_idle_clients(time_us);
+
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        struct stream_client *client = &stream.clients[i];
+        if (client->fd < 0 || !(client->metrics & updated))
+            continue;
+
+        coreliquid_stream_sample_t *sample = queue_frame(client);
+
+        sample->type = CORELIQUID_STREAM_SAMPLE;
+        sample->count = 0;
+        sample->reserved = 0;
+        sample->time_us = time_us;
+        sample->sample_nr = stream.sample_nr;
+        for (int metric = 0; metric < METRIC_COUNT; metric++) {
+            if (client->metrics & (1U << metric))
+                sample->values[sample->count++] = telemetry->values[metric];
+        }
+
+        // Only the first queued frame is sent right away, the others wait for EPOLLOUT
+        if (client->count == 1)
+            flush_client(client);
+    }
+}
+
+/**
+ * Disconnects the clients and removes the socket.
+ */
+void close_telemetry_stream(void)
+{
+    if (stream.fd_listen < 0)
+        return;
+
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (stream.clients[i].fd >= 0)
+            drop_client(&stream.clients[i]);
+    }
+
+    event_loop_remove(stream.fd_listen);
+    close(stream.fd_listen);
+    unlink(stream.path);
+    stream.fd_listen = -1;
+}
+
+/**
+ * Logs the number of clients served and of frames sent and dropped.
+ */
+void log_stream_stats(void)
+{
+    if (stream.accepted == 0 && stream.rejected == 0)
+        return;
+
+    loginfo("Stream: %llu clients (%llu rejected), %llu frames sent, %llu dropped\n",
+        (unsigned long long)stream.accepted, (unsigned long long)stream.rejected,
+        (unsigned long long)stream.sent, (unsigned long long)stream.dropped);
+}
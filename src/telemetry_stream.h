@@ -0,0 +1,25 @@
+#ifndef _TELEMETRY_STREAM__H
+#define _TELEMETRY_STREAM__H
+
+#include "telemetry.h"
+
+#include <stdint.h>
+
+/** Clients connected at the same time */
+#define STREAM_MAX_CLIENTS  8
+
+/** Clients of a same user, except root, so that one user cannot take all the slots */
+#define STREAM_MAX_CLIENTS_PER_UID  2
+
+/** Time a client has to send its first subscription before it is dropped */
+#define STREAM_SUBSCRIBE_TIMEOUT_US 5000000ULL
+
+/** Frames queued per client while its socket is full, the oldest are dropped */
+#define STREAM_QUEUE_LEN    32
+
+int open_telemetry_stream(const char *path);
+void publish_telemetry_stream(const telemetry_t *telemetry, int first, int last, uint64_t time_us);
+void close_telemetry_stream(void);
+void log_stream_stats(void);
+
+#endif // _TELEMETRY_STREAM__H
@@ -0,0 +1,179 @@
+/**
+ * Stand-in for logind on a private bus, to test suspend/resume handling
+ * without suspending the machine.
+ *
+ * Owns org.freedesktop.login1, hands out delay inhibitors and emits
+ * PrepareForSleep cycles. Reports how long the inhibitors delayed each
+ * sleep.
+ *
+ *     dbus-daemon --session --address=unix:path=/tmp/coreliquid_bus --nofork &
+ *     fake_logind unix:path=/tmp/coreliquid_bus 10 3 &
+ *     my_msi_coreliquid_driver -B unix:path=/tmp/coreliquid_bus -M 5 startd
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <systemd/sd-bus.h>
+
+/** Longest time an inhibitor may delay sleep, as logind's InhibitDelayMaxSec */
+#define INHIBIT_DELAY_MAX_US (5 * 1000000ULL)
+
+#define MAX_INHIBITORS 16
+
+static struct {
+    int fds[MAX_INHIBITORS];    // our end of each inhibitor pipe, -1 when free
+} inhibitors;
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/**
+ * Inhibit(what, who, why, mode): returns the write end of a pipe. The
+ * inhibitor is released when the caller closes it.
+ */
+static int method_inhibit(sd_bus_message *message, __attribute__((unused)) void *userdata, sd_bus_error *ret_error)
+{
+    const char *what, *who, *why, *mode;
+    int pipe_fds[2];
+    int slot = -1;
+
+    int result = sd_bus_message_read(message, "ssss", &what, &who, &why, &mode);
+    if (result < 0)
+        return result;
+
+    for (int i = 0; i < MAX_INHIBITORS; i++) {
+        if (inhibitors.fds[i] < 0)
+            slot = i;
+    }
+    if (slot < 0 || pipe2(pipe_fds, O_CLOEXEC) < 0)
+        return sd_bus_error_setf(ret_error, SD_BUS_ERROR_FAILED, "Too many inhibitors");
+
+    printf("Inhibitor taken by %s for %s (%s): %s\n", who, what, mode, why);
+    inhibitors.fds[slot] = pipe_fds[0];
+
+    result = sd_bus_reply_method_return(message, "h", pipe_fds[1]);
+    close(pipe_fds[1]);
+    return result;
+}
+
+static const sd_bus_vtable manager_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("Inhibit", "ssss", "h", method_inhibit, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_SIGNAL("PrepareForSleep", "b", 0),
+    SD_BUS_VTABLE_END
+};
+
+/**
+ * Processes bus messages until the given time.
+ */
+static int run_bus(sd_bus *bus, uint64_t until_us)
+{
+    while (now_us() < until_us) {
+        int result = sd_bus_process(bus, NULL);
+        if (result < 0)
+            return result;
+        if (result > 0)
+            continue;
+
+        result = sd_bus_wait(bus, until_us - now_us());
+        if (result < 0 && result != -EINTR)
+            return result;
+    }
+    return 0;
+}
+
+/**
+ * Processes bus messages until all inhibitors are released or the
+ * maximum delay has elapsed.
+ *
+ * @return Time the inhibitors delayed sleep in microseconds.
+ */
+static uint64_t wait_inhibitors(sd_bus *bus)
+{
+    uint64_t start_us = now_us();
+
+    while (now_us() - start_us < INHIBIT_DELAY_MAX_US) {
+        int held = 0;
+
+        for (int i = 0; i < MAX_INHIBITORS; i++) {
+            if (inhibitors.fds[i] < 0)
+                continue;
+
+            struct pollfd pfd = { .fd = inhibitors.fds[i], .events = POLLIN };
+            if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLIN))) {
+                close(inhibitors.fds[i]);
+                inhibitors.fds[i] = -1;
+            } else {
+                held++;
+            }
+        }
+        if (held == 0)
+            break;
+
+        run_bus(bus, now_us() + 1000);
+    }
+    return now_us() - start_us;
+}
+
+int main(int argc, char *argv[])
+{
+    sd_bus *bus = NULL;
+    int result;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s address [interval_s [cycles]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    long interval_s = argc > 2 ? atol(argv[2]) : 10;
+    long cycles = argc > 3 ? atol(argv[3]) : 1;
+
+    for (int i = 0; i < MAX_INHIBITORS; i++) {
+        inhibitors.fds[i] = -1;
+    }
+
+    if ((result = sd_bus_new(&bus)) < 0
+            || (result = sd_bus_set_address(bus, argv[1])) < 0
+            || (result = sd_bus_set_bus_client(bus, 1)) < 0
+            || (result = sd_bus_start(bus)) < 0
+            || (result = sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/login1",
+                    "org.freedesktop.login1.Manager", manager_vtable, NULL)) < 0
+            || (result = sd_bus_request_name(bus, "org.freedesktop.login1", 0)) < 0) {
+        fprintf(stderr, "Unable to set up logind stand-in on %s: %s\n", argv[1], strerror(-result));
+        sd_bus_unref(bus);
+        return EXIT_FAILURE;
+    }
+
+    for (long cycle = 0; cycle < cycles; cycle++) {
+        if (run_bus(bus, now_us() + interval_s * 1000000ULL) < 0)
+            break;
+
+        sd_bus_emit_signal(bus, "/org/freedesktop/login1", "org.freedesktop.login1.Manager", "PrepareForSleep", "b", 1);
+        sd_bus_flush(bus);
+        printf("Sleep delayed by inhibitors for %llu ms\n", (unsigned long long)(wait_inhibitors(bus) / 1000));
+
+        // "Asleep": nothing is processed
+        sleep(1);
+
+        sd_bus_emit_signal(bus, "/org/freedesktop/login1", "org.freedesktop.login1.Manager", "PrepareForSleep", "b", 0);
+        sd_bus_flush(bus);
+        printf("Resumed\n");
+    }
+
+    // Let the clients take their inhibitors again before exiting
+    run_bus(bus, now_us() + 1000000ULL);
+    sd_bus_flush_close_unref(bus);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/**
+ * Benchmark of the shared-memory telemetry reader: maps the segment of a
+ * running daemon and reads the latest sample in a tight loop, then reports
+ * the cost per read, the retries caused by the daemon publishing, and the
+ * age of the samples.
+ *
+ * With -w, no daemon is needed: the benchmark creates the segment itself
+ * and a thread publishes synthetic samples at the given rate while the
+ * reads run, as the daemon does.
+ *
+ *     shm_bench [-w hz] [reads [metric]]
+ *     shm_bench 10000000 cpu_temp
+ *     shm_bench -w 1000 10000000
+ */
+#include "coreliquid_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static coreliquid_shm_t *segment;
+static _Atomic int writing;
+
+/**
+ * Creates the segment as the daemon does, with a single metric. Fails if
+ * the daemon already publishes it.
+ *
+ * @param name Name of the metric.
+ * @return 1 on success, 0 otherwise.
+ */
+static int create_segment(const char *name)
+{
+    int fd = shm_open(CORELIQUID_SHM_NAME, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create %s: %s\n", CORELIQUID_SHM_NAME, strerror(errno));
+        return 0;
+    }
+
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(coreliquid_shm_t)) == 0)
+        map = mmap(NULL, sizeof(coreliquid_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s: %s\n", CORELIQUID_SHM_NAME, strerror(errno));
+        shm_unlink(CORELIQUID_SHM_NAME);
+        return 0;
+    }
+
+    segment = map;
+    memset(segment, 0, sizeof(*segment));
+    segment->magic = CORELIQUID_SHM_MAGIC;
+    segment->version = CORELIQUID_SHM_VERSION;
+    segment->size = sizeof(coreliquid_shm_t);
+    segment->metric_count = 1;
+    segment->writer_pid = getpid();
+    snprintf(segment->metric_names[0], CORELIQUID_SHM_NAME_LEN, "%s", name);
+    return 1;
+}
+
+/**
+ * Publishes a sample under the seqlock, as publish_telemetry_shm() does.
+ */
+static void publish(uint64_t time_us)
+{
+    uint32_t seq = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&segment->sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint64_t sample_nr = segment->sample_count + 1;
+    coreliquid_shm_sample_t *sample = &segment->history[(sample_nr - 1) % CORELIQUID_SHM_HISTORY];
+
+    sample->time_us = time_us;
+    sample->sample_nr = sample_nr;
+    sample->values[0] = 300 + sample_nr % 100;
+    segment->latest = *sample;
+    segment->sample_count = sample_nr;
+
+    atomic_store_explicit(&segment->sequence, seq + 2, memory_order_release);
+}
+
+/**
+ * Writer thread: publishes at the requested rate until the reads are done.
+ *
+ * @param arg Pointer to the rate in Hz.
+ */
+static void* writer(void *arg)
+{
+    uint64_t period_ns = 1000000000ULL / *(long*) arg;
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (atomic_load(&writing)) {
+        publish(now_ns() / 1000);
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    long write_hz = 0;
+    pthread_t writer_thread;
+
+    if (argc > 2 && strcmp(argv[1], "-w") == 0) {
+        write_hz = atol(argv[2]);
+        if (write_hz <= 0 || write_hz > 1000000) {
+            fprintf(stderr, "Invalid rate %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    long reads = argc > 1 ? atol(argv[1]) : 10000000L;
+    const char *name = argc > 2 ? argv[2] : "cpu_temp";
+    coreliquid_shm_sample_t sample = { 0 };
+    coreliquid_shm_sample_t history[CORELIQUID_SHM_HISTORY];
+
+    if (write_hz) {
+        if (!create_segment(name))
+            return EXIT_FAILURE;
+        publish(now_ns() / 1000);
+        atomic_store(&writing, 1);
+        if (pthread_create(&writer_thread, NULL, writer, &write_hz) != 0) {
+            fprintf(stderr, "Unable to start the writer\n");
+            shm_unlink(CORELIQUID_SHM_NAME);
+            return EXIT_FAILURE;
+        }
+    }
+
+    coreliquid_reader_t *reader = coreliquid_shm_open();
+    if (!reader) {
+        fprintf(stderr, "Unable to open %s: %s\n", CORELIQUID_SHM_NAME, strerror(errno));
+        if (write_hz) {
+            atomic_store(&writing, 0);
+            pthread_join(writer_thread, NULL);
+            shm_unlink(CORELIQUID_SHM_NAME);
+        }
+        return EXIT_FAILURE;
+    }
+
+    int metric = coreliquid_shm_metric(reader, name);
+    if (metric < 0) {
+        fprintf(stderr, "Unknown metric %s\n", name);
+        coreliquid_shm_close(reader);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t checksum = 0, samples_seen = 0, last_nr = 0;
+    uint64_t start_ns = now_ns();
+    for (long i = 0; i < reads; i++) {
+        if (coreliquid_shm_read(reader, &sample) < 0) {
+            fprintf(stderr, errno == EBUSY ? "Daemon stuck writing\n" : "Daemon stopped\n");
+            break;
+        }
+        checksum += sample.values[metric];
+        if (sample.sample_nr != last_nr) {
+            samples_seen++;
+            last_nr = sample.sample_nr;
+        }
+    }
+    uint64_t elapsed_ns = now_ns() - start_ns;
+
+    if (write_hz) {
+        atomic_store(&writing, 0);
+        pthread_join(writer_thread, NULL);
+    }
+
+    int n = coreliquid_shm_read_history(reader, history, CORELIQUID_SHM_HISTORY);
+    uint64_t age_us = (now_ns() / 1000) - sample.time_us;
+
+    printf("%ld reads in %.3f s: %.1f ns/read, %llu retries\n", reads, elapsed_ns / 1e9,
+        reads ? (double) elapsed_ns / reads : 0.0, (unsigned long long) coreliquid_shm_retries(reader));
+    printf("%llu samples published during the run, last #%llu %s=%u, %llu us old (checksum %llu)\n",
+        (unsigned long long) samples_seen, (unsigned long long) sample.sample_nr, name,
+        sample.values[metric], (unsigned long long) age_us, (unsigned long long) checksum);
+    if (n > 1) {
+        printf("History: %d samples over %.1f s\n", n, (history[n - 1].time_us - history[0].time_us) / 1e6);
+    }
+
+    coreliquid_shm_close(reader);
+    if (write_hz) {
+        munmap(segment, sizeof(*segment));
+        shm_unlink(CORELIQUID_SHM_NAME);
+    }
+    return EXIT_SUCCESS;
+}
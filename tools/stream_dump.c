@@ -0,0 +1,116 @@
+/**
+ * Subscriber of the telemetry stream: connects to the socket of a running
+ * daemon, subscribes to the given metrics (all by default) and prints every
+ * frame, along with the frames the daemon dropped for it. With -d the
+ * client sleeps after each frame, to see a slow subscriber being dropped.
+ *
+ *     stream_dump [-p path] [-d delay_ms] [metric ...]
+ *     stream_dump cpu_temp cpu_freq
+ */
+#include "coreliquid_stream.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int main(int argc, char *argv[])
+{
+    const char *path = CORELIQUID_STREAM_PATH;
+    long delay_ms = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:d:")) != -1) {
+        switch (opt) {
+            case 'p':
+                path = optarg;
+                break;
+
+            case 'd':
+                delay_ms = atol(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-p path] [-d delay_ms] [metric ...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Unable to connect to %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    coreliquid_stream_hello_t hello;
+    if (recv(fd, &hello, sizeof(hello), 0) != sizeof(hello) || hello.magic != CORELIQUID_STREAM_MAGIC
+            || hello.version != CORELIQUID_STREAM_VERSION || hello.type != CORELIQUID_STREAM_HELLO
+            || hello.metric_count > CORELIQUID_STREAM_METRICS) {
+        fprintf(stderr, "Unexpected hello from %s\n", path);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    coreliquid_stream_subscribe_t subscribe = {
+        .magic = CORELIQUID_STREAM_MAGIC,
+        .version = CORELIQUID_STREAM_VERSION,
+    };
+    for (int i = optind; i < argc; i++) {
+        int metric = -1;
+        for (int m = 0; m < hello.metric_count; m++) {
+            if (!strncmp(hello.metric_names[m], argv[i], CORELIQUID_STREAM_NAME_LEN))
+                metric = m;
+        }
+        if (metric < 0) {
+            fprintf(stderr, "Unknown metric %s\n", argv[i]);
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        subscribe.metrics |= 1U << metric;
+    }
+    if (!subscribe.metrics)
+        subscribe.metrics = (1U << hello.metric_count) - 1;
+
+    if (send(fd, &subscribe, sizeof(subscribe), MSG_NOSIGNAL) != sizeof(subscribe)) {
+        fprintf(stderr, "Unable to subscribe: %s\n", strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    coreliquid_stream_sample_t sample = { .dropped = 0 };
+    uint64_t frames = 0, last_nr = 0;
+    ssize_t len;
+    while ((len = recv(fd, &sample, sizeof(sample), 0)) > 0) {
+        if ((size_t)len < CORELIQUID_STREAM_SAMPLE_SIZE(0) || sample.type != CORELIQUID_STREAM_SAMPLE
+                || (size_t)len != CORELIQUID_STREAM_SAMPLE_SIZE(sample.count)) {
+            fprintf(stderr, "Malformed frame of %zd bytes\n", len);
+            break;
+        }
+
+        printf("#%llu %llu.%06llu", (unsigned long long)sample.sample_nr,
+            (unsigned long long)(sample.time_us / 1000000), (unsigned long long)(sample.time_us % 1000000));
+        for (int m = 0, v = 0; m < hello.metric_count && v < sample.count; m++) {
+            if (subscribe.metrics & (1U << m))
+                printf(" %s=%u", hello.metric_names[m], sample.values[v++]);
+        }
+        if (last_nr && sample.sample_nr != last_nr + 1)
+            printf(" (skipped %llu, %u dropped)", (unsigned long long)(sample.sample_nr - last_nr - 1), sample.dropped);
+        printf("\n");
+        fflush(stdout);
+
+        last_nr = sample.sample_nr;
+        frames++;
+        if (delay_ms > 0)
+            usleep(delay_ms * 1000);
+    }
+
+    printf("%llu frames, %u dropped by the daemon\n", (unsigned long long)frames, sample.dropped);
+    close(fd);
+    return EXIT_SUCCESS;
+}
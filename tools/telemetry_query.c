@@ -0,0 +1,269 @@
+/**
+ * Offline query of the telemetry log: maps the log read-only and prints the
+ * records of a time range as CSV (-m selects the metrics), their minimum,
+ * maximum and mean (-a), or the block index (-i). Times are Unix seconds,
+ * negative ones are relative to now. Aggregates use the block index for
+ * the blocks entirely in the range and only decode the two ends.
+ *
+ *     telemetry_query [-s since] [-u until] [-m metric,...] [-a | -i] log
+ *     telemetry_query -s -86400 -m cpu_temp,liquid_temp -a /var/lib/my_msi_coreliquid/telemetry.log
+ */
+#include "coreliquid_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct aggregate {
+    uint64_t count;
+    uint64_t sum;
+    uint16_t min;
+    uint16_t max;
+};
+
+static const coreliquid_log_header_t *header;
+static const coreliquid_log_block_t *blocks;
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Converts a time argument in seconds (with a fraction) to Unix ms,
+ * negative ones being relative to now.
+ */
+static uint64_t parse_time(const char *arg)
+{
+    double seconds = atof(arg);
+
+    if (seconds < 0)
+        return now_ms() + (int64_t)(seconds * 1000);
+    return (uint64_t)(seconds * 1000);
+}
+
+static void print_time(uint64_t time_ms)
+{
+    time_t seconds = (time_t)(time_ms / 1000);
+    struct tm tm;
+    char text[32];
+
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &tm));
+    printf("%s.%03u", text, (unsigned)(time_ms % 1000));
+}
+
+static int compare_seq(const void *a, const void *b)
+{
+    uint64_t seq_a = blocks[*(const uint32_t*)a].seq;
+    uint64_t seq_b = blocks[*(const uint32_t*)b].seq;
+
+    return (seq_a > seq_b) - (seq_a < seq_b);
+}
+
+/**
+ * Parses a list of metric names into a mask.
+ */
+static uint32_t parse_metrics(char *list)
+{
+    uint32_t mask = 0;
+    char *saveptr;
+
+    for (char *name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        int found = 0;
+        for (int i = 0; i < header->metric_count; i++) {
+            if (!strncmp(header->metric_names[i], name, CORELIQUID_LOG_NAME_LEN)) {
+                mask |= 1U << i;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown metric %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return mask;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t since_ms = 0, until_ms = UINT64_MAX;
+    char *metric_list = NULL;
+    int aggregate = 0, index = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:u:m:ai")) != -1) {
+        switch (opt) {
+            case 's':
+                since_ms = parse_time(optarg);
+                break;
+
+            case 'u':
+                until_ms = parse_time(optarg);
+                break;
+
+            case 'm':
+                metric_list = optarg;
+                break;
+
+            case 'a':
+                aggregate = 1;
+                break;
+
+            case 'i':
+                index = 1;
+                break;
+
+            default:
+                optind = argc;
+                break;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-s since] [-u until] [-m metric,...] [-a | -i] log\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *path = argv[optind];
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < 2 * CORELIQUID_LOG_BLOCK_SIZE) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, fd < 0 ? strerror(errno) : "too small");
+        return EXIT_FAILURE;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    header = map;
+    blocks = (const coreliquid_log_block_t*)((const uint8_t*)map + CORELIQUID_LOG_BLOCK_SIZE);
+    if (header->magic != CORELIQUID_LOG_MAGIC || header->version != CORELIQUID_LOG_VERSION
+            || header->block_size != CORELIQUID_LOG_BLOCK_SIZE || header->metric_count > CORELIQUID_LOG_METRICS
+            || (size_t)st.st_size < (header->block_count + 1ULL) * CORELIQUID_LOG_BLOCK_SIZE) {
+        fprintf(stderr, "%s is not a telemetry log\n", path);
+        return EXIT_FAILURE;
+    }
+
+    int metric_count = header->metric_count;
+    uint32_t metrics = metric_list ? parse_metrics(metric_list) : (1U << metric_count) - 1;
+
+    // Blocks in the order they were written
+    uint32_t *order = malloc(header->block_count * sizeof(*order));
+    if (!order) {
+        fprintf(stderr, "Out of memory for %u blocks\n", header->block_count);
+        return EXIT_FAILURE;
+    }
+    uint32_t used_blocks = 0;
+    for (uint32_t i = 0; i < header->block_count; i++) {
+        if (blocks[i].seq != 0 && blocks[i].records > 0)
+            order[used_blocks++] = i;
+    }
+    qsort(order, used_blocks, sizeof(*order), compare_seq);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct aggregate totals[CORELIQUID_LOG_METRICS];
+    for (int m = 0; m < metric_count; m++) {
+        totals[m] = (struct aggregate) { .min = UINT16_MAX };
+    }
+    uint32_t scanned = 0, decoded = 0;
+
+    if (!aggregate && !index) {
+        printf("time");
+        for (int m = 0; m < metric_count; m++) {
+            if (metrics & (1U << m))
+                printf(",%s", header->metric_names[m]);
+        }
+        printf("\n");
+    }
+
+    for (uint32_t b = 0; b < used_blocks; b++) {
+        const coreliquid_log_block_t *block = &blocks[order[b]];
+        if (block->last_ms < since_ms || block->first_ms > until_ms)
+            continue;
+        scanned++;
+
+        if (index) {
+            printf("#%llu ", (unsigned long long)block->seq);
+            print_time(block->first_ms);
+            printf(" - ");
+            print_time(block->last_ms);
+            printf(": %u records, %u bytes\n", block->records, block->used);
+            continue;
+        }
+
+        // Whole block in the range: its index is enough
+        if (aggregate && block->first_ms >= since_ms && block->last_ms <= until_ms) {
+            for (int m = 0; m < metric_count; m++) {
+                struct aggregate *total = &totals[m];
+                total->count += block->records;
+                total->sum += block->sum[m];
+                if (block->min[m] < total->min)
+                    total->min = block->min[m];
+                if (block->max[m] > total->max)
+                    total->max = block->max[m];
+            }
+            continue;
+        }
+
+        coreliquid_log_record_t record;
+        uint32_t offset = 0;
+        decoded++;
+        while (coreliquid_log_next(block, metric_count, &offset, &record)) {
+            if (record.time_ms < since_ms || record.time_ms > until_ms)
+                continue;
+
+            if (aggregate) {
+                for (int m = 0; m < metric_count; m++) {
+                    struct aggregate *total = &totals[m];
+                    total->count++;
+                    total->sum += record.values[m];
+                    if (record.values[m] < total->min)
+                        total->min = record.values[m];
+                    if (record.values[m] > total->max)
+                        total->max = record.values[m];
+                }
+            } else {
+                print_time(record.time_ms);
+                for (int m = 0; m < metric_count; m++) {
+                    if (metrics & (1U << m))
+                        printf(",%u", record.values[m]);
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    if (aggregate) {
+        printf("metric,count,min,max,mean\n");
+        for (int m = 0; m < metric_count; m++) {
+            if (!(metrics & (1U << m)) || totals[m].count == 0)
+                continue;
+            printf("%s,%llu,%u,%u,%.2f\n", header->metric_names[m], (unsigned long long)totals[m].count,
+                totals[m].min, totals[m].max, (double)totals[m].sum / totals[m].count);
+        }
+
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        fprintf(stderr, "%u of %u blocks in range, %u decoded, %.3f ms\n", scanned, used_blocks, decoded,
+            (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    }
+
+    free(order);
+    munmap(map, st.st_size);
+    return EXIT_SUCCESS;
+}
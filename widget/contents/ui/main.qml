@@ -9,25 +9,29 @@ import org.kde.plasma.plasmoid
 import org.kde.plasma.core as PlasmaCore
 import org.kde.plasma.components 3.0 as PlasmaComponents
 import org.kde.plasma.plasma5support as Plasma5Support
+import org.kde.plasma.workspace.dbus as DBus
 import org.kde.kirigami as Kirigami
 
 PlasmoidItem {
     id: root
 
-    // Current active mode (default -1 until detected)
-    property string activeMode: "-1"
-    property int fanRadiatorSpeed: 0
-    property int fanWaterBlockSpeed: 0
-    property int pumpSpeed: 0
-    property int waterTemp: 0
-
-    readonly property string getListSysctlUnits: `systemctl list-units --state=active --no-legend \
-                                                 'my_msi_coreliquid_driver@*'`
+    // Daemon properties, kept up to date by its PropertiesChanged signals
+    DBus.Properties {
+        id: daemon
+        busType: DBus.BusType.System
+        service: "io.github.MSICoreliquid"
+        path: "/io/github/MSICoreliquid"
+        iface: "io.github.MSICoreliquid"
+    }
 
-    readonly property string getAllPropsCmd: `qdbus --system io.github.MSICoreliquid \
-                                              /io/github/MSICoreliquid \
-                                              org.freedesktop.DBus.Properties.GetAll \
-                                              io.github.MSICoreliquid`
+    // Current active mode (-1 while the daemon is not running)
+    readonly property string activeMode: daemon.properties.ActiveMode !== undefined
+                                         ? daemon.properties.ActiveMode.toString() : "-1"
+    readonly property string health: daemon.properties.Health ?? ""
+    readonly property int fanRadiatorSpeed: daemon.properties.FanRadiatorSpeed ?? 0
+    readonly property int fanWaterBlockSpeed: daemon.properties.FanWaterBlockSpeed ?? 0
+    readonly property int pumpSpeed: daemon.properties.PumpSpeed ?? 0
+    readonly property int waterTemp: daemon.properties.LiquidTemp ?? 0
 
     Plasmoid.backgroundHints: PlasmaCore.Types.DefaultBackground | PlasmaCore.Types.ConfigurableBackground
 
@@ -38,13 +42,6 @@ PlasmoidItem {
     compactRepresentation: compactComp
     fullRepresentation: fullComp
 
-    function doUpdate() {
-        executable.connectSource(getListSysctlUnits)
-        if (plasmoid.configuration.showSensors) {
-            executable.connectSource(getAllPropsCmd)
-        }
-    }
-
     function get_mode_name(mode_id) {
         switch (mode_id) {
             case "0": return "silent";
@@ -55,19 +52,17 @@ PlasmoidItem {
         }
     }
 
-    onActiveModeChanged: {
+    function updateStatus() {
         var mode_name = get_mode_name(root.activeMode);
         var icon_path = "../icons/fan-" + mode_name + ".png";
 
         plasmoid.icon = Qt.resolvedUrl(icon_path);
-        root.toolTipSubText = "Current Mode: " + mode_name;
+        root.toolTipSubText = "Current Mode: " + mode_name
+                            + (root.health !== "" && root.health !== "ok" ? " (" + root.health + ")" : "");
     }
 
-    onExpandedChanged: {
-        if (root.expanded) {
-            doUpdate();
-        }
-    }
+    onActiveModeChanged: updateStatus()
+    onHealthChanged: updateStatus()
 
     Plasma5Support.DataSource {
         id: executable
@@ -75,51 +70,17 @@ PlasmoidItem {
         connectedSources: []
 
         onNewData: (sourceName, data) => {
-            if (sourceName.indexOf("list-units") !== -1) {
-                let match = data.stdout.match(/@(\d)/);
-                root.activeMode = match ? match[1] : "-1";
-                disconnectSource(sourceName);
-            }
-            else if (sourceName.indexOf("io.github.MSICoreliquid") !== -1) {
-                let lines = data.stdout.split('\n');
-                lines.forEach(line => {
-                    let parts = line.split(':');
-                    if (parts.length >= 2) {
-                        let name = parts[0].trim();
-                        let value = parseInt(parts[1].trim());
-
-                        if (name === "FanRadiatorSpeed") root.fanRadiatorSpeed = value;
-                        else if (name === "FanWaterBlockSpeed") root.fanWaterBlockSpeed = value;
-                        else if (name === "PumpSpeed") root.pumpSpeed = value;
-                        else if (name === "LiquidTemp") root.waterTemp = value;
-                    }
-                });
-
-                disconnectSource(sourceName);
-            }
-        }
-    }
-
-    // Timer to refresh every 5 seconds
-    Timer {
-        interval: plasmoid.configuration.updateInterval
-        running: true
-        repeat: true
-        triggeredOnStart: true
-
-        onTriggered: {
-            if (root.expanded) {
-                root.doUpdate();
-            }
+            disconnectSource(sourceName);
         }
     }
 
+    // Switched inside the running daemon, no service restart
     function runCmd(mode) {
         let timestamp = Date.now();
-        let command = "sh -c \"systemctl stop 'my_msi_coreliquid_driver@*' && systemctl start 'my_msi_coreliquid_driver@" + mode + "'\" #" + timestamp;
+        let command = "qdbus --system io.github.MSICoreliquid /io/github/MSICoreliquid \
+                       io.github.MSICoreliquid.SetFanMode " + mode + " #" + timestamp;
         executable.connectSource(command);
 
-        root.activeMode = mode.toString()
         root.expanded = false;
     }
 